@@ -20,16 +20,72 @@
 #define Cos(th) cos(3.1415926/180*(th))
 #define Sin(th) sin(3.1415926/180*(th))
 
+//  Material
+typedef struct
+{
+   char* name;                 //  Material name
+   float Ka[4],Kd[4],Ks[4],Ns; //  Colors and shininess
+   float d;                    //  Transparency
+   int map;                    //  Texture
+} mtl_t;
+
+//  Triangles of one material
+typedef struct
+{
+   int first,count;            //  Indices
+   int mtl;                    //  Material (-1 for none)
+} mesh_group_t;
+
+//  Indexed triangle mesh from an OBJ file
+typedef struct
+{
+   int nv;                     //  Vertices
+   float* xyz;                 //  Positions (3 per vertex)
+   float* nrm;                 //  Normals (3 per vertex)
+   float* st;                  //  Texture coordinates (2 per vertex)
+   int hasnormal,hastex;       //  Normals and texture coordinates in file
+   int ni;                     //  Indices
+   unsigned int* idx;          //  Triangle indices
+   int ngroup;                 //  Material groups
+   mesh_group_t* group;
+   int nmtl;                   //  Materials
+   mtl_t* mtl;
+   float min[3],max[3];        //  Bounding box
+} mesh_t;
+
+//  OBJ file being read in pieces
+typedef struct mesh_stream mesh_stream_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void Print(const char* format , ...);
+void PrintFlush(void);
 void Fatal(const char* format , ...);
 unsigned int LoadTexBMP(const char* file);
+int CheckBMP(const char* file);
+unsigned char* ReadBMPRaw(const char* file,int* width,int* height);
+void DecodeBMP(unsigned char* image,int width,int height);
+unsigned char* ReadBMP(const char* file,int* width,int* height);
+void TexImageBMP(unsigned int texture,const char* file,const unsigned char* image,int dx,int dy);
 void Project(double fov,double asp,double dim);
 void ErrCheck(const char* where);
+double Elapsed(void);
 int  LoadOBJ(const char* file);
+int  CheckOBJ(const char* file,int* n);
+mesh_t* LoadMesh(const char* file);
+void FreeMesh(mesh_t* mesh);
+mesh_stream_t* MeshStreamOpen(const char* file,int fatal);
+mesh_t* MeshStreamNext(mesh_stream_t* s,int maxtri);
+float MeshStreamProgress(const mesh_stream_t* s);
+void MeshStreamBounds(const mesh_stream_t* s,float min[3],float max[3]);
+long MeshStreamBytes(const mesh_stream_t* s);
+const char* MeshStreamError(const mesh_stream_t* s);
+void MeshStreamClose(mesh_stream_t* s);
+void MeshMaterial(const mesh_t* mesh,int k);
+void MeshOptimize(mesh_t* mesh);
+void MeshCacheStats(const mesh_t* mesh,int size,float* acmr,float* atvr);
 
 #ifdef __cplusplus
 }
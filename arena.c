@@ -0,0 +1,161 @@
+/*
+ *  Per-frame arena allocator
+ */
+#include "CSCIx229.h"
+#include "arena.h"
+#include "jobs.h"
+
+//  Heap block borrowed by an arena that ran out of space
+typedef union block_u
+{
+   union block_u* next;
+   char           align[ARENA_ALIGN];
+} block_t;
+
+//  One arena
+typedef struct
+{
+   char*    base;   //  Main block
+   size_t   size;   //  Size of main block
+   char*    top;    //  Next free byte
+   size_t   left;   //  Bytes left at top
+   size_t   used;   //  Bytes allocated this frame
+   size_t   high;   //  Most bytes allocated in a frame
+   block_t* extra;  //  Borrowed blocks
+   int      allocs; //  Heap allocations this frame
+   int      heap;   //  Heap allocations since start
+   long     last;   //  Last frame that allocated from the heap
+   char     pad[64];//  Keep arenas of different threads off the same cache line
+} arena_t;
+
+static arena_t arena[2][JOBS_MAX];  //  Arenas for alternate frames
+static int     cur=0;               //  Set in use this frame
+static long    frame=0;             //  Frames started
+
+/*
+ *  Report high water marks at exit
+ */
+static void ArenaReport(void)
+{
+   size_t high=0;
+   long last=0;
+   int i,k,n=0,heap=0;
+   for (i=0;i<2;i++)
+      for (k=0;k<JOBS_MAX;k++)
+      {
+         const arena_t* a = &arena[i][k];
+         if (!a->heap) continue;
+         high += a->high;
+         heap += a->heap;
+         if (a->last>last) last = a->last;
+         n++;
+      }
+   if (!n) return;
+   fprintf(stderr,"Frame arenas: %d in use, %ld bytes high water, %d heap allocations (last in frame %ld of %ld)\n",
+      n,(long)high,heap,last,frame);
+}
+
+/*
+ *  Empty an arena, folding borrowed blocks into one main block
+ */
+static void Reset(arena_t* a)
+{
+   a->allocs = 0;
+   if (a->extra)
+   {
+      while (a->extra)
+      {
+         block_t* b = a->extra;
+         a->extra = b->next;
+         free(b);
+      }
+      //  Contents are dead, so there is nothing to copy
+      free(a->base);
+      a->size = a->high<ARENA_MIN ? ARENA_MIN : (a->high+4095)&~(size_t)4095;
+      a->base = (char*)malloc(a->size);
+      if (!a->base) Fatal("Cannot allocate %ld byte frame arena\n",(long)a->size);
+      a->allocs = 1;
+      a->heap++;
+      a->last = frame;
+   }
+   a->top  = a->base;
+   a->left = a->size;
+   a->used = 0;
+}
+
+/*
+ *  Start a new frame
+ *    Everything allocated two frames ago is released
+ */
+void ArenaFrame(void)
+{
+   int k;
+   if (!frame) atexit(ArenaReport);
+   frame++;
+   cur = 1-cur;
+   for (k=0;k<JOBS_MAX;k++)
+      if (arena[cur][k].base || arena[cur][k].extra)
+         Reset(&arena[cur][k]);
+}
+
+/*
+ *  Allocate size bytes for this frame from the arena of part
+ *    Only the thread running part may use its arena
+ */
+void* ArenaAlloc(int part,size_t size)
+{
+   arena_t* a = &arena[cur][part];
+   void* p;
+   size = (size+ARENA_ALIGN-1)&~(size_t)(ARENA_ALIGN-1);
+   //  First use
+   if (!a->base && !a->extra)
+   {
+      a->size = size<ARENA_MIN ? ARENA_MIN : size;
+      a->base = (char*)malloc(a->size);
+      if (!a->base) Fatal("Cannot allocate %ld byte frame arena\n",(long)a->size);
+      a->top  = a->base;
+      a->left = a->size;
+      a->allocs++;
+      a->heap++;
+      a->last = frame;
+   }
+   //  Borrow a block to finish the frame
+   if (size>a->left)
+   {
+      size_t n = size>a->size ? size : a->size;
+      block_t* b;
+      if (n<ARENA_MIN) n = ARENA_MIN;
+      b = (block_t*)malloc(sizeof(block_t)+n);
+      if (!b) Fatal("Cannot allocate %ld bytes for frame arena\n",(long)n);
+      b->next  = a->extra;
+      a->extra = b;
+      a->top   = (char*)(b+1);
+      a->left  = n;
+      a->allocs++;
+      a->heap++;
+      a->last = frame;
+   }
+   p = a->top;
+   a->top  += size;
+   a->left -= size;
+   a->used += size;
+   if (a->used>a->high) a->high = a->used;
+   return p;
+}
+
+/*
+ *  Bytes allocated this frame, high water mark and heap allocations this
+ *  frame, summed over threads
+ */
+void ArenaStats(size_t* used,size_t* high,int* allocs)
+{
+   int k;
+   *used = *high = 0;
+   *allocs = 0;
+   for (k=0;k<JOBS_MAX;k++)
+   {
+      *used   += arena[cur][k].used;
+      *high   += arena[cur][k].high;
+      *allocs += arena[cur][k].allocs;
+   }
+}
@@ -0,0 +1,33 @@
+/*
+ *  Per-frame arena allocator
+ *
+ *  Transient render data is carved out of a bump allocator that is reset
+ *  at the start of each frame instead of being malloced and freed.  There
+ *  are two sets of arenas used in alternate frames, so data allocated in
+ *  one frame stays valid until the end of the next.  Each JobsRun part has
+ *  its own arena (part 0 is the GL thread), so workers allocate without
+ *  locking.  An arena that overflows borrows a heap block for the rest of
+ *  the frame and is resized to its high water mark when it is next reset,
+ *  so once the frame size has settled no heap allocations happen at all.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16     //  Alignment of every allocation
+#define ARENA_MIN   65536  //  Smallest arena in bytes
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void  ArenaFrame(void);
+void* ArenaAlloc(int part,size_t size);
+void  ArenaStats(size_t* used,size_t* high,int* allocs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,401 @@
+/*
+ *  Textures and models that reload when their files change
+ */
+#include "CSCIx229.h"
+#include "asset.h"
+#include "atlas.h"
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+//  Registered texture
+typedef struct
+{
+   char*          file;     //  Source file
+   const char*    base;     //  File name without the directory
+   int            wd;       //  Watch on the directory
+   unsigned int   texture;  //  Texture name
+   int            atlas;    //  Image in the atlas (-1 if it has its own texture)
+   unsigned char* image;    //  Decoded image waiting for AssetPoll
+   int            dx,dy;    //  Image size
+} texasset_t;
+
+//  Texture of the startup manifest
+typedef struct
+{
+   const char*    file;     //  Source file
+   pthread_t      thread;   //  Thread reading it
+   unsigned char* image;    //  Decoded image
+   int            dx,dy;    //  Image size
+   double         t0;       //  Time reading started
+   double         read;     //  Time to read the file
+   double         decode;   //  Time to decode the image
+   double         pack;     //  Time to copy it into the atlas
+} preload_t;
+
+//  Startup event
+typedef struct
+{
+   const char* what;
+   double      t;
+} mark_t;
+
+static texasset_t      tex[ASSET_MAX];
+static int             Ntex=0;
+static model_t**       model=NULL;   //  Registered model
+static char*           mfile=NULL;   //  Model file
+static const char*     mbase=NULL;   //  Model file name without the directory
+static int             mwd=-1;       //  Watch on the model directory
+static model_t*        next=NULL;    //  Replacement model being streamed
+static int             stale=0;      //  Model files changed
+static unsigned int    generation=0; //  Swaps so far
+static unsigned int    swaps=0;      //  Model swaps so far
+static int             started=0;    //  Watcher started
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static preload_t       pre[ASSET_MAX];
+static int             Npre=0;
+static mark_t          mark[ASSET_MARKS];
+static int             Nmark=0;
+
+#ifdef __linux__
+static int fd=-1;  //  inotify instance
+
+/*
+ *  Watch the directory holding file
+ *    Returns the watch (inotify reuses it for the same directory)
+ */
+static int Watch(const char* file,const char** base)
+{
+   char dir[4096];
+   const char* slash = strrchr(file,'/');
+   if (fd<0) fd = inotify_init();
+   if (fd<0) return -1;
+   if (slash)
+   {
+      int n = slash-file;
+      if (n>=(int)sizeof(dir)) n = sizeof(dir)-1;
+      memcpy(dir,file,n);
+      dir[n] = 0;
+      if (!n) strcpy(dir,"/");
+      *base = slash+1;
+   }
+   else
+   {
+      strcpy(dir,".");
+      *base = file;
+   }
+   return inotify_add_watch(fd,dir,IN_CLOSE_WRITE|IN_MOVED_TO);
+}
+
+/*
+ *  True if name ends with ext
+ */
+static int Ext(const char* name,const char* ext)
+{
+   int n = strlen(name),m = strlen(ext);
+   return n>m && !strcmp(name+n-m,ext);
+}
+
+/*
+ *  File name in directory wd was written
+ */
+static void Changed(int wd,const char* name)
+{
+   int k;
+   //  Registered texture: decode it here
+   for (k=0;k<Ntex;k++)
+      if (tex[k].wd==wd && !strcmp(tex[k].base,name))
+      {
+         int dx,dy;
+         unsigned char* image = ReadBMP(tex[k].file,&dx,&dy);
+         if (!image) return;
+         pthread_mutex_lock(&lock);
+         free(tex[k].image);
+         tex[k].image = image;
+         tex[k].dx = dx;
+         tex[k].dy = dy;
+         pthread_mutex_unlock(&lock);
+         return;
+      }
+   //  Model, its materials or their textures
+   if (model && ((wd==mwd && !strcmp(mbase,name)) || Ext(name,".mtl") || Ext(name,".bmp")))
+   {
+      pthread_mutex_lock(&lock);
+      stale = 1;
+      pthread_mutex_unlock(&lock);
+   }
+}
+
+/*
+ *  Watcher thread
+ */
+static void* Watcher(void* arg)
+{
+   union
+   {
+      struct inotify_event e;
+      char buf[4096];
+   } u;
+   for (;;)
+   {
+      int i=0,n = read(fd,u.buf,sizeof(u.buf));
+      if (n<0 && errno==EINTR) continue;
+      if (n<=0) break;
+      while (i<n)
+      {
+         const struct inotify_event* e = (const struct inotify_event*)(u.buf+i);
+         if (e->len) Changed(e->wd,e->name);
+         i += sizeof(struct inotify_event)+e->len;
+      }
+   }
+   return NULL;
+}
+#endif
+
+/*
+ *  Reload texture when file changes
+ */
+static void Register(const char* file,unsigned int texture,int atlas)
+{
+   texasset_t* t;
+   if (Ntex==ASSET_MAX) Fatal("Too many textures (%d)\n",ASSET_MAX);
+   t = tex+Ntex;
+   t->file = (char*)malloc(strlen(file)+1);
+   if (!t->file) Fatal("Cannot allocate texture name\n");
+   strcpy(t->file,file);
+   t->texture = texture;
+   t->atlas = atlas;
+   t->image = NULL;
+#ifdef __linux__
+   t->wd = Watch(t->file,&t->base);
+#else
+   t->base = t->file;
+   t->wd = -1;
+#endif
+   Ntex++;
+}
+
+/*
+ *  Load a texture and reload it when its file changes
+ */
+unsigned int AssetTexture(const char* file)
+{
+   unsigned int texture = LoadTexBMP(file);
+   Register(file,texture,-1);
+   return texture;
+}
+
+/*
+ *  Read and decode a texture of the manifest
+ */
+static void* Preload(void* arg)
+{
+   preload_t* p = (preload_t*)arg;
+   double t;
+   p->t0 = Elapsed();
+   p->image = ReadBMPRaw(p->file,&p->dx,&p->dy);
+   t = Elapsed();
+   p->read = t-p->t0;
+   if (p->image) DecodeBMP(p->image,p->dx,p->dy);
+   p->decode = Elapsed()-t;
+   return NULL;
+}
+
+/*
+ *  Check that every asset of the manifest can be loaded and start reading
+ *  the textures in parallel
+ *    Lists every missing or unreadable file before exiting, so nothing is
+ *    half initialized.  The model (if any), its MTL files and their images
+ *    are only checked.
+ */
+void AssetPreload(const char* const file[],int n,const char* model)
+{
+   int k,bad=0,files=n;
+   if (n>ASSET_MAX) Fatal("Too many textures (%d)\n",ASSET_MAX);
+   for (k=0;k<n;k++)
+      if (!CheckBMP(file[k])) bad++;
+   if (model)
+   {
+      int m;
+      bad += CheckOBJ(model,&m);
+      files += m;
+   }
+   if (bad) Fatal("%d of %d assets missing or invalid\n",bad,files);
+   //  One thread per texture
+   for (k=0;k<n;k++)
+   {
+      pre[k].file = file[k];
+      pre[k].image = NULL;
+      if (pthread_create(&pre[k].thread,NULL,Preload,pre+k)) Fatal("Cannot start thread loading %s\n",file[k]);
+   }
+   Npre = n;
+   AssetMark("validated");
+}
+
+/*
+ *  Pack the textures of the manifest into the atlas once they are decoded
+ *    Image k of the atlas is texture k of the manifest.  Needs the OpenGL
+ *    context.  The images reload when their files change.
+ */
+void AssetUpload(void)
+{
+   int k,w[ASSET_MAX],h[ASSET_MAX];
+   for (k=0;k<Npre;k++)
+   {
+      pthread_join(pre[k].thread,NULL);
+      if (!pre[k].image) Fatal("Cannot load texture %s\n",pre[k].file);
+      w[k] = pre[k].dx;
+      h[k] = pre[k].dy;
+   }
+   AtlasPack(w,h,Npre);
+   for (k=0;k<Npre;k++)
+   {
+      double t = Elapsed();
+      AtlasCopy(k,pre[k].image);
+      free(pre[k].image);
+      pre[k].image = NULL;
+      pre[k].pack = Elapsed()-t;
+      Register(pre[k].file,0,k);
+   }
+   AtlasUpload();
+   AssetMark("textures");
+}
+
+/*
+ *  Note the time of a startup event
+ */
+void AssetMark(const char* what)
+{
+   if (Nmark==ASSET_MARKS) return;
+   mark[Nmark].what = what;
+   mark[Nmark].t = Elapsed();
+   Nmark++;
+}
+
+/*
+ *  Report the startup timeline
+ *    Times are from the first mark (the start of main)
+ */
+void AssetTimeline(void)
+{
+   int k;
+   double t0 = Nmark ? mark[0].t : 0;
+   fprintf(stderr,"Startup timeline (ms)\n");
+   for (k=0;k<Npre;k++)
+      fprintf(stderr,"  %-32s at %7.1f read %6.1f decode %6.1f pack %6.1f\n",pre[k].file,
+         1e3*(pre[k].t0-t0),1e3*pre[k].read,1e3*pre[k].decode,1e3*pre[k].pack);
+   for (k=0;k<Nmark;k++)
+      fprintf(stderr,"  %-32s at %7.1f\n",mark[k].what,1e3*(mark[k].t-t0));
+}
+
+/*
+ *  Reload the model when its files change
+ */
+void AssetModel(model_t** m)
+{
+   model = m;
+   //  Own copy, since the model is replaced
+   mfile = (char*)malloc(strlen((*m)->file)+1);
+   if (!mfile) Fatal("Cannot allocate model name\n");
+   strcpy(mfile,(*m)->file);
+#ifdef __linux__
+   {
+      const char* base;
+      mwd = Watch(mfile,&mbase);
+      //  MTL files and their textures are opened from the working directory
+      Watch("./",&base);
+   }
+#else
+   mbase = mfile;
+#endif
+}
+
+/*
+ *  Swap in assets whose files have changed
+ *    Call at the start of a frame
+ */
+void AssetPoll(void)
+{
+   int k,restart,dx[ASSET_MAX],dy[ASSET_MAX];
+   unsigned char* image[ASSET_MAX];
+#ifdef __linux__
+   //  Start watching
+   if (!started && fd>=0)
+   {
+      pthread_t thread;
+      if (pthread_create(&thread,NULL,Watcher,NULL)) Fatal("Cannot start asset watcher\n");
+      pthread_detach(thread);
+   }
+#endif
+   started = 1;
+   //  Take the decoded images
+   pthread_mutex_lock(&lock);
+   for (k=0;k<Ntex;k++)
+   {
+      //  The size goes with the image, since the watcher may decode another
+      image[k] = tex[k].image;
+      dx[k] = tex[k].dx;
+      dy[k] = tex[k].dy;
+      tex[k].image = NULL;
+   }
+   restart = stale;
+   stale = 0;
+   pthread_mutex_unlock(&lock);
+   //  Replace the texture images
+   for (k=0;k<Ntex;k++)
+      if (image[k])
+      {
+         if (tex[k].atlas>=0)
+            AtlasImage(tex[k].atlas,image[k],dx[k],dy[k]);
+         else
+         {
+            TexImageBMP(tex[k].texture,tex[k].file,image[k],dx[k],dy[k]);
+            glBindTexture(GL_TEXTURE_2D,0);
+         }
+         free(image[k]);
+         generation++;
+         printf("Reloaded %s\n",tex[k].file);
+      }
+   //  Start (or start over) streaming the model
+   if (model && *model && restart)
+   {
+      ModelFree(next);
+      next = ModelOpen((*model)->file,(*model)->format,(*model)->tris>0?(*model)->tris:ASSET_PIECE,0);
+   }
+   //  Keep the old model if the new files have an error
+   if (next && ModelStream(next)<0)
+   {
+      fprintf(stderr,"Keeping the old %s: %s",next->file,MeshStreamError(next->stream));
+      ModelFree(next);
+      next = NULL;
+   }
+   //  Swap it in once it is complete
+   else if (next && !next->stream)
+   {
+      ModelFree(*model);
+      *model = next;
+      next = NULL;
+      generation++;
+      swaps++;
+      printf("Reloaded %s\n",(*model)->file);
+   }
+}
+
+/*
+ *  Number of assets swapped so far
+ */
+unsigned int AssetGeneration(void)
+{
+   return generation;
+}
+
+/*
+ *  Number of times the model was swapped so far
+ */
+unsigned int AssetModelGeneration(void)
+{
+   return swaps;
+}
@@ -0,0 +1,59 @@
+/*
+ *  Textures and models that reload when their files change
+ *
+ *  AssetTexture and AssetModel register an asset along with the file it
+ *  came from.  On Linux a watcher thread follows the directories of those
+ *  files with inotify.  A texture file that is written is decoded on the
+ *  watcher thread.  A model is marked stale when its OBJ file, an MTL file
+ *  or a texture that is not registered (a map_Kd image) is written.
+ *
+ *  AssetPoll is called at the start of each frame.  It copies decoded
+ *  images into the existing textures (or atlas images) and streams a
+ *  replacement for a stale model a piece per frame, swapping it in once it
+ *  is complete, so a frame sees either the old or the new asset and never
+ *  a mixture.  A replacement with an error in its files (say one saved
+ *  half way) is dropped with a message and the old model is kept.
+ *  AssetGeneration counts the swaps so caches made from the assets (the
+ *  impostor atlas) know to rebuild.  AssetModelGeneration only counts model
+ *  swaps, for caches of its geometry.
+ *
+ *  Register everything before the first AssetPoll, which starts the
+ *  watcher.
+ *
+ *  At startup AssetPreload checks the whole manifest of textures (and the
+ *  model with its MTL files and their images) before the window is
+ *  created, so a missing file ends the program with a list of every
+ *  problem instead of part way through.  Each texture is then read and
+ *  decoded on a thread of its own while the window opens, and AssetUpload
+ *  packs them into the atlas (atlas.h) once there is a context.  AssetMark
+ *  notes startup events and AssetTimeline reports them with the read,
+ *  decode and packing times of each texture.
+ */
+#ifndef ASSET_H
+#define ASSET_H
+
+#include "model.h"
+
+#define ASSET_MAX    64     //  Most textures
+#define ASSET_PIECE  65536  //  Triangles per frame when reloading a model
+#define ASSET_MARKS  16     //  Most startup events
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned int AssetTexture(const char* file);
+void         AssetModel(model_t** model);
+void         AssetPoll(void);
+unsigned int AssetGeneration(void);
+unsigned int AssetModelGeneration(void);
+void         AssetPreload(const char* const file[],int n,const char* model);
+void         AssetUpload(void);
+void         AssetMark(const char* what);
+void         AssetTimeline(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
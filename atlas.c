@@ -0,0 +1,271 @@
+/*
+ *  Texture atlas
+ */
+#include "CSCIx229.h"
+#include "glstats.h"
+#include "atlas.h"
+
+//  Image in the atlas
+typedef struct
+{
+   int   page;   //  Page
+   int   x,y;    //  Corner of the border
+   int   w,h;    //  Image size
+   float st[4];  //  Texture coordinates of the image (s0,t0,s1,t1)
+} image_t;
+
+//  Page of the atlas
+typedef struct
+{
+   int            w,h;     //  Size
+   unsigned char* pixels;  //  RGB texels kept for reloads
+   unsigned int   texture; //  Texture name
+} page_t;
+
+static image_t img[ATLAS_MAX];
+static page_t  page[ATLAS_MAX];
+static int     Nimg=0,Npage=0;
+static int     bound=-1;  //  Page bound last
+
+/*
+ *  Round n up to a multiple of the border
+ */
+static int Align(int n)
+{
+   return (n+ATLAS_BORDER-1) & ~(ATLAS_BORDER-1);
+}
+
+/*
+ *  Halve a w x h RGB image with a 2x2 box filter
+ *    Returns the new image (free when done)
+ */
+static unsigned char* Reduce(const unsigned char* src,int w,int h)
+{
+   int i,j,k;
+   unsigned char* dst = (unsigned char*)malloc(3*(w/2)*(h/2));
+   if (!dst) Fatal("Cannot allocate %dx%d mipmap\n",w/2,h/2);
+   for (j=0;j<h/2;j++)
+      for (i=0;i<w/2;i++)
+         for (k=0;k<3;k++)
+         {
+            const unsigned char* p = src+3*(2*j*w+2*i)+k;
+            dst[3*(j*(w/2)+i)+k] = (p[0]+p[3]+p[3*w]+p[3*w+3]+2)/4;
+         }
+   return dst;
+}
+
+/*
+ *  Load the w x h RGB image at (x,y) of the bound page and its mipmaps
+ *    With x, y, w and h multiples of the border the levels line up
+ */
+static void Levels(const unsigned char* image,int x,int y,int w,int h,int whole)
+{
+   int l;
+   const unsigned char* cur = image;
+   //  Level rows are not padded
+   glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+   for (l=0;l<=ATLAS_LEVELS;l++)
+   {
+      if (l)
+      {
+         unsigned char* next = Reduce(cur,w,h);
+         if (cur!=image) free((void*)cur);
+         cur = next;
+         w /= 2;
+         h /= 2;
+      }
+      if (whole)
+         glTexImage2D(GL_TEXTURE_2D,l,GL_RGB8,w,h,0,GL_RGB,GL_UNSIGNED_BYTE,cur);
+      else
+         glTexSubImage2D(GL_TEXTURE_2D,l,x>>l,y>>l,w,h,GL_RGB,GL_UNSIGNED_BYTE,cur);
+   }
+   if (cur!=image) free((void*)cur);
+   glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+}
+
+/*
+ *  Place n images of size w x h on pages
+ *    Images are copied in with AtlasCopy and the pages made with AtlasUpload
+ */
+void AtlasPack(const int w[],const int h[],int n)
+{
+   int order[ATLAS_MAX];
+   int i,j,k,x=0,y=0,shelf=0;
+   long used=0,total=0;
+   char sizes[256]="";
+   if (n>ATLAS_MAX) Fatal("Too many images for the atlas (%d)\n",ATLAS_MAX);
+   //  Tallest first so each shelf is as high as its first image
+   for (i=0;i<n;i++)
+   {
+      for (j=i;j>0 && h[order[j-1]]<h[i];j--)
+         order[j] = order[j-1];
+      order[j] = i;
+   }
+   Npage = 0;
+   for (i=0;i<n;i++)
+   {
+      int W,H;
+      k = order[i];
+      W = Align(w[k]+2*ATLAS_BORDER);
+      H = Align(h[k]+2*ATLAS_BORDER);
+      if (W>ATLAS_SIZE || H>ATLAS_SIZE) Fatal("%dx%d image too large for the atlas\n",w[k],h[k]);
+      //  Next shelf
+      if (x+W>ATLAS_SIZE)
+      {
+         y += shelf;
+         x = shelf = 0;
+      }
+      //  Next page
+      if (!Npage || y+H>ATLAS_SIZE)
+      {
+         page[Npage].w = page[Npage].h = 0;
+         Npage++;
+         x = y = shelf = 0;
+      }
+      img[k].page = Npage-1;
+      img[k].x = x;
+      img[k].y = y;
+      img[k].w = w[k];
+      img[k].h = h[k];
+      x += W;
+      if (H>shelf) shelf = H;
+      if (x>page[Npage-1].w) page[Npage-1].w = x;
+      if (y+H>page[Npage-1].h) page[Npage-1].h = y+H;
+   }
+   Nimg = n;
+   //  Trimmed pages
+   for (i=0;i<Npage;i++)
+   {
+      page[i].pixels = (unsigned char*)calloc(3*page[i].w,page[i].h);
+      if (!page[i].pixels) Fatal("Cannot allocate %dx%d atlas page\n",page[i].w,page[i].h);
+      total += page[i].w*page[i].h;
+      if (strlen(sizes)<sizeof(sizes)-16) sprintf(sizes+strlen(sizes)," %dx%d",page[i].w,page[i].h);
+   }
+   //  Texture coordinates of the images
+   for (k=0;k<n;k++)
+   {
+      const page_t* p = page+img[k].page;
+      img[k].st[0] = (float)(img[k].x+ATLAS_BORDER)/p->w;
+      img[k].st[1] = (float)(img[k].y+ATLAS_BORDER)/p->h;
+      img[k].st[2] = (float)(img[k].x+ATLAS_BORDER+img[k].w)/p->w;
+      img[k].st[3] = (float)(img[k].y+ATLAS_BORDER+img[k].h)/p->h;
+      used += img[k].w*img[k].h;
+   }
+   printf("Atlas: %d images in %d pages of%s texels, %.0f%% used\n",n,Npage,sizes,total?100.0*used/total:0);
+}
+
+/*
+ *  Copy RGB image k (rows padded to 4 bytes) into its page
+ *    The border repeats the edge texels
+ */
+void AtlasCopy(int k,const unsigned char* image)
+{
+   const image_t* m = img+k;
+   page_t* p = page+m->page;
+   int row = (3*m->w+3)&~3;
+   int i,j;
+   for (j=-ATLAS_BORDER;j<m->h+ATLAS_BORDER;j++)
+   {
+      const unsigned char* src = image+row*(j<0 ? 0 : j<m->h ? j : m->h-1);
+      unsigned char* dst = p->pixels+3*((m->y+ATLAS_BORDER+j)*p->w+m->x+ATLAS_BORDER);
+      memcpy(dst,src,3*m->w);
+      for (i=1;i<=ATLAS_BORDER;i++)
+      {
+         memcpy(dst-3*i,src,3);
+         memcpy(dst+3*(m->w+i-1),src+3*(m->w-1),3);
+      }
+   }
+}
+
+/*
+ *  Make textures of the pages
+ */
+void AtlasUpload(void)
+{
+   int i;
+   for (i=0;i<Npage;i++)
+   {
+      glGenTextures(1,&page[i].texture);
+      glBindTexture(GL_TEXTURE_2D,page[i].texture);
+      Levels(page[i].pixels,0,0,page[i].w,page[i].h,1);
+      if (glGetError()) Fatal("Error making %dx%d atlas page\n",page[i].w,page[i].h);
+      //  Coarser levels would blend neighbouring images
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,ATLAS_LEVELS);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+   }
+   glBindTexture(GL_TEXTURE_2D,0);
+   bound = -1;
+}
+
+/*
+ *  Replace image k with a new w x h image
+ *    An image of another size is scaled (nearest texel) to the old size
+ */
+void AtlasImage(int k,const unsigned char* image,int w,int h)
+{
+   const image_t* m = img+k;
+   page_t* p = page+m->page;
+   unsigned char* scaled=NULL;
+   unsigned char* slot;
+   int j,W=Align(m->w+2*ATLAS_BORDER),H=Align(m->h+2*ATLAS_BORDER);
+   if (w!=m->w || h!=m->h)
+   {
+      int i,row=(3*w+3)&~3,ROW=(3*m->w+3)&~3;
+      scaled = (unsigned char*)malloc(ROW*m->h);
+      if (!scaled) Fatal("Cannot allocate %dx%d image\n",m->w,m->h);
+      for (j=0;j<m->h;j++)
+         for (i=0;i<m->w;i++)
+            memcpy(scaled+ROW*j+3*i,image+row*(j*h/m->h)+3*(i*w/m->w),3);
+      image = scaled;
+   }
+   AtlasCopy(k,image);
+   free(scaled);
+   //  Upload the slot of the image and its mipmaps
+   slot = (unsigned char*)malloc(3*W*H);
+   if (!slot) Fatal("Cannot allocate %dx%d image\n",W,H);
+   for (j=0;j<H;j++)
+      memcpy(slot+3*W*j,p->pixels+3*((m->y+j)*p->w+m->x),3*W);
+   glBindTexture(GL_TEXTURE_2D,p->texture);
+   Levels(slot,m->x,m->y,W,H,0);
+   glBindTexture(GL_TEXTURE_2D,0);
+   free(slot);
+   bound = -1;
+}
+
+/*
+ *  Texture coordinates of image k (s0,t0,s1,t1)
+ */
+const float* AtlasRect(int k)
+{
+   return img[k].st;
+}
+
+/*
+ *  Set texture coordinate (s,t) of image k
+ */
+void AtlasCoord(int k,float s,float t)
+{
+   const float* st = img[k].st;
+   glTexCoord2f(st[0]+s*(st[2]-st[0]),st[1]+t*(st[3]-st[1]));
+}
+
+/*
+ *  Forget the page bound last
+ */
+void AtlasBegin(void)
+{
+   bound = -1;
+}
+
+/*
+ *  Bind the page of image k unless it is bound already
+ */
+void AtlasBind(int k)
+{
+   if (img[k].page==bound) return;
+   bound = img[k].page;
+   glBindTexture(GL_TEXTURE_2D,page[bound].texture);
+}
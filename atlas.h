@@ -0,0 +1,41 @@
+/*
+ *  Texture atlas
+ *
+ *  Textures are packed into shared pages so objects with different textures
+ *  are drawn without binding between them.  Images are sorted by height and
+ *  placed on shelves, and each page is trimmed to the area used.  Every
+ *  image is surrounded by ATLAS_BORDER copies of its edge texels and placed
+ *  on a multiple of the border, so the mipmap levels up to ATLAS_LEVELS
+ *  never blend in a neighbouring image.
+ *
+ *  AtlasCoord maps texture coordinates in [0,1] into the rectangle of an
+ *  image, so geometry using the atlas must not repeat its textures.
+ *  AtlasBind binds the page of an image only when it is not the page bound
+ *  last; AtlasBegin forgets the page after other code has bound textures.
+ */
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#define ATLAS_MAX    64    //  Most images
+#define ATLAS_SIZE   2048  //  Most texels on a side of a page
+#define ATLAS_LEVELS 3     //  Mipmap levels kept apart
+#define ATLAS_BORDER (1<<ATLAS_LEVELS)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void AtlasPack(const int w[],const int h[],int n);
+void AtlasCopy(int k,const unsigned char* image);
+void AtlasUpload(void);
+void AtlasImage(int k,const unsigned char* image,int w,int h);
+const float* AtlasRect(int k);
+void AtlasCoord(int k,float s,float t);
+void AtlasBegin(void);
+void AtlasBind(int k);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,348 @@
+/*
+ *  Asynchronous frame capture
+ *
+ *  Frame n is read into pbo[n%NPBO] and mapped NPBO-1 frames later, by which
+ *  time the transfer has completed.  The pixels are copied into a free
+ *  writer slot and the writer thread encodes them to disk.
+ */
+#include "CSCIx229.h"
+#include "capture.h"
+#include <pthread.h>
+#include <sched.h>
+
+#define NPBO  3  //  Pixel buffer objects in flight
+#define NSLOT 4  //  Frames queued for the writer
+
+//  Frame waiting to be written
+typedef struct
+{
+   unsigned char* pix;  //  RGB pixels, bottom row first
+   size_t         size; //  Allocated size
+   int            w,h;  //  Dimensions
+   int            n;    //  Frame number
+   int            full; //  Waiting for writer
+} slot_t;
+
+static char            dir[1024];     //  Output directory
+static int             fmt=0;         //  0=ppm 1=png 2=raw
+static int             on=0;          //  Capture enabled
+static unsigned int    pbo[NPBO];     //  Pixel buffer objects
+static int             pw[NPBO],ph[NPBO]; //  Size of frame in each PBO
+static int             frame=0;       //  Frames read back
+static int             saved=0;       //  Frames written
+static int             dropped=0;     //  Frames dropped
+static double          cost=0;        //  Time spent in CaptureFrame
+static double          t0=-1,t1=0;    //  First and last call
+static slot_t          slot[NSLOT];   //  Writer queue
+static int             head=0,tail=0; //  Queue positions
+static int             quit=0;        //  Writer should exit
+static pthread_t       writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ *  CRC32 for PNG chunks
+ */
+static unsigned int crc32(unsigned int crc,const unsigned char* buf,size_t n)
+{
+   static unsigned int table[256];
+   size_t k;
+   if (!table[1])
+   {
+      unsigned int i,j;
+      for (i=0;i<256;i++)
+      {
+         unsigned int c = i;
+         for (j=0;j<8;j++)
+            c = (c&1) ? 0xEDB88320^(c>>1) : c>>1;
+         table[i] = c;
+      }
+   }
+   crc = ~crc;
+   for (k=0;k<n;k++)
+      crc = table[(crc^buf[k])&0xFF]^(crc>>8);
+   return ~crc;
+}
+
+/*
+ *  Write big endian 32 bit integer
+ */
+static void put32(unsigned char* b,unsigned int x)
+{
+   b[0] = x>>24; b[1] = x>>16; b[2] = x>>8; b[3] = x;
+}
+
+/*
+ *  Write PNG chunk
+ */
+static void chunk(FILE* f,const char* type,const unsigned char* data,unsigned int n)
+{
+   unsigned char b[4];
+   unsigned int crc = crc32(0,(const unsigned char*)type,4);
+   crc = crc32(crc,data,n);
+   put32(b,n);   fwrite(b,4,1,f);
+   fwrite(type,4,1,f);
+   fwrite(data,1,n,f);
+   put32(b,crc); fwrite(b,4,1,f);
+}
+
+/*
+ *  Write PNG using stored (uncompressed) deflate blocks
+ *    Keeps the writer cheap and free of external libraries
+ */
+static void WritePNG(FILE* f,const slot_t* s)
+{
+   const unsigned char sig[8] = {137,'P','N','G',13,10,26,10};
+   unsigned char  hdr[13];
+   unsigned char* z;
+   size_t row = 3*s->w+1;          //  Filter byte plus pixels
+   size_t raw = row*s->h;          //  Uncompressed image size
+   size_t nblk = (raw+65534)/65535; //  Stored blocks
+   size_t n = 2+raw+5*nblk+4;      //  zlib stream size
+   size_t i,k=0,pos=0;
+   unsigned int a=1,b=0;
+   int y;
+
+   //  Header
+   fwrite(sig,8,1,f);
+   put32(hdr,s->w);
+   put32(hdr+4,s->h);
+   hdr[8] = 8;  //  Bit depth
+   hdr[9] = 2;  //  RGB
+   hdr[10] = hdr[11] = hdr[12] = 0;
+   chunk(f,"IHDR",hdr,13);
+
+   //  Build zlib stream of stored blocks (rows flipped to top first)
+   z = (unsigned char*)malloc(n);
+   if (!z) Fatal("Cannot allocate %d bytes for PNG\n",(int)n);
+   z[k++] = 0x78;
+   z[k++] = 0x01;
+   for (y=s->h-1;y>=0;y--)
+   {
+      const unsigned char* src = s->pix+3*(size_t)s->w*y;
+      for (i=0;i<row;i++)
+      {
+         unsigned char c = i ? src[i-1] : 0;
+         //  Start new stored block
+         if (pos%65535==0)
+         {
+            size_t len = raw-pos<65535 ? raw-pos : 65535;
+            z[k++] = (raw-pos<=65535);
+            z[k++] = len;   z[k++] = len>>8;
+            z[k++] = ~len;  z[k++] = (~len)>>8;
+         }
+         z[k++] = c;
+         pos++;
+         //  Adler32
+         a = (a+c)%65521;
+         b = (b+a)%65521;
+      }
+   }
+   put32(z+k,(b<<16)|a);
+   chunk(f,"IDAT",z,n);
+   chunk(f,"IEND",NULL,0);
+   free(z);
+}
+
+/*
+ *  Write frame to disk
+ */
+static void Write(const slot_t* s)
+{
+   static const char* ext[] = {"ppm","png","rgb"};
+   char file[1100];
+   int y;
+   FILE* f;
+   snprintf(file,sizeof(file),"%s/frame%06d.%s",dir,s->n,ext[fmt]);
+   f = fopen(file,"wb");
+   if (!f)
+   {
+      fprintf(stderr,"Cannot open capture file %s\n",file);
+      return;
+   }
+   //  PPM is top row first
+   if (fmt==0)
+   {
+      fprintf(f,"P6\n%d %d\n255\n",s->w,s->h);
+      for (y=s->h-1;y>=0;y--)
+         fwrite(s->pix+3*(size_t)s->w*y,3,s->w,f);
+   }
+   else if (fmt==1)
+      WritePNG(f,s);
+   //  Raw is as read (bottom row first)
+   else
+      fwrite(s->pix,3*(size_t)s->w,s->h,f);
+   fclose(f);
+}
+
+/*
+ *  Writer thread
+ */
+static void* WriterThread(void* arg)
+{
+   pthread_mutex_lock(&lock);
+   for (;;)
+   {
+      slot_t* s = slot+tail;
+      //  Wait for a frame
+      while (!s->full && !quit)
+         pthread_cond_wait(&cond,&lock);
+      if (!s->full) break;
+      //  Encode without holding the lock
+      pthread_mutex_unlock(&lock);
+      Write(s);
+      pthread_mutex_lock(&lock);
+      s->full = 0;
+      saved++;
+      tail = (tail+1)%NSLOT;
+   }
+   pthread_mutex_unlock(&lock);
+   return NULL;
+}
+
+/*
+ *  Map PBO k and queue its frame for the writer
+ *    When wait is zero the frame is dropped if the queue is full
+ */
+static void Queue(int k,int n,int wait)
+{
+   slot_t* s = slot+head;
+   size_t size = 3*(size_t)pw[k]*ph[k];
+   unsigned char* pix;
+   int full;
+
+   pthread_mutex_lock(&lock);
+   while (wait && s->full)
+   {
+      pthread_mutex_unlock(&lock);
+      sched_yield();
+      pthread_mutex_lock(&lock);
+   }
+   full = s->full;
+   pthread_mutex_unlock(&lock);
+   //  Drop the frame rather than wait for the writer
+   if (full)
+   {
+      dropped++;
+      return;
+   }
+   //  Copy pixels out of the PBO
+   glBindBuffer(GL_PIXEL_PACK_BUFFER,pbo[k]);
+   pix = (unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
+   if (pix)
+   {
+      if (s->size<size)
+      {
+         s->pix = (unsigned char*)realloc(s->pix,size);
+         if (!s->pix) Fatal("Cannot allocate %d bytes for capture\n",(int)size);
+         s->size = size;
+      }
+      memcpy(s->pix,pix,size);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      s->w = pw[k];
+      s->h = ph[k];
+      s->n = n;
+      //  Hand to writer
+      pthread_mutex_lock(&lock);
+      s->full = 1;
+      head = (head+1)%NSLOT;
+      pthread_cond_signal(&cond);
+      pthread_mutex_unlock(&lock);
+   }
+   else
+      dropped++;
+   glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+}
+
+/*
+ *  Hand the frames still in PBOs to the writer and stop capturing
+ *    Call on the thread with the GL context before exiting
+ */
+void CaptureFlush(void)
+{
+   int n;
+   if (!on) return;
+   on = 0;
+   for (n=frame-NPBO+1<0?0:frame-NPBO+1;n<frame;n++)
+      Queue(n%NPBO,n,1);
+   if (pbo[0]) glDeleteBuffers(NPBO,pbo);
+   pbo[0] = 0;
+}
+
+/*
+ *  Stop the writer at exit
+ *    This may run on any thread (Fatal), so it makes no GL calls; frames
+ *    not flushed with CaptureFlush are lost.
+ */
+static void CaptureClose(void)
+{
+   int lost = on ? (frame<NPBO-1 ? frame : NPBO-1) : 0;
+   on = 0;
+   //  Let the writer finish, unless it is the thread exiting
+   pthread_mutex_lock(&lock);
+   quit = 1;
+   pthread_cond_signal(&cond);
+   pthread_mutex_unlock(&lock);
+   if (!pthread_equal(pthread_self(),writer)) pthread_join(writer,NULL);
+   //  Report
+   fprintf(stderr,"Captured %d frames to %s, %d dropped",saved,dir,dropped+lost);
+   if (frame>1 && t1>t0)
+      fprintf(stderr,", readback %.3f ms/frame (%.1f%% of frame time)",
+         1000*cost/frame,100*cost/(t1-t0));
+   fprintf(stderr,"\n");
+}
+
+/*
+ *  Start capturing frames to directory dir
+ *    format is ppm, png or raw
+ */
+void CaptureOpen(const char* d,const char* format)
+{
+   if (!strcmp(format,"ppm"))
+      fmt = 0;
+   else if (!strcmp(format,"png"))
+      fmt = 1;
+   else if (!strcmp(format,"raw"))
+      fmt = 2;
+   else
+      Fatal("Unknown capture format %s (ppm, png or raw)\n",format);
+   snprintf(dir,sizeof(dir),"%s",d);
+   if (pthread_create(&writer,NULL,WriterThread,NULL))
+      Fatal("Cannot start capture writer\n");
+   on = 1;
+   atexit(CaptureClose);
+}
+
+/*
+ *  Read back the current frame
+ *    Call after drawing and before glutSwapBuffers
+ */
+void CaptureFrame(void)
+{
+   int k = frame%NPBO;
+   int w,h;
+   double t = Elapsed();
+   if (!on) return;
+   if (t0<0) t0 = t;
+   //  Create PBOs on first use
+   if (!pbo[0]) glGenBuffers(NPBO,pbo);
+   //  Collect the frame read NPBO-1 frames ago
+   if (frame>=NPBO-1)
+      Queue((frame-NPBO+1)%NPBO,frame-NPBO+1,0);
+   //  Start asynchronous read of the whole back buffer
+   w = glutGet(GLUT_WINDOW_WIDTH);
+   h = glutGet(GLUT_WINDOW_HEIGHT);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER,pbo[k]);
+   if (pw[k]!=w || ph[k]!=h)
+   {
+      pw[k] = w;
+      ph[k] = h;
+      glBufferData(GL_PIXEL_PACK_BUFFER,3*pw[k]*ph[k],NULL,GL_STREAM_READ);
+   }
+   glPixelStorei(GL_PACK_ALIGNMENT,1);
+   glReadPixels(0,0,pw[k],ph[k],GL_RGB,GL_UNSIGNED_BYTE,0);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+   frame++;
+   t1 = Elapsed();
+   cost += t1-t;
+}
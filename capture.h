@@ -0,0 +1,27 @@
+/*
+ *  Asynchronous frame capture
+ *
+ *  Frames are read back into a ring of pixel buffer objects and mapped one
+ *  or two frames later, so glReadPixels never waits for the GPU.  A writer
+ *  thread saves them as numbered PPM, PNG or raw RGB files.  Frames are
+ *  dropped (and counted) rather than stalling when the writer falls behind.
+ *  CaptureFlush collects the last frames on the GL thread before a normal
+ *  exit; the exit handler only stops the writer, so it is safe from Fatal
+ *  on any thread.
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void CaptureOpen(const char* dir,const char* format);
+void CaptureFrame(void);
+void CaptureFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
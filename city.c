@@ -7,6 +7,26 @@
  #else
  #include <GL/glut.h>
  #endif
+#include "glstats.h"
+#include "replay.h"
+#include "capture.h"
+#include "scene.h"
+#include "drawlist.h"
+#include "jobs.h"
+#include "occlude.h"
+#include "query.h"
+#include "impostor.h"
+#include "arena.h"
+#include "vecmath.h"
+#include "xform.h"
+#include "shapes.h"
+#include "model.h"
+#include "asset.h"
+#include "atlas.h"
+#include "vtex.h"
+#include "dynres.h"
+#include "collide.h"
+#include "ray.h"
 
 int axes=0;       //  Display axes
 int mode=1;
@@ -35,126 +55,133 @@ int shininess =   0;  // Shininess (power of two)
 float shinyvec[1];    // Shininess (value)
 int zh        =  90;  // Light azimuth
 float ylight  =   20;  // Elevation of light
-unsigned int texture[7]; // Texture names
+//  Textures loaded at startup (atlas image k is manifest[k])
+static const char* const manifest[] = {"textures/central_block.bmp","textures/outide_grass.bmp"};
+#define TEX_BLOCK 0
+#define TEX_GRASS 1
+#define NMANIFEST (int)(sizeof(manifest)/sizeof(manifest[0]))
+int startup=0;           // Startup timeline reported
 
 float fpnx, fpny, fpnz;   // Camera position
 float dirx, diry, dirz; // Camera direction
 float fpn_ang, fpn_p; // Rotation angles
 float orth_x, orth_z; // Orthogonal angles
 
-/*
- *  Convenience routine to output raster text
- *  Use VARARGS to make this more flexible
- */
-#define LEN 8192  //  Maximum length of text string
-void Print(const char* format , ...)
-{
-   char    buf[LEN];
-   char*   ch=buf;
-   va_list args;
-   //  Turn the parameters into a character string
-   va_start(args,format);
-   vsnprintf(buf,LEN,format,args);
-   va_end(args);
-   //  Display the characters one at a time at the current raster position
-   while (*ch)
-      glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
-}
+//  Cameras a view can show
+enum {CAM_ORBIT,CAM_FIRST,CAM_TOP};
+static const char* const camera_name[] = {"Orbit","First person","Top"};
+//  Names of the object types for picking
+static const char* const object_name[OBJ_TYPES] = {"City frame","Ground","Street light","Lamp","Arch building","Skyscraper"};
 
-/*
- *  Draw vertex in polar coordinates with normal
- */
-static void Vertex(double th,double ph)
+//  View of the scene in part of the window
+typedef struct
 {
-   double x = Sin(th)*Cos(ph);
-   double y = Cos(th)*Cos(ph);
-   double z =         Sin(ph);
-   //  For a sphere at the origin, the position
-   //  and normal vectors are the same
-   glNormal3d(x,y,z);
-   glVertex3d(x,y,z);
-}
-
+   int    camera;      //  CAM_ORBIT, CAM_FIRST or CAM_TOP
+   float  x,y,w,h;     //  Part of the window (fractions from the lower left)
+   int    n,occluded;  //  Objects drawn and hidden by occluders last frame
+   double sort;        //  Seconds spent sorting the draw list
+} view_t;
+//  Main view and the insets shown for monitoring
+static view_t view[] =
+{
+   {CAM_ORBIT, 0.00,0.00,1.00,1.00},
+   {CAM_FIRST, 0.66,0.66,0.33,0.33},
+   {CAM_TOP,   0.66,0.32,0.33,0.33},
+};
+#define MAXVIEWS (int)(sizeof(view)/sizeof(view[0]))
+int views=1;             // Views shown
+
+model_t* model=NULL;  // Imported model (-obj)
+int meshlets=1;       // Cull the model's meshlets
+int model_tris=0;     // Model triangles drawn
+
+int pick=0;               // Pick objects with the mouse
+rayhit_t picked;          // Last pick
+int picked_hit=0;         // Last pick hit something
+unsigned int ray_key=~0u; // Model the ray queries were built with
+
+// Level of detail of the object being drawn
+//  (tessgen.c builds tables for these sizes; keep the two in step)
+int lod = 0;
+static const int cyl_slices[LODS] = {20000,64,16};  // Cylinder slices
+static const int cyl_stacks[LODS] = {16,4,1};       // Cylinder stacks
+static const int torus_n[LODS]    = {100,32,12};    // Torus sides and rings
+static const int ball_inc[LODS]   = {10,15,30};     // Lamp sphere increment (0 uses inc)
 
 static void ball(double x,double y,double z,double r)
 {
-   int th,ph;
+   STATS_BEGIN;
    float yellow[] = {1.0,1.0,0.0,1.0};
    float Emission[]  = {0.0,0.0,0.01*emission,1.0};
    //  Save transformation
-   glPushMatrix();
+   MatPush();
    //  Offset, scale and rotate
-   glTranslated(x,y,z);
-   glScaled(r,r,r);
+   MatTranslate(x,y,z);
+   MatScale(r,r,r);
+   MatSync();
    //  White ball
    glColor3f(1,1,1);
    glMaterialfv(GL_FRONT,GL_SHININESS,shinyvec);
    glMaterialfv(GL_FRONT,GL_SPECULAR,yellow);
    glMaterialfv(GL_FRONT,GL_EMISSION,Emission);
    //  Bands of latitude
-   for (ph=-90;ph<90;ph+=inc)
-   {
-      glBegin(GL_QUAD_STRIP);
-      for (th=0;th<=360;th+=2*inc)
-      {
-         Vertex(th,ph);
-         Vertex(th,ph+inc);
-      }
-      glEnd();
-   }
+   Sphere(inc);
    //  Undo transofrmations
-   glPopMatrix();
+   MatPop();
+   STATS_END;
 }
 
+
 //Draw a Skyscraper
 static void draw_skyscraper(double x,double y,double z,
                  double dx,double dy,double dz,
                  double th)
 {
-  glPushMatrix();
-  glTranslated(x,y+12.5,z);
-  glRotated(90,100,1,0);
-  glScaled(10*dx,10*dy,10*dz);
+  STATS_BEGIN;
+  MatPush();
+  MatTranslate(x,y+12.5,z);
+  MatRotate(90,100,1,0);
+  MatScale(10*dx,10*dy,10*dz);
+  MatSync();
   glColor3f(0.196078,0.6,0.8);
-  GLUquadric* qobj;
-  qobj = gluNewQuadric();
-  gluQuadricNormals(qobj, GLU_SMOOTH);
-  gluCylinder(qobj, 0.5, 1, 5, 20000, 16);
-  glPopMatrix();
-  glPushMatrix();
+  Cylinder(0.5, 1, 5, cyl_slices[lod], cyl_stacks[lod]);
+  MatPop();
+  MatPush();
   glColor3f( 0.6,0.196078,0.8);
-  glTranslated(x,y+12.5,z);
-  glRotated(90,100,1,0);
-  glScaled(4*dx,4*dy,4*dz);
-  glutSolidTorus(1.0, 2.0,100,100);
-  glPopMatrix();
-
-  glPushMatrix();
+  MatTranslate(x,y+12.5,z);
+  MatRotate(90,100,1,0);
+  MatScale(4*dx,4*dy,4*dz);
+  MatSync();
+  Torus(1.0, 2.0,torus_n[lod],torus_n[lod]);
+  MatPop();
+
+  MatPush();
   glColor3f( 0.6,0.196078,0.8);
-  glTranslated(x,y+14,z);
-  glRotated(90,100,1,0);
-  glScaled(3*dx,3*dy,3*dz);
-  glutSolidTorus(1.0, 2.0,100,100);
-  glPopMatrix();
-
-  glPushMatrix();
+  MatTranslate(x,y+14,z);
+  MatRotate(90,100,1,0);
+  MatScale(3*dx,3*dy,3*dz);
+  MatSync();
+  Torus(1.0, 2.0,torus_n[lod],torus_n[lod]);
+  MatPop();
+
+  MatPush();
   glColor3f( 0.6,0.196078,0.8);
-  glTranslated(x,y+15,z);
-  glRotated(90,100,1,0);
-  glScaled(2*dx,2*dy,2*dz);
-  glutSolidTorus(1.0, 2.0,100,100);
-  glPopMatrix();
-
-  glPushMatrix();
+  MatTranslate(x,y+15,z);
+  MatRotate(90,100,1,0);
+  MatScale(2*dx,2*dy,2*dz);
+  MatSync();
+  Torus(1.0, 2.0,torus_n[lod],torus_n[lod]);
+  MatPop();
+
+  MatPush();
   glColor3f( 0.6,0.196078,0.8);
-  glTranslated(x,y+15.75,z);
-  glRotated(90,100,1,0);
-  glScaled(dx,dy,dz);
-  glutSolidTorus(1.0, 2.0,100,100);
-  glPopMatrix();
-
-
-
+  MatTranslate(x,y+15.75,z);
+  MatRotate(90,100,1,0);
+  MatScale(dx,dy,dz);
+  MatSync();
+  Torus(1.0, 2.0,torus_n[lod],torus_n[lod]);
+  MatPop();
+  STATS_END;
 }
 
 //Draw a arch building
@@ -162,10 +189,12 @@ static void draw_arch_building(double x,double y,double z,
                  double dx,double dy,double dz,
                  double th)
 {
-  glPushMatrix();
-  glTranslated(x,y+1.2,z+0.1);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,12*dy,5*dz);
+  STATS_BEGIN;
+  MatPush();
+  MatTranslate(x,y+1.2,z+0.1);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,12*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0, 0, -1);
@@ -174,11 +203,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x,y+2.2,z+1.5);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,15*dy,5*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x,y+2.2,z+1.5);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,15*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0, 0, 1);
@@ -187,12 +217,13 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
+  MatPop();
 
-  glPushMatrix();
-  glTranslated(x,y+9.2,z+1.4);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,15*dy,5*dz);
+  MatPush();
+  MatTranslate(x,y+9.2,z+1.4);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,15*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0,+1, 0);
@@ -201,11 +232,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(+1,+1,-1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x,y+9.25,z-1.3);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,15*dy,5*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x,y+9.25,z-1.3);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,15*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0,+1, 0);
@@ -215,11 +247,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(-1,+1,-1);
   glEnd();
 
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x,y+11.2,z+1.7);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,15*dy,5*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x,y+11.2,z+1.7);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,15*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0,+1, 0);
@@ -228,11 +261,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(+1,+1,-1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x,y+11.25,z-1.1);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,15*dy,5*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x,y+11.25,z-1.1);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,15*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0,+1, 0);
@@ -241,11 +275,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(+1,+1,-1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x,y+11.25,z-2.6);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,15*dy,5*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x,y+11.25,z-2.6);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,15*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0,+1, 0);
@@ -254,12 +289,13 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(+1,+1,-1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
+  MatPop();
 
-  glPushMatrix();
-  glTranslated(x+0.7,y+2.2,z+2.3);
-  glRotated(180,0,1,-100);
-  glScaled(2.5*dx,15*dy,2.5*dz);
+  MatPush();
+  MatTranslate(x+0.7,y+2.2,z+2.3);
+  MatRotate(180,0,1,-100);
+  MatScale(2.5*dx,15*dy,2.5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( -1, 0, 0);
@@ -268,11 +304,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(-1,+1,+1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x-2.2,y+2.2,z+2.3);
-  glRotated(180,0,1,-100);
-  glScaled(2.5*dx,15*dy,2.5*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x-2.2,y+2.2,z+2.3);
+  MatRotate(180,0,1,-100);
+  MatScale(2.5*dx,15*dy,2.5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( +1, 0, 0);
@@ -281,12 +318,13 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(-1,+1,+1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
+  MatPop();
 
-  glPushMatrix();
-  glTranslated(x,y+2.3,z-5.85);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,15*dy,5*dz);
+  MatPush();
+  MatTranslate(x,y+2.3,z-5.85);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,15*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0, 0, -1);
@@ -295,11 +333,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x,y+1.3,z-4.4);
-  glRotated(180,0,1,-100);
-  glScaled(5*dx,12*dy,5*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x,y+1.3,z-4.4);
+  MatRotate(180,0,1,-100);
+  MatScale(5*dx,12*dy,5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0, 0, 1);
@@ -308,12 +347,13 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
+  MatPop();
 
-  glPushMatrix();
-  glTranslated(x+0.7,y+2.3,z-3.6);
-  glRotated(180,0,1,-100);
-  glScaled(2.5*dx,15*dy,2.5*dz);
+  MatPush();
+  MatTranslate(x+0.7,y+2.3,z-3.6);
+  MatRotate(180,0,1,-100);
+  MatScale(2.5*dx,15*dy,2.5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( -1, 0, 0);
@@ -322,11 +362,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(-1,+1,+1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x-2.2,y+2.3,z-3.6);
-  glRotated(180,0,1,-100);
-  glScaled(2.5*dx,15*dy,2.5*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x-2.2,y+2.3,z-3.6);
+  MatRotate(180,0,1,-100);
+  MatScale(2.5*dx,15*dy,2.5*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 1, 0, 0);
@@ -335,12 +376,13 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(-1,+1,+1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
+  MatPop();
 
-  glPushMatrix();
-  glTranslated(x-1.5,y+5.75,z);
-  glRotated(180,0,1,-100);
-  glScaled(10*dx,3.5*dy,10*dz);
+  MatPush();
+  MatTranslate(x-1.5,y+5.75,z);
+  MatRotate(180,0,1,-100);
+  MatScale(10*dx,3.5*dy,10*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( -1, 0, 0);
@@ -349,11 +391,12 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(-1,+1,+1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
-  glPushMatrix();
-  glTranslated(x-4.4,y+5.75,z);
-  glRotated(180,0,1,-100);
-  glScaled(10*dx,3.5*dy,10*dz);
+  MatPop();
+  MatPush();
+  MatTranslate(x-4.4,y+5.75,z);
+  MatRotate(180,0,1,-100);
+  MatScale(10*dx,3.5*dy,10*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 1, 0, 0);
@@ -362,9 +405,8 @@ static void draw_arch_building(double x,double y,double z,
   glVertex3f(-1,+1,+1);
   glVertex3f(-1,+1,-1);
   glEnd();
-  glPopMatrix();
-
-
+  MatPop();
+  STATS_END;
 }
 
 
@@ -373,46 +415,39 @@ static void draw_lamp(double x,double y,double z,
                  double dx,double dy,double dz,
                  double th)
 {
-  int th1, ph1;
+  STATS_BEGIN;
+  int sinc = lod ? ball_inc[lod] : inc;
   //Lamp post
-  glPushMatrix();
-  glTranslated(x,y,z);
-  glRotated(90,100,1,0);
-  glScaled(10*dx,10*dy,10*dz);
+  MatPush();
+  MatTranslate(x,y,z);
+  MatRotate(90,100,1,0);
+  MatScale(10*dx,10*dy,10*dz);
+  MatSync();
   glColor3f(0.329412,0.329412,0.329412);
-  GLUquadric* qobj;
-  qobj = gluNewQuadric();
-  gluQuadricNormals(qobj, GLU_SMOOTH);
-  gluCylinder(qobj, 0.01, 0.04, 0.7, 20000, 16);
-  glPopMatrix();
+  Cylinder(0.01, 0.04, 0.7, cyl_slices[lod], cyl_stacks[lod]);
+  MatPop();
   //Light source TODO: Make it a source of light
-  glPushMatrix();
+  MatPush();
   glColor3f(0.29, 0.46, 0.43);
-  glTranslated(x,y,z);
-  glRotated(90,100,1,0);
-  glScaled(0.2*dx,0.2*dy,0.2*dz);
-  glutSolidTorus(1.0, 2.0,100,100);
-  glPopMatrix();
-
-  glPushMatrix();
+  MatTranslate(x,y,z);
+  MatRotate(90,100,1,0);
+  MatScale(0.2*dx,0.2*dy,0.2*dz);
+  MatSync();
+  Torus(1.0, 2.0,torus_n[lod],torus_n[lod]);
+  MatPop();
+
+  MatPush();
   glColor3f(1,1,1);
-  glTranslated(x,y,z);
-  glRotated(90,100,1,0);
-  glScaled(0.2*dx,0.2*dy,0.2*dz);
+  MatTranslate(x,y,z);
+  MatRotate(90,100,1,0);
+  MatScale(0.2*dx,0.2*dy,0.2*dz);
+  MatSync();
 
   //  White ball
   glColor3f(1,1,1);
-  for (ph1=-90;ph1<90;ph1+=inc)
-  {
-     glBegin(GL_QUAD_STRIP);
-     for (th1=0;th1<=360;th1+=2*inc)
-     {
-        Vertex(th1,ph1);
-        Vertex(th1,ph1+inc);
-     }
-     glEnd();
-   }
-  glPopMatrix();
+  Sphere(sinc);
+  MatPop();
+  STATS_END;
 }
 
 //Draw a streetlight
@@ -420,83 +455,67 @@ static void draw_streetlights(double x,double y,double z,
                  double dx,double dy,double dz,
                  double th)
 {
-  int th1,ph1;
+  STATS_BEGIN;
+  int sinc = lod ? ball_inc[lod] : inc;
   //First pole
-  glPushMatrix();
-  if(th == 5) glTranslated(x+th-0.4,y+1,z+th);
-  else glTranslated(x+th,y+1,z+th);
-  glRotated(90,100,1,0);
-  glScaled(10*dx,10*dy,10*dz);
+  MatPush();
+  if(th == 5) MatTranslate(x+th-0.4,y+1,z+th);
+  else MatTranslate(x+th,y+1,z+th);
+  MatRotate(90,100,1,0);
+  MatScale(10*dx,10*dy,10*dz);
+  MatSync();
   glColor3f(0.752941, 0.752941, 0.752941);
-  GLUquadric* qobj;
-  qobj = gluNewQuadric();
-  gluQuadricNormals(qobj, GLU_SMOOTH);
-  gluCylinder(qobj, 0.02, 0.02, 1, 20000, 16);
-  glPopMatrix();
-  glPushMatrix();
-  if(th == 5) glTranslated(x+th-0.4,y+1,z+th);
-  else glTranslated(x+th,y+1,z+th);
-  glRotated(90,100,1,0);
-  glScaled(0.2*dx,0.2*dy,0.2*dz);
-  for (ph1=-90;ph1<90;ph1+=inc)
-  {
-     glBegin(GL_QUAD_STRIP);
-     for (th1=0;th1<=360;th1+=2*inc)
-     {
-        Vertex(th1,ph1);
-        Vertex(th1,ph1+inc);
-     }
-     glEnd();
-  }
-  glPopMatrix();
+  Cylinder(0.02, 0.02, 1, cyl_slices[lod], cyl_stacks[lod]);
+  MatPop();
+  MatPush();
+  if(th == 5) MatTranslate(x+th-0.4,y+1,z+th);
+  else MatTranslate(x+th,y+1,z+th);
+  MatRotate(90,100,1,0);
+  MatScale(0.2*dx,0.2*dy,0.2*dz);
+  MatSync();
+  Sphere(sinc);
+  MatPop();
 
   //Second pole
-  glPushMatrix();
-  if(th == 5) glTranslated(x+5-0.4,y+1,z);
-  else glTranslated(x+5,y+1,z);
-  glRotated(90,100,1,0);
-  glScaled(10*dx,10*dy,10*dz);
+  MatPush();
+  if(th == 5) MatTranslate(x+5-0.4,y+1,z);
+  else MatTranslate(x+5,y+1,z);
+  MatRotate(90,100,1,0);
+  MatScale(10*dx,10*dy,10*dz);
+  MatSync();
   glColor3f(0.752941, 0.752941, 0.752941);
-  gluQuadricNormals(qobj, GLU_SMOOTH);
-  gluCylinder(qobj, 0.02, 0.02, 1, 20000, 16);
-  glPopMatrix();
-  glPushMatrix();
-  if(th == 5) glTranslated(x+5-0.4,y+1,z);
-  else glTranslated(x+5,y+1,z);
-  glRotated(90,100,1,0);
-  glScaled(0.2*dx,0.2*dy,0.2*dz);
-  for (ph1=-90;ph1<90;ph1+=inc)
-  {
-     glBegin(GL_QUAD_STRIP);
-     for (th1=0;th1<=360;th1+=2*inc)
-     {
-        Vertex(th1,ph1);
-        Vertex(th1,ph1+inc);
-     }
-     glEnd();
-  }
-  glPopMatrix();
+  Cylinder(0.02, 0.02, 1, cyl_slices[lod], cyl_stacks[lod]);
+  MatPop();
+  MatPush();
+  if(th == 5) MatTranslate(x+5-0.4,y+1,z);
+  else MatTranslate(x+5,y+1,z);
+  MatRotate(90,100,1,0);
+  MatScale(0.2*dx,0.2*dy,0.2*dz);
+  MatSync();
+  Sphere(sinc);
+  MatPop();
 
   //cable
-  glPushMatrix();
-  if(th == 5) glTranslated(x+5-0.4,y+1,z);
-  else glTranslated(x+5,y+1,z);
-  glRotated(180,100,1,-100);
+  MatPush();
+  if(th == 5) MatTranslate(x+5-0.4,y+1,z);
+  else MatTranslate(x+5,y+1,z);
+  MatRotate(180,100,1,-100);
   if(th == 5)
-    glRotated(180,100,1,-100);
-  glScaled(10*dx,10*dy,10*dz);
+    MatRotate(180,100,1,-100);
+  MatScale(10*dx,10*dy,10*dz);
+  MatSync();
   glColor3f(0,0,0);
-  gluQuadricNormals(qobj, GLU_SMOOTH);
-  gluCylinder(qobj, 0.007, 0.007, 1.65, 20000, 16);
-  glPopMatrix();
+  Cylinder(0.007, 0.007, 1.65, cyl_slices[lod], cyl_stacks[lod]);
+  MatPop();
 
   //draw light 1
   int offset = 3.999999999999999;
-  glPushMatrix();
-  if(th == 5)  glTranslated(x+1.75+offset,y+0.8,z+offset);
-  else glTranslated(x+1.75,y+0.8,z);
-  glRotated(180,100,1,-100);
-  glScaled(0.25*dx,0.5*dy,0.25*dz);
+  MatPush();
+  if(th == 5)  MatTranslate(x+1.75+offset,y+0.8,z+offset);
+  else MatTranslate(x+1.75,y+0.8,z);
+  MatRotate(180,100,1,-100);
+  MatScale(0.25*dx,0.5*dy,0.25*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( -1, 0, 0);
@@ -505,13 +524,14 @@ static void draw_streetlights(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-
-  glPushMatrix();
-  if(th == 5) glTranslated(x+1.6+offset,y+0.8,z+offset);
-  else glTranslated(x+1.6,y+0.8,z);
-  glRotated(180,0,1,-100);
-  glScaled(0.25*dx,0.5*dy,0.25*dz);
+  MatPop();
+
+  MatPush();
+  if(th == 5) MatTranslate(x+1.6+offset,y+0.8,z+offset);
+  else MatTranslate(x+1.6,y+0.8,z);
+  MatRotate(180,0,1,-100);
+  MatScale(0.25*dx,0.5*dy,0.25*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0, 0, -1);
@@ -520,13 +540,14 @@ static void draw_streetlights(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-
-  glPushMatrix();
-  if(th == 5) glTranslated(x+1.6+offset,y+0.8,z+offset);
-  else glTranslated(x+1.6,y+0.8,z);
-  glRotated(180,100,1,-100);
-  glScaled(0.25*dx,0.5*dy,0.25*dz);
+  MatPop();
+
+  MatPush();
+  if(th == 5) MatTranslate(x+1.6+offset,y+0.8,z+offset);
+  else MatTranslate(x+1.6,y+0.8,z);
+  MatRotate(180,100,1,-100);
+  MatScale(0.25*dx,0.5*dy,0.25*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 1, 0, 0);
@@ -535,13 +556,14 @@ static void draw_streetlights(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-
-  glPushMatrix();
-  if(th == 5) glTranslated(x+1.6+offset,y+0.8,z-0.15+offset);
-  else glTranslated(x+1.6,y+0.8,z-0.15);
-  glRotated(180,0,1,-100);
-  glScaled(0.25*dx,0.5*dy,0.25*dz);
+  MatPop();
+
+  MatPush();
+  if(th == 5) MatTranslate(x+1.6+offset,y+0.8,z-0.15+offset);
+  else MatTranslate(x+1.6,y+0.8,z-0.15);
+  MatRotate(180,0,1,-100);
+  MatScale(0.25*dx,0.5*dy,0.25*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0, 0, 1);
@@ -550,15 +572,16 @@ static void draw_streetlights(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
+  MatPop();
 
   //draw light 2
   offset = 1.9;
-  glPushMatrix();
-  if(th == 5) glTranslated(x+3.75+offset,y+0.8,z+offset);
-  else glTranslated(x+3.65,y+0.8,z);
-  glRotated(180,100,1,-100);
-  glScaled(0.25*dx,0.5*dy,0.25*dz);
+  MatPush();
+  if(th == 5) MatTranslate(x+3.75+offset,y+0.8,z+offset);
+  else MatTranslate(x+3.65,y+0.8,z);
+  MatRotate(180,100,1,-100);
+  MatScale(0.25*dx,0.5*dy,0.25*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( -1, 0, 0);
@@ -567,13 +590,14 @@ static void draw_streetlights(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-
-  glPushMatrix();
-  if(th == 5) glTranslated(x+3.6+offset,y+0.8,z+offset);
-  else glTranslated(x+3.5,y+0.8,z);
-  glRotated(180,0,1,-100);
-  glScaled(0.25*dx,0.5*dy,0.25*dz);
+  MatPop();
+
+  MatPush();
+  if(th == 5) MatTranslate(x+3.6+offset,y+0.8,z+offset);
+  else MatTranslate(x+3.5,y+0.8,z);
+  MatRotate(180,0,1,-100);
+  MatScale(0.25*dx,0.5*dy,0.25*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0, 0, -1);
@@ -582,13 +606,14 @@ static void draw_streetlights(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-
-  glPushMatrix();
-  if(th ==5) glTranslated(x+3.6+offset,y+0.8,z+offset);
-  else glTranslated(x+3.5,y+0.8,z);
-  glRotated(180,100,1,-100);
-  glScaled(0.25*dx,0.5*dy,0.25*dz);
+  MatPop();
+
+  MatPush();
+  if(th ==5) MatTranslate(x+3.6+offset,y+0.8,z+offset);
+  else MatTranslate(x+3.5,y+0.8,z);
+  MatRotate(180,100,1,-100);
+  MatScale(0.25*dx,0.5*dy,0.25*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 1, 0, 0);
@@ -597,13 +622,14 @@ static void draw_streetlights(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-
-  glPushMatrix();
-  if(th == 5) glTranslated(x+3.6+offset,y+0.8,z-0.15+offset);
-  else glTranslated(x+3.5,y+0.8,z-0.15);
-  glRotated(180,0,1,-100);
-  glScaled(0.25*dx,0.5*dy,0.25*dz);
+  MatPop();
+
+  MatPush();
+  if(th == 5) MatTranslate(x+3.6+offset,y+0.8,z-0.15+offset);
+  else MatTranslate(x+3.5,y+0.8,z-0.15);
+  MatRotate(180,0,1,-100);
+  MatScale(0.25*dx,0.5*dy,0.25*dz);
+  MatSync();
   glColor3f(0.560784,0.560784,0.737255);
   glBegin(GL_QUADS);
   glNormal3f( 0, 0, 1);
@@ -612,8 +638,8 @@ static void draw_streetlights(double x,double y,double z,
   glVertex3f(+1,+1, 1);
   glVertex3f(-1,+1, 1);
   glEnd();
-  glPopMatrix();
-
+  MatPop();
+  STATS_END;
 }
 
 
@@ -622,49 +648,56 @@ static void city_frame(double x,double y,double z,
                  double dx,double dy,double dz,
                  double th)
 {
+  STATS_BEGIN;
   //  Draw disc
-  int i,k;
+  int i;
   glEnable(GL_TEXTURE_2D);
-  glPushMatrix();
+  MatPush();
 
-  glTranslated(x,y-2.6,z);
-  glRotated(th,100,1,0);
-  glScaled(125*dx,125*dy,dz);
+  MatTranslate(x,y-2.6,z);
+  MatRotate(th,100,1,0);
+  MatScale(125*dx,125*dy,dz);
+  MatSync();
 
   glLineWidth(100);
   // glColor3f(0.137255,0.556863,0.137255);
 
   glColor3f(1,1,1);
 
+  AtlasBind(TEX_GRASS);
   for (i=1;i>=-1;i-=2)
   {
-     glBindTexture(GL_TEXTURE_2D, texture[1]);
      glNormal3f(0,0,i);
-     glBegin(GL_TRIANGLE_FAN);
-     glTexCoord2f(0.5,0.5);
-     glVertex3f(0,0,i);
-     for (k=0;k<=360;k+=10)
-     {
-        glTexCoord2f(0.5*Cos(k)+0.5,0.5*Sin(k)+0.5);
-        glVertex3f(i*Cos(k),Sin(k),i);
-     }
-     glEnd();
+     DiscFace(i,AtlasRect(TEX_GRASS));
   }
   //  Edge
-  glBindTexture(GL_TEXTURE_2D,texture[1]);
   glColor3f(1.00,0.77,0.36);
-  glBegin(GL_QUAD_STRIP);
-  for (k=0;k<=360;k+=10)
-  {
-     glNormal3f(Cos(k),Sin(k),0);
-     glTexCoord2f(0,0.5*k); glVertex3f(Cos(k),Sin(k),+1);
-     glTexCoord2f(1,0.5*k); glVertex3f(Cos(k),Sin(k),-1);
-  }
-
-  glEnd();
-  glPopMatrix();
+  DiscEdge(AtlasRect(TEX_GRASS));
+  MatPop();
   glDisable(GL_TEXTURE_2D);
+  STATS_END;
+}
 
+/*
+ *  Virtual texture block of the first quad of a ground
+ */
+static int ground_block(const object_t* o)
+{
+   int k,n=0;
+   for (k=0;scene+k<o;k++)
+      if (scene[k].type==OBJ_GROUND) n += 4;
+   return n;
+}
+
+/*
+ *  Set texture coordinate (s,t) of a ground quad
+ */
+static void ground_coord(int block,float s,float t)
+{
+   if (vtex)
+      VTexCoord(block,s,t);
+   else
+      AtlasCoord(TEX_BLOCK,s,t);
 }
 
 /*
@@ -672,11 +705,13 @@ static void city_frame(double x,double y,double z,
  *     at (x,y,z)
  *     dimentions (dx,dy,dz)
  *     rotated th about the y axis
+ *     with virtual texture blocks from block on
  */
 static void draw_ground(double x,double y,double z,
                  double dx,double dy,double dz,
-                 double th)
+                 double th,int block)
 {
+  STATS_BEGIN;
   //  Set specular color to white
   float white[] = {1,1,1,1};
   float black[] = {0,0,0,1};
@@ -685,120 +720,300 @@ static void draw_ground(double x,double y,double z,
   glMaterialfv(GL_FRONT_AND_BACK,GL_EMISSION,black);
 
    //Draw ground
-   glPushMatrix();
-    glTranslated(x,y-5,z);
-    glRotated(180,100,1,0);
-    glScaled(10*dx,10*dy,10*dz);
+   MatPush();
+    MatTranslate(x,y-5,z);
+    MatRotate(180,100,1,0);
+    MatScale(10*dx,10*dy,10*dz);
+    MatSync();
 
     glEnable(GL_TEXTURE_2D);
     glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,mode?GL_REPLACE:GL_MODULATE);
     // glColor3f(0.137255,0.556863,0.137255);
     glColor3f(1,1,1);
-    if (ntex) glBindTexture(GL_TEXTURE_2D,texture[0]);
+    if (vtex) VTexBegin();
+    else if (ntex) AtlasBind(TEX_BLOCK);
     glBegin(GL_POLYGON);
     glNormal3f( 0,+1, 0);
     double ground_size = 2.5;
-    glTexCoord2f(0,0); glVertex3f(ground_size,-1.0,ground_size);
-    glTexCoord2f(1,0); glVertex3f(-ground_size,-1.0,ground_size);
-    glTexCoord2f(1,1); glVertex3f(-ground_size,-1.0,-ground_size);
-    glTexCoord2f(0,1); glVertex3f(ground_size,-1.0,-ground_size);
+    ground_coord(block,0,0); glVertex3f(ground_size,-1.0,ground_size);
+    ground_coord(block,1,0); glVertex3f(-ground_size,-1.0,ground_size);
+    ground_coord(block,1,1); glVertex3f(-ground_size,-1.0,-ground_size);
+    ground_coord(block,0,1); glVertex3f(ground_size,-1.0,-ground_size);
     glEnd();
-    glPopMatrix();
+    MatPop();
     glDisable(GL_TEXTURE_2D);
     glEnd();
 
     //Second Block
-    glPushMatrix();
-     glTranslated(x-14,y-5.3,z);
-     glRotated(180,100,1,0);
-     glScaled(10*dx,10*dy,10*dz);
+    MatPush();
+     MatTranslate(x-14,y-5.3,z);
+     MatRotate(180,100,1,0);
+     MatScale(10*dx,10*dy,10*dz);
+     MatSync();
 
      glEnable(GL_TEXTURE_2D);
      glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,mode?GL_REPLACE:GL_MODULATE);
     //  glColor3f(0.137255,0.556863,0.137255);
      glColor3f(1,1,1);
-     if (ntex) glBindTexture(GL_TEXTURE_2D,texture[0]);
+     if (vtex) VTexBegin();
+     else if (ntex) AtlasBind(TEX_BLOCK);
      glBegin(GL_POLYGON);
      glNormal3f( 0,+1, 0);
-     glTexCoord2f(0,0); glVertex3f(ground_size,-1.0,ground_size);
-     glTexCoord2f(1,0); glVertex3f(-ground_size,-1.0,ground_size);
-     glTexCoord2f(1,1); glVertex3f(-ground_size,-1.0,-ground_size);
-     glTexCoord2f(0,1); glVertex3f(ground_size,-1.0,-ground_size);
+     ground_coord(block+1,0,0); glVertex3f(ground_size,-1.0,ground_size);
+     ground_coord(block+1,1,0); glVertex3f(-ground_size,-1.0,ground_size);
+     ground_coord(block+1,1,1); glVertex3f(-ground_size,-1.0,-ground_size);
+     ground_coord(block+1,0,1); glVertex3f(ground_size,-1.0,-ground_size);
      glEnd();
-     glPopMatrix();
+     MatPop();
      glDisable(GL_TEXTURE_2D);
      glEnd();
 
      //Third Block
-     glPushMatrix();
-      glTranslated(x,y-5,z-14);
-      glRotated(180,100,1,0);
-      glScaled(10*dx,10*dy,10*dz);
+     MatPush();
+      MatTranslate(x,y-5,z-14);
+      MatRotate(180,100,1,0);
+      MatScale(10*dx,10*dy,10*dz);
+      MatSync();
 
       glEnable(GL_TEXTURE_2D);
       glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,mode?GL_REPLACE:GL_MODULATE);
       // glColor3f(0.137255,0.556863,0.137255);
       glColor3f(1,1,1);
-      if (ntex) glBindTexture(GL_TEXTURE_2D,texture[0]);
+      if (vtex) VTexBegin();
+      else if (ntex) AtlasBind(TEX_BLOCK);
       glBegin(GL_POLYGON);
       glNormal3f( 0,+1, 0);
-      glTexCoord2f(0,0); glVertex3f(ground_size,-1.0,ground_size);
-      glTexCoord2f(1,0); glVertex3f(-ground_size,-1.0,ground_size);
-      glTexCoord2f(1,1); glVertex3f(-ground_size,-1.0,-ground_size);
-      glTexCoord2f(0,1); glVertex3f(ground_size,-1.0,-ground_size);
+      ground_coord(block+2,0,0); glVertex3f(ground_size,-1.0,ground_size);
+      ground_coord(block+2,1,0); glVertex3f(-ground_size,-1.0,ground_size);
+      ground_coord(block+2,1,1); glVertex3f(-ground_size,-1.0,-ground_size);
+      ground_coord(block+2,0,1); glVertex3f(ground_size,-1.0,-ground_size);
       glEnd();
-      glPopMatrix();
+      MatPop();
       glDisable(GL_TEXTURE_2D);
       glEnd();
 
       //Fourth Block
-      glPushMatrix();
-       glTranslated(x-14,y-5.3,z-14);
-       glRotated(180,100,1,0);
-       glScaled(10*dx,10*dy,10*dz);
+      MatPush();
+       MatTranslate(x-14,y-5.3,z-14);
+       MatRotate(180,100,1,0);
+       MatScale(10*dx,10*dy,10*dz);
+       MatSync();
 
        glEnable(GL_TEXTURE_2D);
        glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,mode?GL_REPLACE:GL_MODULATE);
       //  glColor3f(0.137255,0.556863,0.137255);
        glColor3f(1,1,1);
-       if (ntex) glBindTexture(GL_TEXTURE_2D,texture[0]);
+       if (vtex) VTexBegin();
+       else if (ntex) AtlasBind(TEX_BLOCK);
        glBegin(GL_POLYGON);
        glNormal3f( 0,+1, 0);
-       glTexCoord2f(0,0); glVertex3f(ground_size,-1.0,ground_size);
-       glTexCoord2f(1,0); glVertex3f(-ground_size,-1.0,ground_size);
-       glTexCoord2f(1,1); glVertex3f(-ground_size,-1.0,-ground_size);
-       glTexCoord2f(0,1); glVertex3f(ground_size,-1.0,-ground_size);
+       ground_coord(block+3,0,0); glVertex3f(ground_size,-1.0,ground_size);
+       ground_coord(block+3,1,0); glVertex3f(-ground_size,-1.0,ground_size);
+       ground_coord(block+3,1,1); glVertex3f(-ground_size,-1.0,-ground_size);
+       ground_coord(block+3,0,1); glVertex3f(ground_size,-1.0,-ground_size);
        glEnd();
-       glPopMatrix();
+       MatPop();
        glDisable(GL_TEXTURE_2D);
        glEnd();
+   if (vtex) VTexEnd();
+   STATS_END;
+}
 
+/*
+ *  Draw a scene object with its draw function
+ */
+static void draw_object(const object_t* o)
+{
+   switch (o->type)
+   {
+      case OBJ_FRAME:
+         city_frame(o->x,o->y,o->z, o->dx,o->dy,o->dz, o->th);
+         break;
+      case OBJ_GROUND:
+         draw_ground(o->x,o->y,o->z, o->dx,o->dy,o->dz, o->th,ground_block(o));
+         break;
+      case OBJ_STREETLIGHT:
+         draw_streetlights(o->x,o->y,o->z, o->dx,o->dy,o->dz, o->th);
+         break;
+      case OBJ_LAMP:
+         draw_lamp(o->x,o->y,o->z, o->dx,o->dy,o->dz, o->th);
+         break;
+      case OBJ_ARCH:
+         draw_arch_building(o->x,o->y,o->z, o->dx,o->dy,o->dz, o->th);
+         break;
+      case OBJ_SKYSCRAPER:
+         draw_skyscraper(o->x,o->y,o->z, o->dx,o->dy,o->dz, o->th);
+         break;
+   }
+}
 
+/*
+ *  Draw object k of the scene with its baked matrices
+ */
+static void draw_scene(int k)
+{
+   XformBegin(k);
+   draw_object(scene+k);
+   XformEnd();
 }
 
+/*
+ *  Draw object k for XformBake
+ *    Textures do not change the geometry, so none are bound, and the
+ *    finest level of detail reaches furthest out
+ */
+static void bake_object(int k)
+{
+   int t=ntex,v=vtex,l=lod;
+   ntex = vtex = 0;
+   lod = 0;
+   draw_object(scene+k);
+   ntex = t;
+   vtex = v;
+   lod = l;
+}
 
 /*
- *  OpenGL (GLUT) calls this routine to display the scene
+ *  Set up light 0 at its current position
  */
-void display()
+static void lighting(void)
+{
+   //  Translate intensity to color vectors
+   float Ambient[]   = {0.01*ambient ,0.01*ambient ,0.01*ambient ,1.0};
+   float Diffuse[]   = {0.01*diffuse ,0.01*diffuse ,0.01*diffuse ,1.0};
+   float Specular[]  = {0.01*specular,0.01*specular,0.01*specular,1.0};
+   //  OpenGL should normalize normal vectors
+   glEnable(GL_NORMALIZE);
+   //  Enable lighting
+   glEnable(GL_LIGHTING);
+   //  Location of viewer for specular calculations
+   glLightModeli(GL_LIGHT_MODEL_LOCAL_VIEWER,local);
+   //  glColor sets ambient and diffuse color materials
+   glColorMaterial(GL_FRONT_AND_BACK,GL_AMBIENT_AND_DIFFUSE);
+   glEnable(GL_COLOR_MATERIAL);
+   //  Enable light 0
+   glEnable(GL_LIGHT0);
+   //  Set ambient, diffuse, specular components and position of light 0
+   glLightfv(GL_LIGHT0,GL_AMBIENT ,Ambient);
+   glLightfv(GL_LIGHT0,GL_DIFFUSE ,Diffuse);
+   glLightfv(GL_LIGHT0,GL_SPECULAR,Specular);
+}
+
+/*
+ *  Position light 0 in the scene seen by the current camera
+ */
+static void light_position(void)
+{
+   float Position[] = {20*distance*Cos(zh),ylight,20*distance*Sin(zh),1.0};
+   glLightfv(GL_LIGHT0,GL_POSITION,Position);
+}
+
+/*
+ *  Lights used when rendering the impostor atlas
+ */
+static void impostor_light(void)
+{
+   if (light)
+   {
+      lighting();
+      light_position();
+   }
+   else
+      glDisable(GL_LIGHTING);
+}
+
+/*
+ *  Draw an object into the impostor atlas
+ */
+static void impostor_draw(const object_t* o)
+{
+   float M[16];
+   //  Cells are small, so the middle level of detail is plenty
+   lod = 1;
+   //  Transforms start from the cell camera
+   glGetFloatv(GL_MODELVIEW_MATRIX,M);
+   MatLoad(M);
+   AtlasBegin();
+   draw_object(o);
+   MatSync();
+}
+
+/*
+ *  Summary of everything that changes how the impostors look
+ *    The light azimuth is taken in 15 degree steps
+ */
+static unsigned int impostor_key(void)
+{
+   unsigned int key = light;
+   key = 31*key + local;
+   key = 31*key + distance;
+   key = 31*key + ambient;
+   key = 31*key + diffuse;
+   key = 31*key + specular;
+   key = 31*key + emission;
+   key = 31*key + shininess;
+   key = 31*key + (int)floor(10*ylight);
+   key = 31*key + (light ? zh/15 : 0);
+   key = 31*key + AssetGeneration();
+   return key;
+}
+
+/*
+ *  Place the imported model at the origin, two units across and standing
+ *  on y=0
+ *    Returns the scale and sets the offset applied before it
+ */
+static float model_place(const model_t* m,float t[3])
+{
+   float s = 0;
+   int i;
+   for (i=0;i<3;i++)
+      if (m->max[i]-m->min[i]>s) s = m->max[i]-m->min[i];
+   t[0] = -0.5*(m->min[0]+m->max[0]);
+   t[1] = -m->min[1];
+   t[2] = -0.5*(m->min[2]+m->max[2]);
+   return s>0 ? 2/s : 1;
+}
+
+/*
+ *  Build the ray queries over the scene and the placed model
+ */
+static void ray_build(const model_t* m)
+{
+   float* tri = NULL;
+   int k,n = 0;
+   if (m)
+   {
+      float t[3],s = model_place(m,t);
+      tri = ModelTriangles(m,&n);
+      for (k=0;k<9*n;k++)
+         tri[k] = s*(tri[k]+t[k%3]);
+   }
+   RayBuild(tri,n);
+   free(tri);
+   //  Triangle numbers may have changed
+   picked_hit = 0;
+}
+
+/*
+ *  Set the modelview matrix for a camera
+ *    Returns the eye position
+ */
+static void camera(int cam,float eye[3])
 {
-  const double len=1.5;  //  Length of axes
-   //  Erase the window and the depth buffer
-   glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-   //  Enable Z-buffering in OpenGL
-   glEnable(GL_DEPTH_TEST);
-   //  Undo previous transformations
    glLoadIdentity();
    //  Perspective - set eye position
-   if (mode == 1)
+   if (cam==CAM_ORBIT)
    {
       double Ex = -2*dim*Sin(th)*Cos(ph);
       double Ey = +2*dim        *Sin(ph);
       double Ez = +2*dim*Cos(th)*Cos(ph);
       gluLookAt(Ex,Ey,Ez , 0,0,0 , 0,Cos(ph),0);
+      eye[0] = Ex;  eye[1] = Ey;  eye[2] = Ez;
    }
    //  First Person Nav
-   else{
+   else if (cam==CAM_FIRST)
+   {
      dirx = cos(fpn_ang) * cos(fpn_p);
      diry = sin(fpn_p);
      dirz = sin(fpn_ang) * cos(fpn_p);
@@ -806,114 +1021,113 @@ void display()
      orth_x = cos(fpn_ang - M_PI_2);
      orth_z = sin(fpn_ang - M_PI_2);
 
-     glMatrixMode(GL_MODELVIEW);
-     glLoadIdentity();
      gluLookAt(fpnx,fpny,fpnz, fpnx+dirx,fpny+diry,fpnz+dirz, 0.0,1.0,0.0);
+     eye[0] = fpnx;  eye[1] = fpny;  eye[2] = fpnz;
+   }
+   //  Straight down on the city
+   else
+   {
+      gluLookAt(0,3*dim,0 , 0,0,0 , 0,0,-1);
+      eye[0] = 0;  eye[1] = 3*dim;  eye[2] = 0;
    }
-   //city frame
-   city_frame(1,1,1, 0.3,0.3,0.3 , 90);
-
-   //  Draw city foundation
-   int stoplight_offset = 0;
-   draw_ground(1,1,1, 0.3,0.3,0.3 , 90);
-   draw_ground(15,1.3,1, 0.3,0.3,0.3 , 90);
-   draw_ground(1,1,15, 0.3,0.3,0.3 , 90);
-   draw_ground(15,1.3,15, 0.3,0.3,0.3 , 90);
-
-   //Draw street lights
-   draw_streetlights(-2,1,-1.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-2,1,3.75, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-2,1,-10.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-2,1,-15.75, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-2,1,12.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-2,1,17.75, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12,1,-1.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12,1,3.75, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12,1,-10.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12,1,-15.75, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12,1,12.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12,1,17.75, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-16,.5,-1.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-16,.5,3.75, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-16,.5,-10.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-16,.5,-15.75, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-16,.5,12.5, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-16,.5,17.75, 0.3,0.3,0.3 ,stoplight_offset);
-
-   stoplight_offset = 5;
-   draw_streetlights(-1.6,1,-1.375, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-6.6,1,-1.375, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-15.6,.5,-1.375, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-20.6,.5,-1.375, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(7.4,1,-1.375, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12.4,1,-1.375, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-1.6,1,12.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-6.6,1,12.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-1.6,1,-15.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-6.6,1,-15.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-15.6,.5,-15.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-20.6,.5,-15.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-15.6,.5,12.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(-20.6,.5,12.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(7.4,1,-15.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12.4,1,-15.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(7.4,1,12.6, 0.3,0.3,0.3 ,stoplight_offset);
-   draw_streetlights(12.4,1,12.6, 0.3,0.3,0.3 ,stoplight_offset);
-
-   //Draw Street Lamps
-   draw_lamp(7.5,1,12.5, 0.3,0.3,0.3 , 90);
-   draw_lamp(7.5,1,17.5, 0.3,0.3,0.3 , 90);
-   draw_lamp(7.5,1,-1.25, 0.3,0.3,0.3 , 90);
-   draw_lamp(7.5,1,3.5, 0.3,0.3,0.3 , 90);
-   draw_lamp(7.5,1,-15.4, 0.3,0.3,0.3 , 90);
-   draw_lamp(7.5,1,-10.65, 0.3,0.3,0.3 , 90);
-   draw_lamp(-6.5,1,-10.65, 0.3,0.3,0.3 , 90);
-   draw_lamp(-6.5,1,-15.4, 0.3,0.3,0.3 , 90);
-   draw_lamp(-6.5,1,12.5, 0.3,0.3,0.3 , 90);
-   draw_lamp(-6.5,1,17.5, 0.3,0.3,0.3 , 90);
-   draw_lamp(-6.5,1,-1.25, 0.3,0.3,0.3 , 90);
-   draw_lamp(-6.5,1,3.5, 0.3,0.3,0.3 , 90);
-
-   //Draw Arch building
-  draw_arch_building(5,1,1.75, 0.3,0.3,0.3 , 90);
-  draw_arch_building(5,1,-4, 0.3,0.3,0.3 , 90);
-  draw_arch_building(5,10,-1.25, 0.3,0.3,0.3 , 90);
-
-  //Draw a Skyscraper
-  draw_skyscraper(-5.2,1,-5, 0.3,0.3,0.3 , 90);
-
-
-   //  Light switch
+}
+
+/*
+ *  Draw the scene from the camera of view v
+ *    vp is the part of the framebuffer the views share.  Only the main view
+ *    uses occlusion queries and asks for virtual texture tiles.
+ */
+static void draw_view(view_t* v,const int vp[4],int main)
+{
+   const double len=1.5;  //  Length of axes
+   int i,j,q=queries && main;
+   float eye[3],P[16],M[16],clip[16];
+   drawlist_t* list;
+   int x = vp[0]+v->x*vp[2],y = vp[1]+v->y*vp[3];
+   int w = v->w*vp[2]>1 ? v->w*vp[2] : 1,h = v->h*vp[3]>1 ? v->h*vp[3] : 1;
+   //  Insets are drawn over the main view
+   if (!main)
+   {
+      glEnable(GL_SCISSOR_TEST);
+      glScissor(x,y,w,h);
+      glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+      glDisable(GL_SCISSOR_TEST);
+   }
+   glViewport(x,y,w,h);
+   Project(45,(double)w/h,dim);
+   camera(v->camera,eye);
+   //  The light is fixed in the scene, so it is placed again by each camera
+   if (light) light_position();
+   //  Build draw lists on the workers
+   glGetFloatv(GL_PROJECTION_MATRIX,P);
+   glGetFloatv(GL_MODELVIEW_MATRIX,M);
+   for (i=0;i<4;i++)
+      for (j=0;j<4;j++)
+         clip[4*j+i] = P[i]*M[4*j] + P[4+i]*M[4*j+1] + P[8+i]*M[4*j+2] + P[12+i]*M[4*j+3];
+   OcclusionBegin(clip);
+   list = DrawListBuild(eye,clip);
+   v->n = list->n;
+   v->occluded = list->occluded;
+   v->sort = list->sort;
+   //  Object transforms are built on the CPU starting from the camera
+   MatLoad(M);
+   //  Submit in key order (occluders, other opaque objects, impostors)
+   //  The textured objects share the atlas, so it is bound once
+   if (q) QueryFrame();
+   AtlasBegin();
+   for (i=0;i<list->n;i++)
+   {
+      const draw_t* d = list->draw+i;
+      lod = KEY_LOD(d->key);
+      //  Distant objects become impostors
+      if (KEY_PASS(d->key)==PASS_IMPOSTOR && ImpostorDraw(d->obj,eye))
+         continue;
+      //  With queries the occluders are always drawn to fill the depth buffer
+      if (!q || KEY_PASS(d->key)==PASS_OCCLUDER)
+         draw_scene(d->obj);
+      else if (QueryBegin(d->obj))
+      {
+         draw_scene(d->obj);
+         QueryEnd();
+      }
+   }
+   //  Ask for the ground tiles this view needs
+   if (vtex && main)
+   {
+      VTexFeedbackBegin();
+      for (i=0;i<list->n;i++)
+         if (scene[list->draw[i].obj].type==OBJ_GROUND)
+            draw_scene(list->draw[i].obj);
+      VTexFeedbackEnd();
+   }
+   //  Back to the camera for everything drawn in world coordinates
+   MatSync();
+   ImpostorFlush();
+   //  Re-test hidden objects against the finished depth buffer
+   if (q) QueryFlush();
+
+   //  Draw light position as ball
    if (light)
    {
-        //  Translate intensity to color vectors
-        float Ambient[]   = {0.01*ambient ,0.01*ambient ,0.01*ambient ,1.0};
-        float Diffuse[]   = {0.01*diffuse ,0.01*diffuse ,0.01*diffuse ,1.0};
-        float Specular[]  = {0.01*specular,0.01*specular,0.01*specular,1.0};
-        //  Light position
-        float Position[]  = {20*distance*Cos(zh),ylight,20*distance*Sin(zh),1.0};
-        //  Draw light position as ball (still no lighting here)
         glColor3f(1,1,1);
-        ball(Position[0],Position[1],Position[2] , 0.1);
-        //  OpenGL should normalize normal vectors
-        glEnable(GL_NORMALIZE);
-        //  Enable lighting
-        glEnable(GL_LIGHTING);
-        //  Location of viewer for specular calculations
-        glLightModeli(GL_LIGHT_MODEL_LOCAL_VIEWER,local);
-        //  glColor sets ambient and diffuse color materials
-        glColorMaterial(GL_FRONT_AND_BACK,GL_AMBIENT_AND_DIFFUSE);
-        glEnable(GL_COLOR_MATERIAL);
-        //  Enable light 0
-        glEnable(GL_LIGHT0);
-        //  Set ambient, diffuse, specular components and position of light 0
-        glLightfv(GL_LIGHT0,GL_AMBIENT ,Ambient);
-        glLightfv(GL_LIGHT0,GL_DIFFUSE ,Diffuse);
-        glLightfv(GL_LIGHT0,GL_SPECULAR,Specular);
-        glLightfv(GL_LIGHT0,GL_POSITION,Position);
+        ball(20*distance*Cos(zh),ylight,20*distance*Sin(zh) , 0.1);
+        MatSync();
+   }
+   //  Imported model
+   if (model && model->npiece)
+   {
+      float t[3],s = model_place(model,t);
+      int n;
+      MatPush();
+      MatScale(s,s,s);
+      MatTranslate(t[0],t[1],t[2]);
+      MatSync();
+      glColor3f(1,1,1);
+      n = ModelDraw(model,meshlets);
+      if (main) model_tris = n;
+      MatPop();
+      MatSync();
    }
-   else
-     glDisable(GL_LIGHTING);
    //  Draw axes
    glColor3f(1,1,1);
    if (axes)
@@ -927,7 +1141,111 @@ void display()
       glVertex3d(0.0,0.0,0.0);
       glVertex3d(0.0,0.0,len);
       glEnd();
-      //  Label axes
+   }
+   //  Mark the picked point and outline the picked object
+   if (pick && picked_hit)
+   {
+      glPushAttrib(GL_ENABLE_BIT|GL_LINE_BIT);
+      glDisable(GL_LIGHTING);
+      glLineWidth(2);
+      glColor3f(1,1,0);
+      glBegin(GL_LINES);
+      for (i=0;i<3;i++)
+      {
+         float p[3] = {picked.p[0],picked.p[1],picked.p[2]};
+         p[i] -= 0.1;
+         glVertex3fv(p);
+         p[i] += 0.2;
+         glVertex3fv(p);
+      }
+      glEnd();
+      if (picked.object>=0)
+      {
+         float min[3],max[3];
+         for (i=0;i<3;i++)
+         {
+            min[i] = xform.min[i][picked.object];
+            max[i] = xform.max[i][picked.object];
+         }
+         for (i=0;i<3;i++)
+         {
+            int a = (i+1)%3,b = (i+2)%3;
+            glBegin(GL_LINES);
+            for (j=0;j<4;j++)
+            {
+               float p[3];
+               p[a] = j&1 ? max[a] : min[a];
+               p[b] = j&2 ? max[b] : min[b];
+               p[i] = min[i];
+               glVertex3fv(p);
+               p[i] = max[i];
+               glVertex3fv(p);
+            }
+            glEnd();
+         }
+      }
+      glPopAttrib();
+   }
+}
+
+/*
+ *  OpenGL (GLUT) calls this routine to display the scene
+ */
+void display()
+{
+  const double len=1.5;  //  Length of axes
+   int k,vp[4];
+   unsigned int gen;
+   float eye[3];
+   size_t used,high;
+   int allocs;
+   //  Release transient data from two frames ago
+   ArenaFrame();
+   //  Swap in assets whose files have changed
+   AssetPoll();
+   //  Upload ground tiles requested by earlier frames
+   VTexUpdate();
+   //  Draw the scene at the resolution that holds the frame time
+   DynResBegin();
+   //  Erase the window and the depth buffer
+   glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+   //  Enable Z-buffering in OpenGL
+   glEnable(GL_DEPTH_TEST);
+   //  Work shared by all views
+   //  Render impostors again if the lighting has changed
+   ImpostorUpdate(impostor_key(),impostor_draw,impostor_light);
+   //  Object matrices in world coordinates
+   XformBake(bake_object);
+   //  Light colors (each camera places the light)
+   if (light)
+      lighting();
+   else
+     glDisable(GL_LIGHTING);
+   //  Next piece of a streaming model
+   if (model && model->stream) ModelStream(model);
+   //  Ray queries include the model once it is loaded, and again when it is replaced
+   gen = model && !model->stream ? AssetModelGeneration()+1 : 0;
+   if (gen!=ray_key)
+   {
+      ray_build(gen ? model : NULL);
+      ray_key = gen;
+   }
+   //  The main view shows the camera picked with m and the first inset the other one
+   view[0].camera = mode==1 ? CAM_ORBIT : CAM_FIRST;
+   view[1].camera = mode==1 ? CAM_FIRST : CAM_ORBIT;
+   glGetIntegerv(GL_VIEWPORT,vp);
+   for (k=0;k<views;k++)
+      draw_view(view+k,vp,k==0);
+   //  Back to the main camera
+   glViewport(vp[0],vp[1],vp[2],vp[3]);
+   Project(45,asp,dim);
+   camera(view[0].camera,eye);
+   //  Text is drawn at the resolution of the window
+   DynResEnd();
+   //  Label axes
+   if (axes)
+   {
+      glColor3f(0,0,0);
       glRasterPos3d(len,0.0,0.0);
       Print("X");
       glRasterPos3d(0.0,len,0.0);
@@ -945,9 +1263,92 @@ void display()
    else if(mode == 0){
      Print("Angle=%d,%d  Dim=%.1f FOV=%d Projection=%s",th,ph,dim,fov,"First Person");
    }
+   //  Culling results
+   glWindowPos2i(5,25);
+   ArenaStats(&used,&high,&allocs);
+   Print("Objects=%d/%d Occluded=%d Occlusion=%s Sort=%.3fms Arena=%dKB/%dKB Allocs=%d",
+      view[0].n,Nscene,view[0].occluded,occlusion?"On":"Off",1000*view[0].sort,(int)(used/1024),(int)(high/1024),allocs);
+   if (queries)
+   {
+      int visible,hidden,issued,waiting;
+      QueryStats(&visible,&hidden,&issued,&waiting);
+      glWindowPos2i(5,45);
+      Print("Queries: Visible=%d Hidden=%d Issued=%d Waiting=%d",visible,hidden,issued,waiting);
+   }
+   if (impostors)
+   {
+      int rebuilt,n = ImpostorCount(&rebuilt);
+      glWindowPos2i(5,queries?65:45);
+      Print("Impostors=%d Atlas renders=%d",n,rebuilt);
+   }
+   if (model)
+   {
+      glWindowPos2i(5,45+(queries?20:0)+(impostors?20:0));
+      Print("Model triangles=%d/%d Meshlets=%d Culling=%s",model_tris,model->ni/3,model->nmeshlet,meshlets?"On":"Off");
+      if (model->stream) Print(" Loading=%.0f%%",100*MeshStreamProgress(model->stream));
+   }
+   if (vtex)
+   {
+      int resident,slots,loading,tiles;
+      VTexStats(&resident,&slots,&loading,&tiles);
+      glWindowPos2i(5,45+(queries?20:0)+(impostors?20:0)+(model?20:0));
+      Print("Virtual texture: Resident=%d/%d Loading=%d Tiles=%d",resident,slots,loading,tiles);
+   }
+   if (dynres)
+   {
+      int w,h;
+      double ms,s = DynResStats(&w,&h,&ms);
+      glWindowPos2i(5,45+(queries?20:0)+(impostors?20:0)+(model?20:0)+(vtex?20:0));
+      Print("Resolution=%.0f%% (%dx%d) Frame=%.1fms",100*s,w,h,ms);
+   }
+   if (mode == 0)
+   {
+      int boxes,tested;
+      CollideStats(&boxes,&tested);
+      glWindowPos2i(5,45+(queries?20:0)+(impostors?20:0)+(model?20:0)+(vtex?20:0)+(dynres?20:0));
+      Print("Collision=%s Boxes=%d Tested=%d",collide?"On":"Off",boxes,tested);
+   }
+   if (pick)
+   {
+      int nodes,prims,visited;
+      double us;
+      RayStats(&nodes,&prims,&visited,&us);
+      glWindowPos2i(5,45+(queries?20:0)+(impostors?20:0)+(model?20:0)+(vtex?20:0)+(dynres?20:0)+(mode==0?20:0));
+      if (!picked_hit)
+         Print("Pick: nothing");
+      else if (picked.object>=0)
+         Print("Pick: %s %d",object_name[scene[picked.object].type],picked.object);
+      else
+         Print("Pick: Model triangle %d",picked.tri);
+      Print(" Ray=%.2fus Nodes=%d/%d Primitives=%d",us,visited,nodes,prims);
+   }
+   //  Culling results of the insets at their top left corners
+   for (k=1;k<views;k++)
+   {
+      int W = glutGet(GLUT_WINDOW_WIDTH),H = glutGet(GLUT_WINDOW_HEIGHT);
+      glWindowPos2i(view[k].x*W+5,(view[k].y+view[k].h)*H-20);
+      Print("%s",camera_name[view[k].camera]);
+      glWindowPos2i(view[k].x*W+5,(view[k].y+view[k].h)*H-40);
+      Print("Drawn=%d Occluded=%d",view[k].n,view[k].occluded);
+   }
+   //  Draw the text printed this frame
+   PrintFlush();
    //  Render the scene and make it visible
    glFlush();
+   //  Start readback of this frame if capturing
+   CaptureFrame();
    glutSwapBuffers();
+   //  Report time to first frame
+   if (!startup)
+   {
+      glFinish();
+      AssetMark("first frame");
+      AssetTimeline();
+      startup = 1;
+   }
+   //  Write and reset per-frame statistics
+   StatsFrame();
+   RecordFrame();
 }
 
 /*
@@ -955,6 +1356,8 @@ void display()
  */
 void special(int key,int x,int y)
 {
+   //  Log for replay
+   RecordEvent(EVENT_SPECIAL,key,x,y);
    //  Right arrow key - increase angle by 5 degrees
    if (key == GLUT_KEY_RIGHT)
       th += 5;
@@ -989,9 +1392,14 @@ void key(unsigned char ch,int x,int y)
 {
   float c_angle = .05;
   float inc = .05;
-   //  Exit on ESC
+   //  Log for replay
+   RecordEvent(EVENT_KEY,ch,x,y);
+   //  Exit on ESC (saving the frames still being captured)
    if (ch == 27)
+   {
+      CaptureFlush();
       exit(0);
+   }
    //  Reset view angle
    else if (ch == '0'){
       th = -45;
@@ -1008,6 +1416,33 @@ void key(unsigned char ch,int x,int y)
       light = 1-light;
    else if (ch == 'p' || ch == 'P')
       gc_move = (gc_move+1)%2;
+   //  Toggle occlusion culling
+   else if (ch == 'o' || ch == 'O')
+      occlusion = 1-occlusion;
+   //  Toggle occlusion queries
+   else if (ch == 'q' || ch == 'Q')
+      queries = 1-queries;
+   //  Toggle impostors
+   else if (ch == 'i' || ch == 'I')
+      impostors = 1-impostors;
+   //  Toggle meshlet culling of the model
+   else if (ch == 'c' || ch == 'C')
+      meshlets = 1-meshlets;
+   //  Toggle the virtual texture of the ground
+   else if (ch == 'v' || ch == 'V')
+      vtex = 1-vtex;
+   //  Toggle dynamic resolution
+   else if (ch == 'r' || ch == 'R')
+      dynres = 1-dynres;
+   //  Number of views
+   else if (ch == 'b' || ch == 'B')
+      views = views%MAXVIEWS+1;
+   //  Toggle collision of the first person camera
+   else if (ch == 'k' || ch == 'K')
+      collide = 1-collide;
+   //  Toggle picking with the mouse
+   else if (ch == 'f' || ch == 'F')
+      pick = 1-pick;
    //  Change field of view angle
    else if (ch == '-' && ch>1)
       fov--;
@@ -1047,7 +1482,19 @@ void key(unsigned char ch,int x,int y)
    shinyvec[0] = shininess<0 ? 0 : pow(2.0,shininess);
    //First Person Nav
    if(mode == 0){
-        if(ch == 'w' || ch == 'W') {
+        //  Move the camera sphere through the city and stand it on the ground
+        if (collide && (ch == 'w' || ch == 'W' || ch == 's' || ch == 'S')) {
+           float step = (ch == 'w' || ch == 'W') ? inc : -inc;
+           float p[3] = {fpnx,fpny,fpnz};
+           float d[3] = {step*cos(fpn_ang)*cos(fpn_p),step*sin(fpn_p),step*sin(fpn_ang)*cos(fpn_p)};
+           float ground;
+           CollideMove(p,d);
+           if (CollideGround(p[0],p[1],p[2],&ground)) p[1] = ground+COL_EYE;
+           fpnx = p[0];
+           fpny = p[1];
+           fpnz = p[2];
+        }
+        else if(ch == 'w' || ch == 'W') {
            float lx = cos(fpn_ang)*cos(fpn_p);
            float ly = sin(fpn_p);
            float lz = sin(fpn_ang)*cos(fpn_p);
@@ -1077,23 +1524,142 @@ void key(unsigned char ch,int x,int y)
    glutPostRedisplay();
 }
 
+/*
+ *  Pick what is under window position (x,y) in the view drawn there
+ */
+static void pick_at(int x,int y)
+{
+   int W = glutGet(GLUT_WINDOW_WIDTH),H = glutGet(GLUT_WINDOW_HEIGHT);
+   int k,vp[4];
+   double mv[16],pr[16],a[3],b[3];
+   float eye[3],org[3],dir[3];
+   const view_t* v = view;
+   //  Insets are drawn over the main view
+   y = H-y;
+   for (k=views-1;k>0;k--)
+      if (x>=view[k].x*W && x<(view[k].x+view[k].w)*W && y>=view[k].y*H && y<(view[k].y+view[k].h)*H)
+      {
+         v = view+k;
+         break;
+      }
+   vp[0] = v->x*W;
+   vp[1] = v->y*H;
+   vp[2] = v->w*W>1 ? v->w*W : 1;
+   vp[3] = v->h*H>1 ? v->h*H : 1;
+   //  Ray from the near to the far plane through the cursor
+   Project(45,(double)vp[2]/vp[3],dim);
+   camera(v->camera,eye);
+   glGetDoublev(GL_MODELVIEW_MATRIX,mv);
+   glGetDoublev(GL_PROJECTION_MATRIX,pr);
+   gluUnProject(x,y,0,mv,pr,vp,a,a+1,a+2);
+   gluUnProject(x,y,1,mv,pr,vp,b,b+1,b+2);
+   for (k=0;k<3;k++)
+   {
+      org[k] = a[k];
+      dir[k] = b[k]-a[k];
+   }
+   //  Matrices of the main view as display leaves them
+   Project(45,asp,dim);
+   camera(view[0].camera,eye);
+   picked_hit = RayCast(org,dir,1,&picked);
+   if (!picked_hit)
+      printf("Picked nothing\n");
+   else if (picked.object>=0)
+      printf("Picked %s %d at (%.2f,%.2f,%.2f)\n",object_name[scene[picked.object].type],picked.object,picked.p[0],picked.p[1],picked.p[2]);
+   else
+      printf("Picked model triangle %d at (%.2f,%.2f,%.2f)\n",picked.tri,picked.p[0],picked.p[1],picked.p[2]);
+}
+
+/*
+ *  GLUT calls this routine when a mouse button is pressed or released
+ */
+void mouse(int button,int state,int x,int y)
+{
+   if (state!=GLUT_DOWN) return;
+   //  Log for replay
+   RecordEvent(EVENT_MOUSE,button,x,y);
+   if (pick && button==GLUT_LEFT_BUTTON)
+      pick_at(x,y);
+   glutPostRedisplay();
+}
+
 /*
  *  GLUT calls this routine when the window is resized
  */
 void reshape(int width,int height)
 {
+   //  Log for replay
+   RecordEvent(EVENT_RESHAPE,0,width,height);
    //  Ratio of the width to the height of the window
    asp = (height>0) ? (double)width/height : 1;
    //  Set the viewport to the entire window
    glViewport(0,0, width,height);
+   //  Size of the dynamic resolution framebuffer
+   DynResReshape(width,height);
    //  Set projection
    Project(45,asp,dim);
 }
 
-void idle_function()
+/*
+ *  GLUT calls this routine instead of reshape when replaying
+ *    Live size changes are ignored; the recorded ones are replayed
+ */
+void replay_reshape(int width,int height)
 {
-   double t = glutGet(GLUT_ELAPSED_TIME)/1000.0;
+}
+
+/*
+ *  Move the light to time ms
+ */
+static void animate(int ms)
+{
+   double t = ms/1000.0;
    zh = fmod(90*t,360);
+}
+
+void idle_function()
+{
+   int ms = glutGet(GLUT_ELAPSED_TIME);
+   //  Log the clock so a replay moves the light identically
+   RecordEvent(EVENT_TICK,0,ms,0);
+   animate(ms);
+   glutPostRedisplay();
+}
+
+/*
+ *  GLUT calls this routine instead of idle_function when replaying
+ *  Recorded events due in this frame are fed to the callbacks
+ */
+void replay_function()
+{
+   static int t0=-1;
+   event_t e;
+   if (t0<0) t0 = glutGet(GLUT_ELAPSED_TIME);
+   //  Report and quit once the last recorded frame has been drawn
+   if (ReplayDone())
+   {
+      double t = (glutGet(GLUT_ELAPSED_TIME)-t0)/1000.0;
+      unsigned int n = ReplayFrames();
+      fprintf(stderr,"Replayed %u frames in %.3f s (%.2f ms/frame)\n",n,t,n?1000*t/n:0);
+      CaptureFlush();
+      exit(0);
+   }
+   while (ReplayEvent(&e))
+   {
+      if (e.type==EVENT_KEY)
+         key(e.key,e.x,e.y);
+      else if (e.type==EVENT_SPECIAL)
+         special(e.key,e.x,e.y);
+      else if (e.type==EVENT_RESHAPE)
+      {
+         glutReshapeWindow(e.x,e.y);
+         reshape(e.x,e.y);
+      }
+      else if (e.type==EVENT_TICK)
+         animate(e.x);
+      else if (e.type==EVENT_MOUSE)
+         mouse(e.key,GLUT_DOWN,e.x,e.y);
+   }
    glutPostRedisplay();
 }
 
@@ -1102,22 +1668,103 @@ void idle_function()
  */
 int main(int argc,char* argv[])
 {
+   int k;
+   int replay=0;
+   const char* capture=NULL;
+   const char* format="ppm";
+   int threads=0;
+   const char* obj=NULL;
+   int vertex=MODEL_COMPACT;
+   int stream=0;
+   AssetMark("start");
    //  Initialize GLUT
    glutInit(&argc,argv);
+   //  Process remaining command line options
+   for (k=1;k<argc;k++)
+   {
+      //  Per-frame GL statistics as JSON lines
+      if (!strcmp(argv[k],"-stats") && k+1<argc)
+         StatsOpen(argv[++k]);
+      //  Record input events
+      else if (!strcmp(argv[k],"-record") && k+1<argc)
+         RecordOpen(argv[++k]);
+      //  Replay recorded input events
+      else if (!strcmp(argv[k],"-replay") && k+1<argc)
+      {
+         ReplayOpen(argv[++k]);
+         replay = 1;
+      }
+      //  Capture frames to directory
+      else if (!strcmp(argv[k],"-capture") && k+1<argc)
+         capture = argv[++k];
+      //  Capture file format
+      else if (!strcmp(argv[k],"-format") && k+1<argc)
+         format = argv[++k];
+      //  Worker threads for draw list construction
+      else if (!strcmp(argv[k],"-threads") && k+1<argc)
+         threads = atoi(argv[++k]);
+      //  Model to import
+      else if (!strcmp(argv[k],"-obj") && k+1<argc)
+         obj = argv[++k];
+      //  Stream the model in pieces of n triangles
+      else if (!strcmp(argv[k],"-stream") && k+1<argc)
+         stream = atoi(argv[++k]);
+      //  Vertex format of the model
+      else if (!strcmp(argv[k],"-vertex") && k+1<argc && !strcmp(argv[k+1],"float"))
+      {
+         vertex = MODEL_FLOAT;
+         k++;
+      }
+      else if (!strcmp(argv[k],"-vertex") && k+1<argc && !strcmp(argv[k+1],"compact"))
+      {
+         vertex = MODEL_COMPACT;
+         k++;
+      }
+      //  Scale the resolution to hold a frame time (ms)
+      else if (!strcmp(argv[k],"-target") && k+1<argc)
+         DynResTarget(atof(argv[++k]));
+      else
+         Fatal("Usage: %s [-stats file|-] [-record file] [-replay file] [-capture dir [-format ppm|png|raw]] [-threads n] [-obj file [-vertex float|compact] [-stream n]] [-target ms]\n",argv[0]);
+   }
+   //  Check the assets and start reading the textures before the window opens
+   AssetPreload(manifest,NMANIFEST,obj);
    //  Request double buffered, true color window with Z buffering at 600x600
    glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
    glutInitWindowSize(600,600);
    glutCreateWindow("Future City");
+   AssetMark("window");
+   if (capture) CaptureOpen(capture,format);
+   //  Start worker threads
+   JobsInit(threads);
+   //  Hash the solid parts of the city for the first person camera
+   CollideInit();
    //  Tell GLUT to call "idle" when there is nothing else to do
-   glutIdleFunc(idle_function);
-   //  Load textures
-   texture[0] = LoadTexBMP("textures/central_block.bmp");
-   texture[1] = LoadTexBMP("textures/grass.bmp");
+   glutIdleFunc(replay ? replay_function : idle_function);
+   //  Upload textures
+   AssetUpload();
+   //  Ground detail is streamed from a virtual texture made from the block texture
+   VTexOpen("textures/ground.vt",manifest[TEX_BLOCK],ground_block(scene+Nscene));
+   AssetMark("virtual texture");
+   //  Load model
+   if (obj && stream>0)
+      model = ModelOpen(obj,vertex,stream,1);
+   else if (obj)
+      model = ModelLoad(obj,vertex);
+   if (model)
+   {
+      AssetModel(&model);
+      AssetMark("model");
+   }
    //  Set callbacks
    glutDisplayFunc(display);
-   glutReshapeFunc(reshape);
-   glutSpecialFunc(special);
-   glutKeyboardFunc(key);
+   glutReshapeFunc(replay ? replay_reshape : reshape);
+   //  Live input is ignored while replaying
+   if (!replay)
+   {
+      glutSpecialFunc(special);
+      glutKeyboardFunc(key);
+      glutMouseFunc(mouse);
+   }
    //  Pass control to GLUT so it can interact with the user
    glutMainLoop();
    return 0;
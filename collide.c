@@ -0,0 +1,234 @@
+/*
+ *  Collision of the first person camera with the city
+ */
+#include "CSCIx229.h"
+#include "scene.h"
+#include "collide.h"
+
+#define COL_SLIDE 4      //  Most slides in one step
+#define COL_SKIN  0.001  //  Gap left between the sphere and what it hits
+
+//  Box in world coordinates (laid out like the parts of an object)
+typedef struct
+{
+   float min[3],max[3];
+} box_t;
+
+int collide = 1;
+
+static box_t*        box=NULL;              //  All boxes
+static int           Nbox=0;
+static int           start[COL_BUCKETS+1];  //  First item of each bucket
+static int*          item=NULL;             //  Boxes of the cells in each bucket
+static unsigned int* seen=NULL;             //  Search that last found each box
+static unsigned int  search=0;
+static int           tested=0;              //  Boxes tested by the last move
+
+/*
+ *  Grid cell of a coordinate
+ */
+static int Cell(float x)
+{
+   return (int)floor(x/COL_CELL);
+}
+
+/*
+ *  Bucket of cell (i,j)
+ */
+static int Bucket(int i,int j)
+{
+   return ((unsigned int)i*73856093u ^ (unsigned int)j*19349663u) & (COL_BUCKETS-1);
+}
+
+/*
+ *  Hash the boxes of the scene
+ */
+void CollideInit(void)
+{
+   float part[OBJ_PARTS][2][3];
+   int k,n,i,j,pass;
+   //  Boxes
+   for (pass=0;pass<2;pass++)
+   {
+      Nbox = 0;
+      for (k=0;k<Nscene;k++)
+      {
+         n = ObjectParts(scene+k,part);
+         if (pass) memcpy(box+Nbox,part,n*sizeof(box_t));
+         Nbox += n;
+      }
+      if (!pass)
+      {
+         box = (box_t*)malloc(Nbox*sizeof(box_t));
+         seen = (unsigned int*)calloc(Nbox,sizeof(unsigned int));
+         if (!box || !seen) Fatal("Cannot allocate %d collision boxes\n",Nbox);
+      }
+   }
+   //  Count then fill the buckets of the cells each box covers
+   memset(start,0,sizeof(start));
+   for (pass=0;pass<2;pass++)
+   {
+      for (k=0;k<Nbox;k++)
+         for (i=Cell(box[k].min[0]);i<=Cell(box[k].max[0]);i++)
+            for (j=Cell(box[k].min[2]);j<=Cell(box[k].max[2]);j++)
+            {
+               int b = Bucket(i,j);
+               if (pass)
+                  item[--start[b]] = k;
+               else
+                  start[b+1]++;
+            }
+      if (!pass)
+      {
+         for (i=0;i<COL_BUCKETS;i++)
+            start[i+1] += start[i];
+         item = (int*)malloc(start[COL_BUCKETS]*sizeof(int));
+         if (!item) Fatal("Cannot allocate collision grid\n");
+         //  Filled from the end of each bucket
+         for (i=0;i<COL_BUCKETS;i++)
+            start[i] = start[i+1];
+      }
+   }
+}
+
+/*
+ *  Boxes in the cells over [x0,x1] x [z0,z1], each once
+ *    Returns the number of boxes put in found
+ */
+static int Find(float x0,float z0,float x1,float z1,int found[],int max)
+{
+   int i,j,k,n=0;
+   search++;
+   for (i=Cell(x0);i<=Cell(x1);i++)
+      for (j=Cell(z0);j<=Cell(z1);j++)
+      {
+         int b = Bucket(i,j);
+         for (k=start[b];k<start[b+1] && n<max;k++)
+            if (seen[item[k]]!=search)
+            {
+               seen[item[k]] = search;
+               found[n++] = item[k];
+            }
+      }
+   return n;
+}
+
+/*
+ *  Time in [0,1] at which a sphere of radius r moving from p by d first
+ *  touches box b
+ *    The box is grown by r on every side, so corners are a little too
+ *    large.  Sets the normal of the face hit.  Returns 0 if it does not
+ *    touch it, or is already inside it.
+ */
+static int Sweep(const box_t* b,const float p[3],const float d[3],float r,float* t,float n[3])
+{
+   float tin=-1,tout=2;
+   int i,axis=-1;
+   for (i=0;i<3;i++)
+   {
+      float lo = b->min[i]-r,hi = b->max[i]+r;
+      if (d[i]==0)
+      {
+         if (p[i]<=lo || p[i]>=hi) return 0;
+      }
+      else
+      {
+         float t0 = (lo-p[i])/d[i],t1 = (hi-p[i])/d[i];
+         if (t0>t1)
+         {
+            float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+         }
+         if (t0>tin)
+         {
+            tin = t0;
+            axis = i;
+         }
+         if (t1<tout) tout = t1;
+      }
+   }
+   if (axis<0 || tin>tout || tin<0 || tin>1) return 0;
+   n[0] = n[1] = n[2] = 0;
+   n[axis] = d[axis]>0 ? -1 : 1;
+   *t = tin;
+   return 1;
+}
+
+/*
+ *  Height of the ground under the eye at (x,y,z)
+ *    The ground is the highest top under (x,z) the feet can step onto.
+ *    Returns 0 if there is nothing under the eye.
+ */
+int CollideGround(float x,float y,float z,float* ground)
+{
+   int found[256];
+   int k,n = Find(x,z,x,z,found,256),hit=0;
+   float top = y-COL_RADIUS;
+   for (k=0;k<n;k++)
+   {
+      const box_t* b = box+found[k];
+      if (x>=b->min[0] && x<=b->max[0] && z>=b->min[2] && z<=b->max[2] && b->max[1]<=top && (!hit || b->max[1]>*ground))
+      {
+         *ground = b->max[1];
+         hit = 1;
+      }
+   }
+   return hit;
+}
+
+/*
+ *  Move the camera sphere at p by d, sliding along what it hits
+ */
+void CollideMove(float p[3],const float d[3])
+{
+   int found[256];
+   float len = sqrt(d[0]*d[0]+d[1]*d[1]+d[2]*d[2]);
+   int s,i,k,steps = (int)ceil(len/(0.5*COL_CELL));
+   tested = 0;
+   for (s=0;s<steps;s++)
+   {
+      float v[3] = {d[0]/steps,d[1]/steps,d[2]/steps};
+      int slide;
+      for (slide=0;slide<COL_SLIDE;slide++)
+      {
+         float t=2,n[3]={0,0,0},tk,nk[3],l;
+         int m = Find((v[0]<0 ? p[0]+v[0] : p[0])-COL_RADIUS,(v[2]<0 ? p[2]+v[2] : p[2])-COL_RADIUS,
+                      (v[0]>0 ? p[0]+v[0] : p[0])+COL_RADIUS,(v[2]>0 ? p[2]+v[2] : p[2])+COL_RADIUS,found,256);
+         tested += m;
+         //  First box touched
+         for (k=0;k<m;k++)
+            if (Sweep(box+found[k],p,v,COL_RADIUS,&tk,nk) && tk<t)
+            {
+               t = tk;
+               memcpy(n,nk,sizeof(n));
+            }
+         if (t>1)
+         {
+            for (i=0;i<3;i++)
+               p[i] += v[i];
+            break;
+         }
+         //  Stop short of it and slide the rest of the way along the face
+         l = sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+         t = t-COL_SKIN/l>0 ? t-COL_SKIN/l : 0;
+         for (i=0;i<3;i++)
+         {
+            p[i] += t*v[i];
+            v[i] *= 1-t;
+         }
+         l = v[0]*n[0]+v[1]*n[1]+v[2]*n[2];
+         for (i=0;i<3;i++)
+            v[i] -= l*n[i];
+      }
+   }
+}
+
+/*
+ *  Boxes in the grid and boxes tested by the last move
+ */
+void CollideStats(int* boxes,int* last)
+{
+   *boxes = Nbox;
+   *last = tested;
+}
@@ -0,0 +1,38 @@
+/*
+ *  Collision of the first person camera with the city
+ *
+ *  The solid parts of every object (posts, walls, the skyscraper cone as
+ *  stacked boxes, the ground) are boxes in a static uniform grid over x
+ *  and z, hashed into COL_BUCKETS lists.  The camera is a sphere of radius
+ *  COL_RADIUS at the eye.  Moves are split into steps no longer than half
+ *  a cell, so each step only looks at the boxes of at most 2x2 cells and
+ *  the cost of a move depends on its length, not the size of the city.
+ *  The sphere slides along what it hits, and after each move the eye is
+ *  put COL_EYE above the highest surface under it that is no more than
+ *  COL_EYE-COL_RADIUS above the feet, so kerbs are stepped onto and walls
+ *  are not.
+ */
+#ifndef COLLIDE_H
+#define COLLIDE_H
+
+#define COL_CELL    4.0    //  Grid cell size
+#define COL_BUCKETS 1024   //  Hash buckets (a power of two)
+#define COL_RADIUS  0.3    //  Radius of the camera sphere
+#define COL_EYE     0.8    //  Eye height above the ground
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int collide;  //  Collision enabled
+
+void  CollideInit(void);
+int   CollideGround(float x,float y,float z,float* ground);
+void  CollideMove(float p[3],const float d[3]);
+void  CollideStats(int* boxes,int* tested);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
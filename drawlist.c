@@ -0,0 +1,217 @@
+/*
+ *  Per-frame draw lists
+ */
+#include "CSCIx229.h"
+#include "scene.h"
+#include "drawlist.h"
+#include "jobs.h"
+#include "occlude.h"
+#include "impostor.h"
+#include "arena.h"
+#include "xform.h"
+
+//  Frame being built
+typedef struct
+{
+   float eye[3];       //  Eye position
+   float plane[6][4];  //  Frustum planes
+} view_t;
+
+static drawlist_t list[JOBS_MAX];  //  One list per part
+static drawlist_t frame;           //  All parts, sorted
+
+//  Pass and texture of each object type (the type is its material)
+static const int state[OBJ_TYPES][2] =
+{
+   {PASS_OCCLUDER,1},  //  OBJ_FRAME (atlas page 0)
+   {PASS_OCCLUDER,1},  //  OBJ_GROUND (atlas page 0)
+   {PASS_OPAQUE,0},    //  OBJ_STREETLIGHT
+   {PASS_OPAQUE,0},    //  OBJ_LAMP
+   {PASS_OCCLUDER,0},  //  OBJ_ARCH
+   {PASS_OCCLUDER,0},  //  OBJ_SKYSCRAPER
+};
+
+/*
+ *  Extract frustum planes from the clip matrix (projection*modelview)
+ */
+static void Planes(const float m[16],float p[6][4])
+{
+   int i,k;
+   for (k=0;k<3;k++)
+      for (i=0;i<4;i++)
+      {
+         p[2*k  ][i] = m[4*i+3]+m[4*i+k];
+         p[2*k+1][i] = m[4*i+3]-m[4*i+k];
+      }
+}
+
+/*
+ *  True if box is at least partly inside the frustum
+ */
+static int Visible(const float p[6][4],const float min[3],const float max[3])
+{
+   int k;
+   for (k=0;k<6;k++)
+   {
+      //  Corner farthest along the plane normal
+      float x = p[k][0]>0 ? max[0] : min[0];
+      float y = p[k][1]>0 ? max[1] : min[1];
+      float z = p[k][2]>0 ? max[2] : min[2];
+      if (p[k][0]*x+p[k][1]*y+p[k][2]*z+p[k][3]<0) return 0;
+   }
+   return 1;
+}
+
+/*
+ *  Sort key of object k at level of detail lod and distance d
+ */
+static unsigned int Key(int k,int lod,float d)
+{
+   const object_t* o = scene+k;
+   const float near = KEY_NEAR;
+   unsigned int depth,bias;
+   //  Positive floats order the same as their bits, and the exponent and
+   //  top 7 bits of the mantissa are 1 part in 128, plenty for ordering draws
+   if (d<near) d = near;
+   memcpy(&depth,&d,sizeof(depth));
+   memcpy(&bias,&near,sizeof(bias));
+   depth = (depth>>16)-(bias>>16);
+   if (depth>KEY_DEPTH) depth = KEY_DEPTH;
+   //  Distant objects with impostors are blended, so go back to front
+   if (lod==LODS-1 && impostors && ImpostorKind(o)>=0)
+      return KEY(PASS_IMPOSTOR,1,o->type,0,KEY_DEPTH-depth);
+   //  Opaque objects go front to back
+   return KEY(state[o->type][0],0,o->type,state[o->type][1],depth);
+}
+
+/*
+ *  Sort draws on their keys
+ *    LSD radix sort on KEY_DIGIT bit digits (two for a key), skipping
+ *    digits that are the same in every key
+ *    tmp must hold n draws and the sorted draws are in whichever buffer
+ *    is returned
+ */
+draw_t* DrawListSort(draw_t* draw,draw_t* tmp,int n)
+{
+   #define ND ((KEY_BITS+KEY_DIGIT-1)/KEY_DIGIT)
+   #define NB (1<<KEY_DIGIT)
+   static unsigned int count[ND][NB];
+   unsigned int diff=0,mask=NB-1;
+   int i,b,nd=0,shift[ND];
+   if (n<2) return draw;
+   //  Digits that differ between keys
+   for (i=1;i<n;i++)
+      diff |= draw[i].key^draw[0].key;
+   diff &= (1u<<KEY_BITS)-1;
+   for (b=0;b<ND;b++)
+      if ((diff>>(KEY_DIGIT*b))&mask) shift[nd++] = KEY_DIGIT*b;
+   //  Histogram of those digits in one pass
+   memset(count,0,nd*sizeof(count[0]));
+   for (i=0;i<n;i++)
+   {
+      unsigned int k = draw[i].key;
+      for (b=0;b<nd;b++)
+         count[b][(k>>shift[b])&mask]++;
+   }
+   for (b=0;b<nd;b++)
+   {
+      unsigned int sum=0,*c=count[b];
+      int s = shift[b];
+      draw_t* t;
+      //  Offsets and scatter
+      for (i=0;i<NB;i++)
+      {
+         unsigned int m = c[i];
+         c[i] = sum;
+         sum += m;
+      }
+      for (i=0;i<n;i++)
+         tmp[c[(draw[i].key>>s)&mask]++] = draw[i];
+      t = draw;  draw = tmp;  tmp = t;
+   }
+   return draw;
+   #undef ND
+   #undef NB
+}
+
+/*
+ *  Build the list for one part of the scene
+ */
+static void Build(int part,int parts,void* arg)
+{
+   const view_t* v = (const view_t*)arg;
+   drawlist_t*   l = list+part;
+   int k;
+   int k0 = Nscene*part/parts;
+   int k1 = Nscene*(part+1)/parts;
+
+   l->n = l->culled = l->occluded = 0;
+   l->draw = (draw_t*)ArenaAlloc(part,(k1-k0)*sizeof(draw_t));
+   for (k=k0;k<k1;k++)
+   {
+      float min[3] = {xform.min[0][k],xform.min[1][k],xform.min[2][k]};
+      float max[3] = {xform.max[0][k],xform.max[1][k],xform.max[2][k]};
+      float c[3],r,d,size;
+      int lod;
+      draw_t* dr;
+      //  Frustum cull
+      if (!Visible(v->plane,min,max))
+      {
+         l->culled++;
+         continue;
+      }
+      //  Occlusion cull
+      if (!OcclusionTest(min,max))
+      {
+         l->occluded++;
+         continue;
+      }
+      //  Distance to center and radius
+      c[0] = xform.center[0][k]-v->eye[0];
+      c[1] = xform.center[1][k]-v->eye[1];
+      c[2] = xform.center[2][k]-v->eye[2];
+      d = sqrt(c[0]*c[0]+c[1]*c[1]+c[2]*c[2]);
+      r = xform.radius[k];
+      dr = l->draw + l->n++;
+      dr->obj   = k;
+      //  Level of detail from the angular size of the object
+      size = d>r ? r/d : 1;
+      lod = size>0.3 ? 0 : size>0.08 ? 1 : 2;
+      dr->key = Key(k,lod,d) | (unsigned int)lod<<KEY_BITS;
+   }
+}
+
+
+/*
+ *  Build the draw list for the current view
+ *    eye is the eye position and clip is projection*modelview
+ *    Returns the frame's draws in submission order
+ */
+drawlist_t* DrawListBuild(const float eye[3],const float clip[16])
+{
+   view_t v;
+   int k,n=0;
+   draw_t* spare;
+   double t;
+   memcpy(v.eye,eye,sizeof(v.eye));
+   Planes(clip,v.plane);
+   JobsRun(Build,&v);
+   //  Join the parts
+   for (k=0;k<JobsCount();k++)
+      n += list[k].n;
+   frame.draw = (draw_t*)ArenaAlloc(0,n*sizeof(draw_t));
+   spare = (draw_t*)ArenaAlloc(0,n*sizeof(draw_t));
+   frame.n = frame.culled = frame.occluded = 0;
+   for (k=0;k<JobsCount();k++)
+   {
+      memcpy(frame.draw+frame.n,list[k].draw,list[k].n*sizeof(draw_t));
+      frame.n        += list[k].n;
+      frame.culled   += list[k].culled;
+      frame.occluded += list[k].occluded;
+   }
+   //  Sort, keeping whichever buffer ends up holding the result
+   t = Elapsed();
+   frame.draw = DrawListSort(frame.draw,spare,frame.n);
+   frame.sort = Elapsed()-t;
+   return &frame;
+}
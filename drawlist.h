@@ -0,0 +1,69 @@
+/*
+ *  Per-frame draw lists
+ *
+ *  The scene table is split into one contiguous range per worker thread.
+ *  Each worker culls its objects against the view frustum, picks a level
+ *  of detail and gives each visible object a 22 bit sort key.  The parts
+ *  are joined into one list for the frame and radix sorted on the key, so
+ *  the GL thread only has to walk it and call the draw functions.  The
+ *  lists live in the frame arena and are valid until the next frame ends.
+ */
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#define LODS 3  //  Levels of detail (0 is full detail)
+
+//  Sort key fields from most to least significant
+//    pass(2) translucent(1) material(4) texture(4) depth(11)
+//  so the key is two 11 bit radix digits.  Depth is the distance as a
+//  float with 7 bits of mantissa, over the 16 octaves from KEY_NEAR.
+#define KEY(pass,translucent,material,texture,depth) \
+   (((unsigned int)(pass)<<20) | ((unsigned int)(translucent)<<19) | \
+    ((unsigned int)(material)<<15) | ((unsigned int)(texture)<<11) | (depth))
+#define KEY_PASS(k)        ((int)((k)>>20)&3)
+#define KEY_TRANSLUCENT(k) ((int)((k)>>19)&1)
+#define KEY_MATERIAL(k)    ((int)((k)>>15)&0xF)
+#define KEY_TEXTURE(k)     ((int)((k)>>11)&0xF)
+#define KEY_LOD(k)         ((int)((k)>>22)&3)  //  Carried above the sorted bits
+#define KEY_DEPTH   0x7FF    //  Largest depth
+#define KEY_NEAR    0.0625   //  Distance of depth 0
+#define KEY_DIGIT   11       //  Bits sorted in each radix pass
+#define KEY_BITS    22       //  Bits in a key
+
+//  Passes in submission order
+enum
+{
+   PASS_OCCLUDER,  //  Large objects that hide others
+   PASS_OPAQUE,    //  Everything else
+   PASS_IMPOSTOR,  //  Blended impostor billboards
+};
+
+//  One object to draw
+typedef struct
+{
+   unsigned int key;  //  Sort key and level of detail
+   int          obj;  //  Index into scene
+} draw_t;
+
+//  Draws for the frame (or one part of it)
+typedef struct
+{
+   draw_t* draw;  //  Draws in submission order (frame arena)
+   int     n;     //  Number of draws
+   int     culled;   //  Objects outside the frustum
+   int     occluded; //  Objects hidden by occluders
+   double  sort;     //  Seconds spent sorting
+} drawlist_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+drawlist_t* DrawListBuild(const float eye[3],const float clip[16]);
+draw_t* DrawListSort(draw_t* draw,draw_t* tmp,int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ *  Dynamic resolution
+ */
+#include "CSCIx229.h"
+#include "glstats.h"
+#include "dynres.h"
+
+int dynres = 0;
+
+static double       target=DYN_TARGET/1000;  //  Frame time target (s)
+static double       scale=1;                 //  Fraction of the window width and height drawn
+static double       dt[DYN_FRAMES];          //  Frame times since the last change
+static int          Ndt=0;
+static double       last=-1;                 //  Time the last frame started
+static double       median=0;                //  Median frame time when last changed
+static int          W=0,H=0;                 //  Window size
+static int          fw=0,fh=0;               //  Framebuffer size
+static int          sw=0,sh=0;               //  Size drawn this frame
+static int          active=0;                //  Drawing into the framebuffer
+static int          prev;                    //  Framebuffer of the window
+static unsigned int fbo=0,color=0,depth=0;
+
+/*
+ *  Set the frame time target in ms and enable dynamic resolution
+ */
+void DynResTarget(double ms)
+{
+   if (ms<=0) Fatal("Frame time target must be positive\n");
+   target = ms/1000;
+   dynres = 1;
+}
+
+/*
+ *  Note the size of the window
+ */
+void DynResReshape(int width,int height)
+{
+   W = width;
+   H = height;
+}
+
+/*
+ *  Median of the frame times
+ */
+static double Median(void)
+{
+   double s[DYN_FRAMES];
+   int i,j;
+   for (i=0;i<Ndt;i++)
+   {
+      for (j=i;j>0 && s[j-1]>dt[i];j--)
+         s[j] = s[j-1];
+      s[j] = dt[i];
+   }
+   return s[Ndt/2];
+}
+
+/*
+ *  Choose the scale from the time of the last frames
+ */
+static void Adjust(void)
+{
+   double t = Elapsed(),f;
+   if (last>=0 && Ndt<DYN_FRAMES) dt[Ndt++] = t-last;
+   last = t;
+   if (Ndt<DYN_FRAMES) return;
+   //  Time is about proportional to the pixels drawn, which go as the scale squared
+   median = Median();
+   f = sqrt(target/median);
+   if (median>1.05*target)
+      scale *= f;
+   else if (median<0.85*target && scale<1)
+      scale *= f<DYN_GROW ? f : DYN_GROW;
+   else
+   {
+      //  Keep measuring at this scale
+      memmove(dt,dt+1,(DYN_FRAMES-1)*sizeof(double));
+      Ndt--;
+      return;
+   }
+   if (scale<DYN_MIN) scale = DYN_MIN;
+   if (scale>1) scale = 1;
+   //  Frames drawn at the old scale no longer count
+   Ndt = 0;
+}
+
+/*
+ *  Start drawing the scene at the chosen resolution
+ *    Call before clearing the frame
+ */
+void DynResBegin(void)
+{
+   if (!dynres || !W || !H)
+   {
+      last = -1;
+      Ndt = 0;
+      return;
+   }
+   Adjust();
+   //  Framebuffer the size of the window
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING,&prev);
+   if (fw!=W || fh!=H)
+   {
+      fw = W;
+      fh = H;
+      if (!fbo)
+      {
+         glGenFramebuffers(1,&fbo);
+         glGenRenderbuffers(1,&color);
+         glGenRenderbuffers(1,&depth);
+      }
+      glBindRenderbuffer(GL_RENDERBUFFER,color);
+      glRenderbufferStorage(GL_RENDERBUFFER,GL_RGBA8,fw,fh);
+      glBindRenderbuffer(GL_RENDERBUFFER,depth);
+      glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT24,fw,fh);
+      glBindRenderbuffer(GL_RENDERBUFFER,0);
+      glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_RENDERBUFFER,color);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,depth);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+         Fatal("Cannot create %dx%d dynamic resolution framebuffer\n",fw,fh);
+   }
+   sw = scale*fw+0.5;
+   sh = scale*fh+0.5;
+   if (sw<1) sw = 1;
+   if (sh<1) sh = 1;
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   glViewport(0,0,sw,sh);
+   active = 1;
+}
+
+/*
+ *  Stretch the scene over the window
+ *    Text drawn afterwards is at the resolution of the window
+ */
+void DynResEnd(void)
+{
+   if (!active) return;
+   STATS_BEGIN;
+   glBindFramebuffer(GL_READ_FRAMEBUFFER,fbo);
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER,prev);
+   glBlitFramebuffer(0,0,sw,sh,0,0,W,H,GL_COLOR_BUFFER_BIT,GL_LINEAR);
+   glBindFramebuffer(GL_FRAMEBUFFER,prev);
+   glViewport(0,0,W,H);
+   //  Nothing has been drawn to the depth buffer of the window
+   glClear(GL_DEPTH_BUFFER_BIT);
+   active = 0;
+   STATS_END;
+}
+
+/*
+ *  Scale of the last frame
+ *    Also returns the size drawn and the median frame time (ms) behind
+ *    the last change
+ */
+double DynResStats(int* width,int* height,double* ms)
+{
+   *width = sw;
+   *height = sh;
+   *ms = 1000*median;
+   return scale;
+}
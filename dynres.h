@@ -0,0 +1,36 @@
+/*
+ *  Dynamic resolution
+ *
+ *  The scene is drawn into the lower left part of an offscreen framebuffer
+ *  the size of the window and stretched over the window, so text drawn
+ *  afterwards stays at the resolution of the window.  The part used is
+ *  chosen from the median of the last DYN_FRAMES frame times: pixels are
+ *  dropped as soon as frames are slower than the target, and added back
+ *  gradually (at most DYN_GROW a step) once they are well under it.
+ *  Since the framebuffer is not resized, changing the scale is free.
+ */
+#ifndef DYNRES_H
+#define DYNRES_H
+
+#define DYN_FRAMES 5      //  Frames measured before each change
+#define DYN_MIN    0.25   //  Smallest fraction of the window width
+#define DYN_GROW   1.1    //  Largest increase of the scale in one step
+#define DYN_TARGET 33.3   //  Default frame time target (ms)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int dynres;  //  Dynamic resolution enabled
+
+void   DynResTarget(double ms);
+void   DynResReshape(int width,int height);
+void   DynResBegin(void);
+void   DynResEnd(void);
+double DynResStats(int* width,int* height,double* ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
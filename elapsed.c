@@ -0,0 +1,33 @@
+/*
+ *  High resolution wall clock
+ *    Returns seconds since the first call
+ */
+#include "CSCIx229.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+double Elapsed(void)
+{
+#ifdef _WIN32
+   static LARGE_INTEGER t0,f;
+   LARGE_INTEGER t;
+   if (!f.QuadPart)
+   {
+      QueryPerformanceFrequency(&f);
+      QueryPerformanceCounter(&t0);
+   }
+   QueryPerformanceCounter(&t);
+   return (double)(t.QuadPart-t0.QuadPart)/f.QuadPart;
+#else
+   static double t0=-1;
+   struct timespec t;
+   double s;
+   clock_gettime(CLOCK_MONOTONIC,&t);
+   s = t.tv_sec + 1e-9*t.tv_nsec;
+   if (t0<0) t0 = s;
+   return s-t0;
+#endif
+}
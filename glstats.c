@@ -0,0 +1,183 @@
+/*
+ *  Per-frame OpenGL call statistics
+ *
+ *  Counters are updated by the wrappers in glstats.h.  StatsFrame writes
+ *  one JSON line per frame to the file given to StatsOpen and resets them.
+ */
+#include "CSCIx229.h"
+#include "glstats.h"
+
+static stats_t scope[STATS_MAX] = {{"display"}};  //  Scope 0 is the caller of the draw functions
+static int     Nscope = 1;                        //  Number of scopes in use
+static FILE*   out    = NULL;                     //  Output file (NULL when disabled)
+static long    frame  = 0;                        //  Frame counter
+
+stats_t* stats_cur  = scope;
+int      stats_mode = -1;
+long     stats_mark = 0;
+
+/*
+ *  Close statistics file at exit
+ */
+static void StatsClose(void)
+{
+   if (out && out!=stdout) fclose(out);
+   else if (out) fflush(out);
+   out = NULL;
+}
+
+/*
+ *  Start writing statistics to file ("-" is stdout)
+ */
+void StatsOpen(const char* file)
+{
+   if (!strcmp(file,"-"))
+      out = stdout;
+   else
+      out = fopen(file,"w");
+   if (!out) Fatal("Cannot open statistics file %s\n",file);
+   atexit(StatsClose);
+}
+
+/*
+ *  Make name the current scope
+ *    Returns the previous scope for StatsPop
+ */
+int StatsPush(const char* name)
+{
+   int k;
+   int prev = stats_cur-scope;
+   //  Search by pointer first since names are normally __func__
+   for (k=0;k<Nscope;k++)
+      if (scope[k].name==name || !strcmp(scope[k].name,name)) break;
+   //  New scope (fold into scope 0 when full)
+   if (k==Nscope)
+   {
+      if (Nscope<STATS_MAX)
+         scope[Nscope++].name = name;
+      else
+         k = 0;
+   }
+   stats_cur = scope+k;
+   return prev;
+}
+
+/*
+ *  Restore the scope returned by StatsPush
+ */
+void StatsPop(int k)
+{
+   stats_cur = scope+k;
+}
+
+/*
+ *  Count triangles in n vertices of primitive mode
+ */
+static long Triangles(int mode,long n)
+{
+   switch (mode)
+   {
+      case GL_TRIANGLES:
+         return n/3;
+      case GL_QUADS:
+         return 2*(n/4);
+      case GL_TRIANGLE_STRIP:
+      case GL_TRIANGLE_FAN:
+      case GL_QUAD_STRIP:
+      case GL_POLYGON:
+         return n>2 ? n-2 : 0;
+      default:
+         return 0;
+   }
+}
+
+/*
+ *  Count triangles at glEnd
+ */
+void StatsEnd(void)
+{
+   //  Ignore glEnd without matching glBegin
+   if (stats_mode<0) return;
+   stats_cur->triangle += Triangles(stats_mode,stats_cur->vertex-stats_mark);
+   stats_mode = -1;
+}
+
+/*
+ *  Count a vertex array draw of n vertices
+ */
+void StatsArrays(int mode,long n)
+{
+   stats_cur->draw++;
+   stats_cur->triangle += Triangles(mode,n);
+}
+
+/*
+ *  Count a multi-draw of n arrays with count vertices each
+ */
+void StatsMulti(int mode,const int* count,int n)
+{
+   int k;
+   stats_cur->draw++;
+   for (k=0;k<n;k++)
+      stats_cur->triangle += Triangles(mode,count[k]);
+}
+
+/*
+ *  Count a GLU/GLUT shape drawn as strips
+ */
+void StatsShape(long strips,long vertices,long triangles)
+{
+   stats_cur->begin    += strips;
+   stats_cur->draw     += strips;
+   stats_cur->vertex   += vertices;
+   stats_cur->triangle += triangles;
+}
+
+/*
+ *  Write counters as JSON
+ */
+static void Write(const char* name,const stats_t* s)
+{
+   fprintf(out,"\"%s\":{\"vertices\":%ld,\"begin_end\":%ld,\"draws\":%ld,\"matrix_ops\":%ld,\"texture_binds\":%ld,\"triangles\":%ld}",
+      name,s->vertex,s->begin,s->draw,s->matrix,s->texture,s->triangle);
+}
+
+/*
+ *  End of frame
+ *    Write statistics for this frame and reset counters
+ */
+void StatsFrame(void)
+{
+   int k;
+   frame++;
+   if (out)
+   {
+      //  Sum over scopes
+      stats_t total = {"total"};
+      for (k=0;k<Nscope;k++)
+      {
+         total.vertex   += scope[k].vertex;
+         total.begin    += scope[k].begin;
+         total.draw     += scope[k].draw;
+         total.matrix   += scope[k].matrix;
+         total.texture  += scope[k].texture;
+         total.triangle += scope[k].triangle;
+      }
+      fprintf(out,"{\"frame\":%ld,",frame);
+      Write("total",&total);
+      for (k=0;k<Nscope;k++)
+      {
+         fputc(',',out);
+         Write(scope[k].name,scope+k);
+      }
+      fputs("}\n",out);
+   }
+   //  Reset counters
+   for (k=0;k<Nscope;k++)
+   {
+      const char* name = scope[k].name;
+      memset(scope+k,0,sizeof(stats_t));
+      scope[k].name = name;
+   }
+   stats_cur = scope;
+}
@@ -0,0 +1,94 @@
+/*
+ *  Per-frame OpenGL call statistics
+ *
+ *  Including this header after CSCIx229.h routes the immediate-mode, matrix
+ *  stack, texture and draw calls of that file through counters.  Counts are
+ *  kept per scope (normally the draw_* function that issued them) and
+ *  written as one JSON line per frame once StatsOpen has been called.
+ *
+ *  Compile with -DNOSTATS to remove the wrappers entirely.
+ */
+#ifndef GLSTATS_H
+#define GLSTATS_H
+
+#define STATS_MAX 32  //  Maximum number of scopes
+
+//  Counters for one scope
+typedef struct
+{
+   const char* name; //  Scope name
+   long vertex;      //  Immediate-mode vertices (glVertex*)
+   long begin;       //  glBegin/glEnd pairs
+   long draw;        //  Draw calls (primitives, arrays, lists, GLU/GLUT shapes)
+   long matrix;      //  Matrix stack operations
+   long texture;     //  Texture binds
+   long triangle;    //  Triangles submitted
+} stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern stats_t* stats_cur;   //  Scope being counted
+extern int      stats_mode;  //  Primitive type inside glBegin (-1 outside)
+extern long     stats_mark;  //  Vertex count at glBegin
+
+void StatsOpen(const char* file);
+int  StatsPush(const char* name);
+void StatsPop(int scope);
+void StatsEnd(void);
+void StatsArrays(int mode,long n);
+void StatsMulti(int mode,const int* count,int n);
+void StatsShape(long strips,long vertices,long triangles);
+void StatsFrame(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef NOSTATS
+
+//  Scope covering the rest of a draw function
+#define STATS_BEGIN int stats_scope_ = StatsPush(__func__)
+#define STATS_END   StatsPop(stats_scope_)
+
+//  Immediate mode
+#define glBegin(m)         (stats_cur->begin++,stats_cur->draw++,stats_mode=(m),stats_mark=stats_cur->vertex,glBegin(m))
+#define glEnd()            (StatsEnd(),glEnd())
+#define glVertex2f(x,y)    (stats_cur->vertex++,glVertex2f(x,y))
+#define glVertex2i(x,y)    (stats_cur->vertex++,glVertex2i(x,y))
+#define glVertex3f(x,y,z)  (stats_cur->vertex++,glVertex3f(x,y,z))
+#define glVertex3d(x,y,z)  (stats_cur->vertex++,glVertex3d(x,y,z))
+#define glVertex3fv(v)     (stats_cur->vertex++,glVertex3fv(v))
+#define glVertex3dv(v)     (stats_cur->vertex++,glVertex3dv(v))
+//  Matrix stack
+#define glPushMatrix()        (stats_cur->matrix++,glPushMatrix())
+#define glPopMatrix()         (stats_cur->matrix++,glPopMatrix())
+#define glLoadIdentity()      (stats_cur->matrix++,glLoadIdentity())
+#define glTranslated(x,y,z)   (stats_cur->matrix++,glTranslated(x,y,z))
+#define glTranslatef(x,y,z)   (stats_cur->matrix++,glTranslatef(x,y,z))
+#define glRotated(a,x,y,z)    (stats_cur->matrix++,glRotated(a,x,y,z))
+#define glRotatef(a,x,y,z)    (stats_cur->matrix++,glRotatef(a,x,y,z))
+#define glScaled(x,y,z)       (stats_cur->matrix++,glScaled(x,y,z))
+#define glScalef(x,y,z)       (stats_cur->matrix++,glScalef(x,y,z))
+#define glLoadMatrixf(m)      (stats_cur->matrix++,glLoadMatrixf(m))
+#define glMultMatrixf(m)      (stats_cur->matrix++,glMultMatrixf(m))
+//  Textures
+#define glBindTexture(t,n)    (stats_cur->texture++,glBindTexture(t,n))
+//  Array and list draws
+#define glDrawArrays(m,f,n)         (StatsArrays(m,n),glDrawArrays(m,f,n))
+#define glDrawElements(m,n,t,i)     (StatsArrays(m,n),glDrawElements(m,n,t,i))
+#define glCallList(l)               (stats_cur->draw++,glCallList(l))
+#define glMultiDrawElements(m,c,t,i,n) (StatsMulti(m,c,n),glMultiDrawElements(m,c,t,i,n))
+//  GLU and GLUT shapes submit one strip per stack/ring
+#define gluCylinder(q,b,t,h,sl,st)  (StatsShape((st),2L*((sl)+1)*(st),2L*(sl)*(st)),gluCylinder(q,b,t,h,sl,st))
+#define glutSolidTorus(r,R,sd,rg)   (StatsShape((rg),2L*((sd)+1)*(rg),2L*(sd)*(rg)),glutSolidTorus(r,R,sd,rg))
+
+#else
+
+#define STATS_BEGIN
+#define STATS_END
+
+#endif
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ *  Impostor billboards
+ *
+ *  The atlas has one column per azimuth and one row per kind and elevation.
+ *  Each cell is an orthographic view of the object's bounding sphere, so a
+ *  quad of the sphere's diameter facing the eye covers the same area.
+ *  Cells are numbered by azimuth, then elevation, then kind.
+ */
+#include "CSCIx229.h"
+#include "impostor.h"
+#include "glstats.h"
+
+#define IMP_W (IMP_AZ*IMP_CELL)            //  Atlas width
+#define IMP_H (IMP_KINDS*IMP_EL*IMP_CELL)  //  Atlas height
+#define IMP_N (IMP_KINDS*IMP_EL*IMP_AZ)    //  Cells
+
+int impostors = 1;
+
+static unsigned int fbo=0,atlas=0,depth=0;  //  Atlas render target
+static unsigned int built;                  //  Key the atlas was rendered with
+static int          valid=0;                //  Atlas has been rendered
+static int          next=0;                 //  Next cell to render again
+static int          stale=0;                //  Cells not yet rendered with key built
+static object_t     proto[IMP_KINDS];       //  Instance of each kind at the origin
+static float        center[IMP_KINDS][3];   //  Centre of the bounds
+static float        radius[IMP_KINDS];      //  Radius of the bounds
+static int*         queue=NULL;             //  Instances to draw this frame
+static int          Nqueue=0,Ndrawn=0,Nbuilt=0;
+static float        eyep[3];                //  Eye position
+
+/*
+ *  Impostor kind of an object (-1 if it has none)
+ */
+int ImpostorKind(const object_t* o)
+{
+   switch (o->type)
+   {
+      case OBJ_SKYSCRAPER:
+         return 0;
+      case OBJ_LAMP:
+         return 1;
+      case OBJ_STREETLIGHT:
+         return o->th==5 ? 3 : 2;
+      default:
+         return -1;
+   }
+}
+
+/*
+ *  Create the render target and find the bounds of each kind
+ */
+static void Init(void)
+{
+   int k,i;
+   //  Prototypes are the first instance of each kind moved to the origin
+   for (k=Nscene-1;k>=0;k--)
+   {
+      int n = ImpostorKind(scene+k);
+      if (n<0) continue;
+      proto[n] = scene[k];
+      proto[n].x = proto[n].y = proto[n].z = 0;
+   }
+   for (k=0;k<IMP_KINDS;k++)
+   {
+      float min[3],max[3],r2=0;
+      ObjectBounds(proto+k,min,max);
+      for (i=0;i<3;i++)
+      {
+         center[k][i] = 0.5*(min[i]+max[i]);
+         r2 += 0.25*(max[i]-min[i])*(max[i]-min[i]);
+      }
+      radius[k] = sqrt(r2);
+   }
+   queue = (int*)malloc(Nscene*sizeof(int));
+   if (!queue) Fatal("Cannot allocate impostor queue\n");
+   //  Atlas with mipmaps so distant quads do not shimmer
+   glGenTextures(1,&atlas);
+   glBindTexture(GL_TEXTURE_2D,atlas);
+   glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,IMP_W,IMP_H,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,IMP_LEVELS);
+   glGenRenderbuffers(1,&depth);
+   glBindRenderbuffer(GL_RENDERBUFFER,depth);
+   glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT24,IMP_W,IMP_H);
+   glGenFramebuffers(1,&fbo);
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,atlas,0);
+   glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,depth);
+   if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+      Fatal("Cannot create impostor atlas\n");
+}
+
+/*
+ *  Render cell c of the atlas inside its gutter
+ */
+static void Cell(int c,void (*draw)(const object_t*),void (*light)(void))
+{
+   int    a = c%IMP_AZ;
+   int    e = c/IMP_AZ%IMP_EL;
+   int    k = c/(IMP_AZ*IMP_EL);
+   double az = a*360.0/IMP_AZ;
+   double el = e*90.0/IMP_EL;
+   double r = radius[k];
+   const float* p = center[k];
+   //  Clear the whole cell to transparent
+   glScissor(a*IMP_CELL,(k*IMP_EL+e)*IMP_CELL,IMP_CELL,IMP_CELL);
+   glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+   //  Orthographic view of the bounding sphere
+   glViewport(a*IMP_CELL+IMP_GUTTER,(k*IMP_EL+e)*IMP_CELL+IMP_GUTTER,IMP_CELL-2*IMP_GUTTER,IMP_CELL-2*IMP_GUTTER);
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   glOrtho(-r,+r,-r,+r,0.5*r,3.5*r);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+   gluLookAt(p[0]+2*r*Sin(az)*Cos(el),p[1]+2*r*Sin(el),p[2]+2*r*Cos(az)*Cos(el) , p[0],p[1],p[2] , 0,1,0);
+   light();
+   draw(proto+k);
+}
+
+/*
+ *  Render the atlas again if key (a summary of the lighting) has changed
+ *    The first time every cell is rendered, after that IMP_STEP cells a
+ *    frame.  Mipmaps are made again each time every cell has been rendered.
+ *    draw draws an object and light sets up the lights in world space
+ */
+void ImpostorUpdate(unsigned int key,void (*draw)(const object_t*),void (*light)(void))
+{
+   int k,n,prev;
+   if (!impostors) return;
+   if (!valid || key!=built) stale = IMP_N;
+   built = key;
+   if (!stale) return;
+   STATS_BEGIN;
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING,&prev);
+   if (!fbo) Init();
+   //  Save state
+   glPushAttrib(GL_ALL_ATTRIB_BITS);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   glEnable(GL_SCISSOR_TEST);
+   glClearColor(0,0,0,0);
+   glEnable(GL_DEPTH_TEST);
+   //  All cells the first time, then the next few
+   n = valid ? (stale<IMP_STEP ? stale : IMP_STEP) : IMP_N;
+   for (k=0;k<n;k++)
+   {
+      Cell(next,draw,light);
+      next = (next+1)%IMP_N;
+   }
+   stale -= n;
+   //  Restore state
+   glBindFramebuffer(GL_FRAMEBUFFER,prev);
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPopMatrix();
+   glPopAttrib();
+   //  Mipmaps once every cell has been rendered again
+   if (!valid || !stale || !next)
+   {
+      glBindTexture(GL_TEXTURE_2D,atlas);
+      glGenerateMipmap(GL_TEXTURE_2D);
+      glBindTexture(GL_TEXTURE_2D,0);
+      Nbuilt++;
+   }
+   valid = 1;
+   STATS_END;
+}
+
+/*
+ *  Queue obj to be drawn as an impostor seen from eye
+ *    Returns 0 if the object has no impostor
+ */
+int ImpostorDraw(int obj,const float eye[3])
+{
+   if (!impostors || !valid || ImpostorKind(scene+obj)<0) return 0;
+   memcpy(eyep,eye,sizeof(eyep));
+   queue[Nqueue++] = obj;
+   return 1;
+}
+
+/*
+ *  Draw the queued impostors in one batch
+ */
+void ImpostorFlush(void)
+{
+   int i;
+   Ndrawn = Nqueue;
+   if (!Nqueue) return;
+   STATS_BEGIN;
+   glPushAttrib(GL_ENABLE_BIT|GL_TEXTURE_BIT|GL_COLOR_BUFFER_BIT);
+   glDisable(GL_LIGHTING);
+   glEnable(GL_TEXTURE_2D);
+   glBindTexture(GL_TEXTURE_2D,atlas);
+   glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_REPLACE);
+   //  The atlas is cleared to transparent black, so its mipmaps are
+   //  premultiplied by coverage and thin parts fade instead of vanishing
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_ONE,GL_ONE_MINUS_SRC_ALPHA);
+   glEnable(GL_ALPHA_TEST);
+   glAlphaFunc(GL_GREATER,0.05);
+   glBegin(GL_QUADS);
+   for (i=0;i<Nqueue;i++)
+   {
+      const object_t* o = scene+queue[i];
+      int   k = ImpostorKind(o);
+      float r = radius[k];
+      float p[3] = {o->x+center[k][0],o->y+center[k][1],o->z+center[k][2]};
+      float d[3] = {eyep[0]-p[0],eyep[1]-p[1],eyep[2]-p[2]};
+      float R[3],U[3],len,u0,u1,v0,v1;
+      int   a,e;
+      //  Direction to the eye
+      len = sqrt(d[0]*d[0]+d[1]*d[1]+d[2]*d[2]);
+      if (len<=0) continue;
+      d[0] /= len;  d[1] /= len;  d[2] /= len;
+      //  Nearest cell
+      a = (int)floor(atan2(d[0],d[2])*IMP_AZ/(2*M_PI)+0.5);
+      a = (a%IMP_AZ+IMP_AZ)%IMP_AZ;
+      e = (int)floor(asin(d[1])*2*IMP_EL/M_PI+0.5);
+      if (e<0) e = 0;
+      if (e>IMP_EL-1) e = IMP_EL-1;
+      u0 = (float)(a*IMP_CELL+IMP_GUTTER)/IMP_W;
+      u1 = (float)((a+1)*IMP_CELL-IMP_GUTTER)/IMP_W;
+      v0 = (float)((k*IMP_EL+e)*IMP_CELL+IMP_GUTTER)/IMP_H;
+      v1 = (float)((k*IMP_EL+e+1)*IMP_CELL-IMP_GUTTER)/IMP_H;
+      //  Right = up x d and up = d x right, as gluLookAt used for the cell
+      len = sqrt(d[0]*d[0]+d[2]*d[2]);
+      if (len>1e-6)
+      {
+         R[0] = d[2]/len;  R[1] = 0;  R[2] = -d[0]/len;
+      }
+      else
+      {
+         R[0] = 1;  R[1] = 0;  R[2] = 0;
+      }
+      U[0] = d[1]*R[2]-d[2]*R[1];
+      U[1] = d[2]*R[0]-d[0]*R[2];
+      U[2] = d[0]*R[1]-d[1]*R[0];
+      glTexCoord2f(u0,v0); glVertex3f(p[0]-r*R[0]-r*U[0],p[1]-r*R[1]-r*U[1],p[2]-r*R[2]-r*U[2]);
+      glTexCoord2f(u1,v0); glVertex3f(p[0]+r*R[0]-r*U[0],p[1]+r*R[1]-r*U[1],p[2]+r*R[2]-r*U[2]);
+      glTexCoord2f(u1,v1); glVertex3f(p[0]+r*R[0]+r*U[0],p[1]+r*R[1]+r*U[1],p[2]+r*R[2]+r*U[2]);
+      glTexCoord2f(u0,v1); glVertex3f(p[0]-r*R[0]+r*U[0],p[1]-r*R[1]+r*U[1],p[2]-r*R[2]+r*U[2]);
+   }
+   glEnd();
+   glPopAttrib();
+   Nqueue = 0;
+   STATS_END;
+}
+
+/*
+ *  Impostors drawn by the last flush and times the atlas was rendered
+ */
+int ImpostorCount(int* rebuilt)
+{
+   *rebuilt = Nbuilt;
+   return Ndrawn;
+}
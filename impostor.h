@@ -0,0 +1,43 @@
+/*
+ *  Impostor billboards
+ *
+ *  Skyscrapers, lamps and street lights are rendered once from a ring of
+ *  view directions into a texture atlas.  Distant instances are drawn as
+ *  quads facing the eye, textured with the atlas cell closest to the
+ *  direction they are seen from, so their cost no longer depends on how
+ *  finely they are tessellated.  When the lighting changes the atlas is
+ *  rendered again IMP_STEP cells a frame, so a light that keeps moving costs
+ *  a few cells each frame rather than the whole atlas.  Each cell is drawn
+ *  inside a transparent gutter of 2^IMP_LEVELS texels and the mipmaps stop
+ *  at IMP_LEVELS, so no level blends neighbouring cells.
+ */
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include "scene.h"
+
+#define IMP_AZ     8    //  Azimuth directions
+#define IMP_EL     3    //  Elevations (0, 30 and 60 degrees)
+#define IMP_CELL   128  //  Cell size in pixels
+#define IMP_LEVELS 3    //  Mipmap levels kept apart
+#define IMP_GUTTER (1<<IMP_LEVELS)  //  Empty texels around each cell
+#define IMP_STEP   8    //  Cells rendered again each frame
+#define IMP_KINDS  4    //  Skyscraper, lamp, street light and stop light
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int impostors;  //  Impostors enabled
+
+int  ImpostorKind(const object_t* obj);
+void ImpostorUpdate(unsigned int key,void (*draw)(const object_t*),void (*light)(void));
+int  ImpostorDraw(int obj,const float eye[3]);
+void ImpostorFlush(void);
+int  ImpostorCount(int* rebuilt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
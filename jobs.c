@@ -0,0 +1,100 @@
+/*
+ *  Worker thread pool
+ */
+#include "CSCIx229.h"
+#include "jobs.h"
+#include <pthread.h>
+#include <unistd.h>
+
+static int             Nthread=1;           //  Threads including caller
+static pthread_t       thread[JOBS_MAX];    //  Workers
+static job_t           job=NULL;            //  Current job
+static void*           jobarg=NULL;         //  Current job argument
+static unsigned int    generation=0;        //  Incremented for each job
+static int             pending=0;           //  Workers still running
+static pthread_mutex_t lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  done  = PTHREAD_COND_INITIALIZER;
+
+/*
+ *  Worker loop
+ */
+static void* Worker(void* arg)
+{
+   int part = (int)(size_t)arg;
+   unsigned int seen = 0;
+   pthread_mutex_lock(&lock);
+   for (;;)
+   {
+      //  Wait for a new job
+      while (generation==seen)
+         pthread_cond_wait(&start,&lock);
+      seen = generation;
+      //  Run my part
+      pthread_mutex_unlock(&lock);
+      job(part,Nthread,jobarg);
+      pthread_mutex_lock(&lock);
+      if (--pending==0) pthread_cond_signal(&done);
+   }
+   return NULL;
+}
+
+/*
+ *  Number of online processors
+ */
+int JobsCores(void)
+{
+   long n = sysconf(_SC_NPROCESSORS_ONLN);
+   return n<1 ? 1 : n>JOBS_MAX ? JOBS_MAX : n;
+}
+
+/*
+ *  Start n-1 workers (n<1 uses one per processor)
+ */
+void JobsInit(int n)
+{
+   int k;
+   if (Nthread>1) Fatal("JobsInit called twice\n");
+   if (n<1) n = JobsCores();
+   if (n>JOBS_MAX) n = JOBS_MAX;
+   Nthread = n;
+   for (k=1;k<Nthread;k++)
+      if (pthread_create(thread+k,NULL,Worker,(void*)(size_t)k))
+         Fatal("Cannot start worker thread %d\n",k);
+}
+
+/*
+ *  Number of parts a job is split into
+ */
+int JobsCount(void)
+{
+   return Nthread;
+}
+
+/*
+ *  Run job on all threads and wait for completion
+ */
+void JobsRun(job_t f,void* arg)
+{
+   //  Single thread
+   if (Nthread==1)
+   {
+      f(0,1,arg);
+      return;
+   }
+   //  Release workers
+   pthread_mutex_lock(&lock);
+   job     = f;
+   jobarg  = arg;
+   pending = Nthread-1;
+   generation++;
+   pthread_cond_broadcast(&start);
+   pthread_mutex_unlock(&lock);
+   //  Do part 0 here
+   f(0,Nthread,arg);
+   //  Wait for the rest
+   pthread_mutex_lock(&lock);
+   while (pending)
+      pthread_cond_wait(&done,&lock);
+   pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,28 @@
+/*
+ *  Worker thread pool
+ *
+ *  JobsRun calls a function once for each part 0..JobsCount()-1, with part
+ *  0 on the calling thread and the rest on persistent workers, and returns
+ *  when all parts have finished.
+ */
+#ifndef JOBS_H
+#define JOBS_H
+
+#define JOBS_MAX 64  //  Maximum number of threads
+
+typedef void (*job_t)(int part,int parts,void* arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void JobsInit(int n);
+int  JobsCount(void);
+int  JobsCores(void);
+void JobsRun(job_t job,void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,32 +19,43 @@ static void Reverse(void* x,const int n)
 }
 
 /*
- *  Load texture from BMP file
+ *  Open BMP file and read its header
+ *    Returns NULL with a warning unless it is an uncompressed 24 bit image
  */
-unsigned int LoadTexBMP(const char* file)
+static FILE* OpenBMP(const char* file,unsigned int* off,unsigned int* width,unsigned int* height)
 {
-   unsigned int   texture;    // Texture name
    FILE*          f;          // File pointer
    unsigned short magic;      // Image magic
-   unsigned int   dx,dy,size; // Image dimensions
+   unsigned int   dx,dy;      // Image dimensions
    unsigned short nbp,bpp;    // Planes and bits per pixel
-   unsigned char* image;      // Image data
-   unsigned int   k;          // Counter
-   int            max;        // Maximum texture dimensions
+   unsigned int   k;          // Compression
 
    //  Open file
    f = fopen(file,"rb");
-   if (!f) Fatal("Cannot open file %s\n",file);
+   if (!f)
+   {
+      fprintf(stderr,"Cannot open file %s\n",file);
+      return NULL;
+   }
    //  Check image magic
-   if (fread(&magic,2,1,f)!=1) Fatal("Cannot read magic from %s\n",file);
-   if (magic!=0x4D42 && magic!=0x424D) Fatal("Image magic not BMP in %s\n",file);
+   if (fread(&magic,2,1,f)!=1 || (magic!=0x4D42 && magic!=0x424D))
+   {
+      fprintf(stderr,"Image magic not BMP in %s\n",file);
+      fclose(f);
+      return NULL;
+   }
    //  Seek to and read header
-   if (fseek(f,16,SEEK_CUR) || fread(&dx ,4,1,f)!=1 || fread(&dy ,4,1,f)!=1 ||
+   if (fseek(f,8,SEEK_CUR) || fread(off,4,1,f)!=1 || fseek(f,4,SEEK_CUR) || fread(&dx ,4,1,f)!=1 || fread(&dy ,4,1,f)!=1 ||
        fread(&nbp,2,1,f)!=1 || fread(&bpp,2,1,f)!=1 || fread(&k,4,1,f)!=1)
-     Fatal("Cannot read header from %s\n",file);
+   {
+      fprintf(stderr,"Cannot read header from %s\n",file);
+      fclose(f);
+      return NULL;
+   }
    //  Reverse bytes on big endian hardware (detected by backwards magic)
    if (magic==0x424D)
    {
+      Reverse(off,4);
       Reverse(&dx,4);
       Reverse(&dy,4);
       Reverse(&nbp,2);
@@ -52,39 +63,131 @@ unsigned int LoadTexBMP(const char* file)
       Reverse(&k,4);
    }
    //  Check image parameters
-   glGetIntegerv(GL_MAX_TEXTURE_SIZE,&max);
-   if (dx<1 || dx>max) Fatal("%s image width %d out of range 1-%d\n",file,dx,max);
-   if (dy<1 || dy>max) Fatal("%s image height %d out of range 1-%d\n",file,dy,max);
-   if (nbp!=1)  Fatal("%s bit planes is not 1: %d\n",file,nbp);
-   if (bpp!=24) Fatal("%s bits per pixel is not 24: %d\n",file,bpp);
-   if (k!=0)    Fatal("%s compressed files not supported\n",file);
-#ifndef GL_VERSION_2_0
-   //  OpenGL 2.0 lifts the restriction that texture size must be a power of two
-   for (k=1;k<dx;k*=2);
-   if (k!=dx) Fatal("%s image width not a power of two: %d\n",file,dx);
-   for (k=1;k<dy;k*=2);
-   if (k!=dy) Fatal("%s image height not a power of two: %d\n",file,dy);
-#endif
+   if (dx<1 || dy<1 || dx>65536 || dy>65536 || nbp!=1 || bpp!=24 || k!=0)
+   {
+      fprintf(stderr,"%s is not an uncompressed 24 bit image (%dx%d, %d planes, %d bits, compression %d)\n",file,dx,dy,nbp,bpp,k);
+      fclose(f);
+      return NULL;
+   }
+   *width  = dx;
+   *height = dy;
+   return f;
+}
+
+/*
+ *  Bytes in a row of a BMP image
+ *    Rows are padded to 4 bytes, which matches the default GL_UNPACK_ALIGNMENT
+ */
+static unsigned int RowBMP(unsigned int dx)
+{
+   return (3*dx+3)&~3;
+}
+
+/*
+ *  Check that file is a complete 24 bit BMP image without reading the pixels
+ *    Returns 0 with a warning if it is not
+ */
+int CheckBMP(const char* file)
+{
+   unsigned int off,dx,dy;
+   long size=-1;
+   FILE* f = OpenBMP(file,&off,&dx,&dy);
+   if (!f) return 0;
+   if (!fseek(f,0,SEEK_END)) size = ftell(f);
+   if (size<off+(long)RowBMP(dx)*dy)
+   {
+      fprintf(stderr,"%s is truncated (%dx%d image in %ld bytes)\n",file,dx,dy,size);
+      fclose(f);
+      return 0;
+   }
+   fclose(f);
+   return 1;
+}
+
+/*
+ *  Read 24 bit BMP file as BGR rows the way they are stored
+ *    Needs no OpenGL context, so it can be called from any thread
+ *    Returns NULL with a warning if the file cannot be read
+ */
+unsigned char* ReadBMPRaw(const char* file,int* width,int* height)
+{
+   FILE*          f;          // File pointer
+   unsigned int   off;        // Offset to image data
+   unsigned int   dx,dy,size; // Image dimensions
+   unsigned char* image;      // Image data
 
+   f = OpenBMP(file,&off,&dx,&dy);
+   if (!f) return NULL;
    //  Allocate image memory
-   size = 3*dx*dy;
+   size = RowBMP(dx)*dy;
    image = (unsigned char*) malloc(size);
    if (!image) Fatal("Cannot allocate %d bytes of memory for image %s\n",size,file);
    //  Seek to and read image
-   if (fseek(f,20,SEEK_CUR) || fread(image,size,1,f)!=1) Fatal("Error reading data from image %s\n",file);
+   if (fseek(f,off,SEEK_SET) || fread(image,size,1,f)!=1)
+   {
+      fprintf(stderr,"Error reading data from image %s\n",file);
+      free(image);
+      fclose(f);
+      return NULL;
+   }
    fclose(f);
-   //  Reverse colors (BGR -> RGB)
-   for (k=0;k<size;k+=3)
+   *width  = dx;
+   *height = dy;
+   return image;
+}
+
+/*
+ *  Reverse colors of BMP rows in place (BGR -> RGB)
+ */
+void DecodeBMP(unsigned char* image,int dx,int dy)
+{
+   int i,j;
+   for (j=0;j<dy;j++)
    {
-      unsigned char temp = image[k];
-      image[k]   = image[k+2];
-      image[k+2] = temp;
+      unsigned char* p = image+j*RowBMP(dx);
+      for (i=0;i<dx;i++,p+=3)
+      {
+         unsigned char temp = p[0];
+         p[0] = p[2];
+         p[2] = temp;
+      }
    }
+}
+
+/*
+ *  Read 24 bit BMP file as RGB rows
+ *    Needs no OpenGL context, so it can be called from any thread
+ *    Returns NULL with a warning if the file cannot be read
+ */
+unsigned char* ReadBMP(const char* file,int* width,int* height)
+{
+   unsigned char* image = ReadBMPRaw(file,width,height);
+   if (image) DecodeBMP(image,*width,*height);
+   return image;
+}
 
+/*
+ *  Copy image into texture
+ */
+void TexImageBMP(unsigned int texture,const char* file,const unsigned char* image,int dx,int dy)
+{
+   int max;
+   //  Check image parameters
+   glGetIntegerv(GL_MAX_TEXTURE_SIZE,&max);
+   if (dx<1 || dx>max) Fatal("%s image width %d out of range 1-%d\n",file,dx,max);
+   if (dy<1 || dy>max) Fatal("%s image height %d out of range 1-%d\n",file,dy,max);
+#ifndef GL_VERSION_2_0
+   //  OpenGL 2.0 lifts the restriction that texture size must be a power of two
+   {
+      int k;
+      for (k=1;k<dx;k*=2);
+      if (k!=dx) Fatal("%s image width not a power of two: %d\n",file,dx);
+      for (k=1;k<dy;k*=2);
+      if (k!=dy) Fatal("%s image height not a power of two: %d\n",file,dy);
+   }
+#endif
    //  Sanity check
    ErrCheck("LoadTexBMP");
-   //  Generate 2D texture
-   glGenTextures(1,&texture);
    glBindTexture(GL_TEXTURE_2D,texture);
    //  Copy image
    glTexImage2D(GL_TEXTURE_2D,0,3,dx,dy,0,GL_RGB,GL_UNSIGNED_BYTE,image);
@@ -92,6 +195,23 @@ unsigned int LoadTexBMP(const char* file)
    //  Scale linearly when image size doesn't match
    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+}
+
+/*
+ *  Load texture from BMP file
+ */
+unsigned int LoadTexBMP(const char* file)
+{
+   unsigned int   texture;    // Texture name
+   unsigned char* image;      // Image data
+   int            dx,dy;      // Image dimensions
+
+   //  Read image
+   image = ReadBMP(file,&dx,&dy);
+   if (!image) Fatal("Cannot load texture %s\n",file);
+   //  Generate 2D texture
+   glGenTextures(1,&texture);
+   TexImageBMP(texture,file,image,dx,dy);
 
    //  Free image memory
    free(image);
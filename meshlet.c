@@ -0,0 +1,166 @@
+/*
+ *  Meshlets: small clusters of a mesh culled on their own
+ */
+#include "CSCIx229.h"
+#include "vecmath.h"
+#include "meshlet.h"
+
+/*
+ *  Bounds and normal cone of the triangles in m
+ */
+static void Bounds(const mesh_t* mesh,meshlet_t* m)
+{
+   float min[3]={+1e30,+1e30,+1e30},max[3]={-1e30,-1e30,-1e30};
+   vec3_t axis = Vec3(0,0,0);
+   float r=0,mindp=1;
+   int i,k;
+   //  Sphere around the box of the vertices
+   for (i=m->first;i<m->first+m->count;i++)
+   {
+      const float* p = mesh->xyz+3*mesh->idx[i];
+      for (k=0;k<3;k++)
+      {
+         if (p[k]<min[k]) min[k] = p[k];
+         if (p[k]>max[k]) max[k] = p[k];
+      }
+   }
+   for (k=0;k<3;k++)
+      m->center[k] = 0.5*(min[k]+max[k]);
+   for (i=m->first;i<m->first+m->count;i++)
+   {
+      const float* p = mesh->xyz+3*mesh->idx[i];
+      float d = Vec3Length(Vec3(p[0]-m->center[0],p[1]-m->center[1],p[2]-m->center[2]));
+      if (d>r) r = d;
+   }
+   m->radius = r;
+   //  Cone around the mean of the face normals
+   for (i=m->first;i<m->first+m->count;i+=3)
+   {
+      const float* p0 = mesh->xyz+3*mesh->idx[i];
+      const float* p1 = mesh->xyz+3*mesh->idx[i+1];
+      const float* p2 = mesh->xyz+3*mesh->idx[i+2];
+      vec3_t n = Vec3Cross(Vec3(p1[0]-p0[0],p1[1]-p0[1],p1[2]-p0[2]),Vec3(p2[0]-p0[0],p2[1]-p0[1],p2[2]-p0[2]));
+      if (Vec3Length(n)>0) axis = Vec3Add(axis,Vec3Normalize(n));
+   }
+   if (Vec3Length(axis)>0)
+   {
+      axis = Vec3Normalize(axis);
+      for (i=m->first;i<m->first+m->count;i+=3)
+      {
+         const float* p0 = mesh->xyz+3*mesh->idx[i];
+         const float* p1 = mesh->xyz+3*mesh->idx[i+1];
+         const float* p2 = mesh->xyz+3*mesh->idx[i+2];
+         vec3_t n = Vec3Cross(Vec3(p1[0]-p0[0],p1[1]-p0[1],p1[2]-p0[2]),Vec3(p2[0]-p0[0],p2[1]-p0[1],p2[2]-p0[2]));
+         if (Vec3Length(n)>0)
+         {
+            float dp = Vec3Dot(Vec3Normalize(n),axis);
+            if (dp<mindp) mindp = dp;
+         }
+      }
+   }
+   else
+      mindp = 0;
+   m->axis[0] = axis.x;
+   m->axis[1] = axis.y;
+   m->axis[2] = axis.z;
+   //  Normals spread over a hemisphere or more can always face the eye
+   m->cutoff = mindp>0 ? sqrt(1-mindp*mindp) : 1;
+}
+
+/*
+ *  Cut the triangles of each material group into meshlets
+ *    Returns the meshlets (free when done) and their number in n
+ */
+meshlet_t* MeshletBuild(const mesh_t* mesh,int* n)
+{
+   int g,N=0,M=0;
+   meshlet_t* m=NULL;
+   for (g=0;g<mesh->ngroup;g++)
+   {
+      const mesh_group_t* grp = mesh->group+g;
+      int i=grp->first,end=grp->first+grp->count;
+      while (i<end)
+      {
+         unsigned int vert[MESHLET_VERTS];
+         int nvert=0;
+         if (N==M)
+         {
+            M = M ? 2*M : 256;
+            m = (meshlet_t*)realloc(m,M*sizeof(meshlet_t));
+            if (!m) Fatal("Cannot allocate %d meshlets\n",M);
+         }
+         m[N].first = i;
+         m[N].group = g;
+         //  Add triangles while they fit
+         while (i<end && i-m[N].first<3*MESHLET_TRIS)
+         {
+            int j,k,add=0;
+            unsigned int v[3];
+            for (j=0;j<3;j++)
+            {
+               v[j] = mesh->idx[i+j];
+               for (k=0;k<nvert && vert[k]!=v[j];k++);
+               if (k==nvert && (j<1 || v[j]!=v[0]) && (j<2 || v[j]!=v[1])) add++;
+            }
+            if (nvert+add>MESHLET_VERTS) break;
+            for (j=0;j<3;j++)
+            {
+               for (k=0;k<nvert && vert[k]!=v[j];k++);
+               if (k==nvert) vert[nvert++] = v[j];
+            }
+            i += 3;
+         }
+         m[N].count = i-m[N].first;
+         Bounds(mesh,m+N);
+         N++;
+      }
+   }
+   *n = N;
+   return m;
+}
+
+/*
+ *  Mark the meshlets that may be seen with the modelview and projection
+ *    Returns the number visible
+ */
+int MeshletCull(const meshlet_t* m,int n,const float mv[16],const float proj[16],char* visible)
+{
+   mat4_t MV,P,C;
+   float p[6][4],nrm[9],eye[3],len[6];
+   int i,k,count=0;
+   //  Frustum planes in model coordinates (from projection*modelview)
+   memcpy(MV.m,mv,sizeof(MV.m));
+   memcpy(P.m,proj,sizeof(P.m));
+   Mat4Mul(&C,&P,&MV);
+   for (k=0;k<3;k++)
+      for (i=0;i<4;i++)
+      {
+         p[2*k  ][i] = C.m[4*i+3]+C.m[4*i+k];
+         p[2*k+1][i] = C.m[4*i+3]-C.m[4*i+k];
+      }
+   for (k=0;k<6;k++)
+      len[k] = sqrt(p[k][0]*p[k][0]+p[k][1]*p[k][1]+p[k][2]*p[k][2]);
+   //  Eye in model coordinates is -inverse(A)*t for modelview [A|t]
+   //  (the normal matrix is the inverse transpose of A)
+   Mat4Normal(&MV,nrm);
+   for (i=0;i<3;i++)
+      eye[i] = -(nrm[3*i]*mv[12]+nrm[3*i+1]*mv[13]+nrm[3*i+2]*mv[14]);
+   for (i=0;i<n;i++)
+   {
+      const float* c = m[i].center;
+      float d[3],dist;
+      visible[i] = 0;
+      //  Sphere outside a plane
+      for (k=0;k<6;k++)
+         if (p[k][0]*c[0]+p[k][1]*c[1]+p[k][2]*c[2]+p[k][3] < -m[i].radius*len[k]) break;
+      if (k<6) continue;
+      //  All triangles facing away from the eye
+      for (k=0;k<3;k++)
+         d[k] = c[k]-eye[k];
+      dist = sqrt(d[0]*d[0]+d[1]*d[1]+d[2]*d[2]);
+      if (d[0]*m[i].axis[0]+d[1]*m[i].axis[1]+d[2]*m[i].axis[2] >= m[i].cutoff*dist+m[i].radius) continue;
+      visible[i] = 1;
+      count++;
+   }
+   return count;
+}
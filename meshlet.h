@@ -0,0 +1,39 @@
+/*
+ *  Meshlets: small clusters of a mesh culled on their own
+ *
+ *  The optimized triangle order of each material group is cut into runs of
+ *  at most MESHLET_TRIS triangles using at most MESHLET_VERTS vertices, so
+ *  a meshlet is a compact patch of surface.  Each keeps a bounding sphere
+ *  and a cone holding the normals of its triangles.  A meshlet is culled if
+ *  its sphere is outside the frustum or if every triangle faces away from
+ *  the eye.  The tests are done in model coordinates, which is only right
+ *  for rotations, translations and uniform scales.
+ */
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#define MESHLET_TRIS  124  //  Most triangles in a meshlet
+#define MESHLET_VERTS  64  //  Most vertices in a meshlet
+
+typedef struct
+{
+   int   first,count;  //  Indices
+   int   group;        //  Material group
+   float center[3];    //  Bounding sphere center
+   float radius;       //  Bounding sphere radius
+   float axis[3];      //  Cone axis (mean normal)
+   float cutoff;       //  Sine of the cone half angle (1 if it cannot be culled)
+} meshlet_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+meshlet_t* MeshletBuild(const mesh_t* mesh,int* n);
+int        MeshletCull(const meshlet_t* m,int n,const float mv[16],const float proj[16],char* visible);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,346 @@
+/*
+ *  Reorder a triangle mesh for the vertex cache, overdraw and vertex fetch
+ *
+ *  Each material group is reordered on its own so groups stay contiguous.
+ *    1.  Triangles are ordered for the post-transform vertex cache with
+ *        Forsyth's greedy algorithm (best scoring triangle next, scored by
+ *        the cache position and remaining valence of its vertices).
+ *    2.  That order is cut into clusters wherever a triangle misses the
+ *        cache on all three vertices, and the clusters are sorted so those
+ *        facing out from the middle of the mesh are drawn first.  Cutting
+ *        only where the cache is cold anyway keeps most of its benefit.
+ *    3.  Vertices are renumbered in the order the indices first use them
+ *        so vertex fetch walks memory forwards.  Unused vertices go.
+ *
+ *  MeshCacheStats measures the result on a FIFO cache: ACMR is vertices
+ *  transformed per triangle and ATVR is vertices transformed per vertex.
+ */
+#include "CSCIx229.h"
+
+#define CACHE 32     //  Cache size used for scoring
+#define FIFO  16     //  Cache size used to find the overdraw clusters
+
+//  Working arrays sized by the vertex count
+static int*   live=NULL;    //  Triangles left using each vertex
+static int*   first=NULL;   //  Start of each vertex's triangles in adj
+static int*   adj=NULL;     //  Triangles using each vertex
+static int*   pos=NULL;     //  Cache position (-1 if not cached)
+static float* score=NULL;   //  Vertex score
+static int    Mv=0,Mi=0;    //  Allocated vertices and indices
+
+/*
+ *  Allocate the working arrays
+ */
+static void Alloc(int nv,int ni)
+{
+   if (nv+1>Mv)
+   {
+      Mv = nv+1;
+      live  = (int*)realloc(live,Mv*sizeof(int));
+      first = (int*)realloc(first,Mv*sizeof(int));
+      pos   = (int*)realloc(pos,Mv*sizeof(int));
+      score = (float*)realloc(score,Mv*sizeof(float));
+      if (!live || !first || !pos || !score) Fatal("Cannot allocate mesh optimizer for %d vertices\n",nv);
+   }
+   if (ni>Mi)
+   {
+      Mi = ni;
+      adj = (int*)realloc(adj,Mi*sizeof(int));
+      if (!adj) Fatal("Cannot allocate mesh optimizer for %d indices\n",ni);
+   }
+}
+
+/*
+ *  Forsyth vertex score from cache position and triangles left
+ */
+static float Score(int p,int n)
+{
+   float s = 0;
+   if (n==0) return -1;
+   //  The last triangle's vertices score a little less so the next
+   //  triangle does not simply fan around one vertex
+   if (p>=0 && p<3)
+      s = 0.75;
+   else if (p>=3)
+      s = pow(1-(p-3)/(float)(CACHE-3),1.5);
+   //  Boost vertices with few triangles left so they are finished off
+   return s + 2/sqrt(n);
+}
+
+/*
+ *  Vertex cache order of ntri triangles in idx (in place)
+ */
+static void CacheOrder(unsigned int* idx,int ntri,int nv)
+{
+   int  cache[CACHE+3];
+   int  ncache=0;
+   int  i,j,k,t,best,next=0;
+   int* done;
+   float* tri;
+   unsigned int* out;
+   if (ntri<2) return;
+   Alloc(nv,3*ntri);
+   done = (int*)calloc(ntri,sizeof(int));
+   tri  = (float*)malloc(ntri*sizeof(float));
+   out  = (unsigned int*)malloc(3*ntri*sizeof(unsigned int));
+   if (!done || !tri || !out) Fatal("Cannot allocate mesh optimizer for %d triangles\n",ntri);
+   //  Triangles of each vertex
+   memset(live,0,(nv+1)*sizeof(int));
+   for (k=0;k<3*ntri;k++)
+      live[idx[k]]++;
+   first[0] = 0;
+   for (k=0;k<nv;k++)
+      first[k+1] = first[k]+live[k];
+   memset(live,0,nv*sizeof(int));
+   for (k=0;k<3*ntri;k++)
+      adj[first[idx[k]]+live[idx[k]]++] = k/3;
+   //  Initial scores
+   for (k=0;k<nv;k++)
+   {
+      pos[k] = -1;
+      score[k] = Score(-1,live[k]);
+   }
+   best = 0;
+   for (t=0;t<ntri;t++)
+   {
+      tri[t] = score[idx[3*t]]+score[idx[3*t+1]]+score[idx[3*t+2]];
+      if (tri[t]>tri[best]) best = t;
+   }
+   //  Emit the best triangle next
+   for (i=0;i<ntri;i++)
+   {
+      int n=0,newcache[CACHE+3];
+      float top=-1;
+      //  Dead end: take the next triangle in input order
+      if (best<0)
+      {
+         while (done[next]) next++;
+         best = next;
+      }
+      t = best;
+      done[t] = 1;
+      memcpy(out+3*i,idx+3*t,3*sizeof(unsigned int));
+      //  Remove the triangle from its vertices and put them at the front
+      for (j=0;j<3;j++)
+      {
+         int v = idx[3*t+j];
+         int* a = adj+first[v];
+         for (k=0;a[k]!=t;k++);
+         a[k] = a[--live[v]];
+         newcache[n++] = v;
+      }
+      for (k=0;k<ncache;k++)
+         if (cache[k]!=newcache[0] && cache[k]!=newcache[1] && cache[k]!=newcache[2])
+            newcache[n++] = cache[k];
+      //  Rescore the cached vertices (those pushed out lose their cache score)
+      for (k=0;k<n;k++)
+      {
+         int v = newcache[k];
+         pos[v] = k<CACHE ? k : -1;
+         score[v] = Score(pos[v],live[v]);
+      }
+      ncache = n<CACHE ? n : CACHE;
+      memcpy(cache,newcache,ncache*sizeof(int));
+      //  Rescore their triangles and pick the best
+      best = -1;
+      for (k=0;k<n;k++)
+      {
+         int v = newcache[k];
+         for (j=0;j<live[v];j++)
+         {
+            int u = adj[first[v]+j];
+            tri[u] = score[idx[3*u]]+score[idx[3*u+1]]+score[idx[3*u+2]];
+            if (tri[u]>top)
+            {
+               top = tri[u];
+               best = u;
+            }
+         }
+      }
+   }
+   memcpy(idx,out,3*ntri*sizeof(unsigned int));
+   free(out);
+   free(tri);
+   free(done);
+}
+
+//  Cluster of triangles for overdraw sorting
+typedef struct
+{
+   int   first,count;   //  Triangles
+   float key;           //  Sort key (larger drawn first)
+} cluster_t;
+
+/*
+ *  Clusters drawn outward facing first
+ */
+static int ClusterCmp(const void* a,const void* b)
+{
+   const cluster_t* A = (const cluster_t*)a;
+   const cluster_t* B = (const cluster_t*)b;
+   if (A->key!=B->key) return A->key>B->key ? -1 : +1;
+   return A->first-B->first;
+}
+
+/*
+ *  Overdraw order of ntri cache ordered triangles in idx (in place)
+ */
+static void OverdrawOrder(const mesh_t* mesh,unsigned int* idx,int ntri)
+{
+   int i,k,n=0;
+   int fifo[FIFO],head=0;
+   float mid[3];
+   cluster_t* cl;
+   unsigned int* out;
+   if (ntri<2) return;
+   cl = (cluster_t*)malloc(ntri*sizeof(cluster_t));
+   out = (unsigned int*)malloc(3*ntri*sizeof(unsigned int));
+   if (!cl || !out) Fatal("Cannot allocate mesh optimizer for %d triangles\n",ntri);
+   //  Cut where a triangle misses the cache on every vertex
+   for (k=0;k<FIFO;k++)
+      fifo[k] = -1;
+   for (i=0;i<ntri;i++)
+   {
+      int j,miss=0;
+      for (j=0;j<3;j++)
+      {
+         int v = idx[3*i+j];
+         for (k=0;k<FIFO && fifo[k]!=v;k++);
+         if (k==FIFO)
+         {
+            fifo[head] = v;
+            head = (head+1)%FIFO;
+            miss++;
+         }
+      }
+      if (i==0 || miss==3)
+      {
+         cl[n].first = i;
+         cl[n].count = 0;
+         n++;
+      }
+      cl[n-1].count++;
+   }
+   //  Key is how far the cluster faces out from the middle of the mesh
+   for (k=0;k<3;k++)
+      mid[k] = 0.5*(mesh->min[k]+mesh->max[k]);
+   for (k=0;k<n;k++)
+   {
+      float c[3]={0,0,0},nrm[3]={0,0,0},area=0,len;
+      for (i=cl[k].first;i<cl[k].first+cl[k].count;i++)
+      {
+         const float* p0 = mesh->xyz+3*idx[3*i];
+         const float* p1 = mesh->xyz+3*idx[3*i+1];
+         const float* p2 = mesh->xyz+3*idx[3*i+2];
+         float u[3],v[3],w[3],a;
+         int j;
+         for (j=0;j<3;j++)
+         {
+            u[j] = p1[j]-p0[j];
+            v[j] = p2[j]-p0[j];
+         }
+         w[0] = u[1]*v[2]-u[2]*v[1];
+         w[1] = u[2]*v[0]-u[0]*v[2];
+         w[2] = u[0]*v[1]-u[1]*v[0];
+         a = sqrt(w[0]*w[0]+w[1]*w[1]+w[2]*w[2]);
+         for (j=0;j<3;j++)
+         {
+            c[j]   += a*(p0[j]+p1[j]+p2[j])/3;
+            nrm[j] += w[j];
+         }
+         area += a;
+      }
+      len = sqrt(nrm[0]*nrm[0]+nrm[1]*nrm[1]+nrm[2]*nrm[2]);
+      if (area>0 && len>0)
+         cl[k].key = ((c[0]/area-mid[0])*nrm[0]+(c[1]/area-mid[1])*nrm[1]+(c[2]/area-mid[2])*nrm[2])/len;
+      else
+         cl[k].key = 0;
+   }
+   qsort(cl,n,sizeof(cluster_t),ClusterCmp);
+   for (i=k=0;k<n;k++)
+   {
+      memcpy(out+3*i,idx+3*cl[k].first,3*cl[k].count*sizeof(unsigned int));
+      i += cl[k].count;
+   }
+   memcpy(idx,out,3*ntri*sizeof(unsigned int));
+   free(out);
+   free(cl);
+}
+
+/*
+ *  Renumber vertices in order of first use and drop unused ones
+ */
+static void FetchOrder(mesh_t* mesh)
+{
+   int k,n=0;
+   int* remap = (int*)malloc(mesh->nv*sizeof(int));
+   float* xyz = (float*)malloc(3*mesh->nv*sizeof(float));
+   float* nrm = (float*)malloc(3*mesh->nv*sizeof(float));
+   float* st  = (float*)malloc(2*mesh->nv*sizeof(float));
+   if (!remap || !xyz || !nrm || !st) Fatal("Cannot allocate mesh optimizer for %d vertices\n",mesh->nv);
+   for (k=0;k<mesh->nv;k++)
+      remap[k] = -1;
+   for (k=0;k<mesh->ni;k++)
+   {
+      int v = mesh->idx[k];
+      if (remap[v]<0)
+      {
+         remap[v] = n;
+         memcpy(xyz+3*n,mesh->xyz+3*v,3*sizeof(float));
+         memcpy(nrm+3*n,mesh->nrm+3*v,3*sizeof(float));
+         memcpy(st +2*n,mesh->st +2*v,2*sizeof(float));
+         n++;
+      }
+      mesh->idx[k] = remap[v];
+   }
+   free(mesh->xyz);
+   free(mesh->nrm);
+   free(mesh->st);
+   mesh->xyz = xyz;
+   mesh->nrm = nrm;
+   mesh->st  = st;
+   mesh->nv  = n;
+   free(remap);
+}
+
+/*
+ *  Vertices transformed per triangle (ACMR) and per vertex (ATVR)
+ *    with a FIFO post-transform cache of the given size
+ */
+void MeshCacheStats(const mesh_t* mesh,int size,float* acmr,float* atvr)
+{
+   int k,i,head=0,miss=0;
+   int* fifo = (int*)malloc(size*sizeof(int));
+   if (!fifo) Fatal("Cannot allocate cache of %d\n",size);
+   for (k=0;k<size;k++)
+      fifo[k] = -1;
+   for (k=0;k<mesh->ni;k++)
+   {
+      int v = mesh->idx[k];
+      for (i=0;i<size && fifo[i]!=v;i++);
+      if (i==size)
+      {
+         fifo[head] = v;
+         head = (head+1)%size;
+         miss++;
+      }
+   }
+   free(fifo);
+   *acmr = mesh->ni ? 3.0*miss/mesh->ni : 0;
+   *atvr = mesh->nv ? (float)miss/mesh->nv : 0;
+}
+
+/*
+ *  Reorder the triangles and vertices of a mesh
+ */
+void MeshOptimize(mesh_t* mesh)
+{
+   int k;
+   for (k=0;k<mesh->ngroup;k++)
+   {
+      const mesh_group_t* g = mesh->group+k;
+      CacheOrder(mesh->idx+g->first,g->count/3,mesh->nv);
+      OverdrawOrder(mesh,mesh->idx+g->first,g->count/3);
+   }
+   FetchOrder(mesh);
+}
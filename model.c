@@ -0,0 +1,527 @@
+/*
+ *  Imported meshes in vertex buffers
+ */
+#include "CSCIx229.h"
+#include "glstats.h"
+#include "model.h"
+#include <stddef.h>
+
+//  Float vertex (32 bytes)
+typedef struct
+{
+   float xyz[3];            //  Position
+   float nrm[3];            //  Normal
+   float st[2];             //  Texture coordinates
+} vertex_t;
+
+//  Compact vertex (16 bytes)
+typedef struct
+{
+   short          xyz[4];   //  Position in the bounds (normalized, w unused)
+   short          oct[2];   //  Octahedral normal (normalized)
+   unsigned short st[2];    //  Texture coordinates (half float)
+} packed_t;
+
+//  Attribute locations of the decode shader
+#define ATTR_POS 0
+#define ATTR_OCT 1
+#define ATTR_TEX 2
+
+//  Decode the compact format and light it like the fixed-function pipeline
+//  with light 0 (no attenuation or spot), leaving texturing to the
+//  fixed-function fragment stage
+static const char* decode_vert =
+   "#version 120\n"
+   "attribute vec3 Pos;\n"
+   "attribute vec2 Oct;\n"
+   "attribute vec2 Tex;\n"
+   "uniform vec3 Center;\n"
+   "uniform vec3 Half;\n"
+   "uniform bool Lit;\n"
+   "uniform bool Local;\n"
+   "vec3 octahedral(vec2 e)\n"
+   "{\n"
+   "   vec3 n = vec3(e,1.0-abs(e.x)-abs(e.y));\n"
+   "   if (n.z<0.0) n.xy = (1.0-abs(n.yx))*vec2(e.x>=0.0?1.0:-1.0,e.y>=0.0?1.0:-1.0);\n"
+   "   return normalize(n);\n"
+   "}\n"
+   "void main()\n"
+   "{\n"
+   "   vec4 P = vec4(Center+Half*Pos,1.0);\n"
+   "   gl_TexCoord[0] = vec4(Tex,0.0,1.0);\n"
+   "   gl_Position = gl_ModelViewProjectionMatrix*P;\n"
+   "   if (Lit)\n"
+   "   {\n"
+   "      vec3 p = vec3(gl_ModelViewMatrix*P);\n"
+   "      vec3 N = normalize(gl_NormalMatrix*octahedral(Oct));\n"
+   "      vec4 Lp = gl_LightSource[0].position;\n"
+   "      vec3 L = normalize(Lp.w==0.0 ? Lp.xyz : Lp.xyz-p);\n"
+   "      vec3 H = normalize(L + (Local ? normalize(-p) : vec3(0.0,0.0,1.0)));\n"
+   "      float Id = max(dot(N,L),0.0);\n"
+   "      float Is = Id>0.0 ? pow(max(dot(N,H),0.0),gl_FrontMaterial.shininess) : 0.0;\n"
+   "      gl_FrontColor = gl_FrontLightModelProduct.sceneColor\n"
+   "                    + gl_FrontLightProduct[0].ambient\n"
+   "                    + Id*gl_FrontLightProduct[0].diffuse\n"
+   "                    + Is*gl_FrontLightProduct[0].specular;\n"
+   "      gl_FrontColor.a = gl_FrontMaterial.diffuse.a;\n"
+   "   }\n"
+   "   else\n"
+   "      gl_FrontColor = gl_Color;\n"
+   "}\n";
+
+static unsigned int decode=0;   //  Decode program
+static char*   visible=NULL;    //  Meshlet visibility
+static int*    count=NULL;      //  Index count of each run
+static void**  offset=NULL;     //  Index offset of each run
+static int     Mrun=0;          //  Allocated runs
+
+/*
+ *  Compile and link the decode shader (once)
+ */
+static void DecodeShader(void)
+{
+   char log[2048];
+   int status;
+   unsigned int vert;
+   if (decode) return;
+   vert = glCreateShader(GL_VERTEX_SHADER);
+   glShaderSource(vert,1,&decode_vert,NULL);
+   glCompileShader(vert);
+   glGetShaderiv(vert,GL_COMPILE_STATUS,&status);
+   if (!status)
+   {
+      glGetShaderInfoLog(vert,sizeof(log),NULL,log);
+      Fatal("Cannot compile vertex decode shader\n%s\n",log);
+   }
+   decode = glCreateProgram();
+   glAttachShader(decode,vert);
+   glBindAttribLocation(decode,ATTR_POS,"Pos");
+   glBindAttribLocation(decode,ATTR_OCT,"Oct");
+   glBindAttribLocation(decode,ATTR_TEX,"Tex");
+   glLinkProgram(decode);
+   glGetProgramiv(decode,GL_LINK_STATUS,&status);
+   if (!status)
+   {
+      glGetProgramInfoLog(decode,sizeof(log),NULL,log);
+      Fatal("Cannot link vertex decode shader\n%s\n",log);
+   }
+   glDeleteShader(vert);
+}
+
+/*
+ *  Float to normalized short, clamped to [-1,1]
+ */
+static short Snorm(float f)
+{
+   if (f>+1) f = +1;
+   if (f<-1) f = -1;
+   return (short)floor(32767*f+0.5);
+}
+
+/*
+ *  Float to half float (rounded, tiny values become zero)
+ */
+static unsigned short Half(float f)
+{
+   union {float f; unsigned int u;} v;
+   unsigned int s,m;
+   int e;
+   v.f = f;
+   s = (v.u>>16) & 0x8000;
+   e = (int)((v.u>>23) & 0xFF) - 127 + 15;
+   m = v.u & 0x7FFFFF;
+   if (e<=0) return s;
+   if (e>=31) return s|0x7C00;
+   //  Round to nearest, carrying into the exponent
+   m += 0x1000;
+   if (m & 0x800000)
+   {
+      m = 0;
+      if (++e>=31) return s|0x7C00;
+   }
+   return s | e<<10 | m>>13;
+}
+
+/*
+ *  Unit normal to octahedral coordinates
+ */
+static void Octahedral(const float n[3],short oct[2])
+{
+   float l = fabs(n[0])+fabs(n[1])+fabs(n[2]);
+   float x = l>0 ? n[0]/l : 0;
+   float y = l>0 ? n[1]/l : 0;
+   //  Fold the lower hemisphere over the diagonals
+   if (l>0 && n[2]<0)
+   {
+      float fx = (1-fabs(y))*(x>=0?1:-1);
+      float fy = (1-fabs(x))*(y>=0?1:-1);
+      x = fx;
+      y = fy;
+   }
+   oct[0] = Snorm(x);
+   oct[1] = Snorm(y);
+}
+
+/*
+ *  Upload a mesh as the next piece of a model
+ *    The model bounds must already hold the mesh
+ *    The vertex arrays of the mesh are freed
+ */
+static void Upload(model_t* model,mesh_t* mesh)
+{
+   int k;
+   void* vtx;
+   size_t size;
+   piece_t* piece;
+   model->piece = (piece_t*)realloc(model->piece,(model->npiece+1)*sizeof(piece_t));
+   if (!model->piece) Fatal("Cannot allocate %d model pieces\n",model->npiece+1);
+   piece = model->piece+model->npiece++;
+   memset(piece,0,sizeof(piece_t));
+   piece->mesh = mesh;
+   piece->nv   = mesh->nv;
+   piece->ni   = mesh->ni;
+   //  Vertices in the chosen format
+   if (model->format==MODEL_COMPACT)
+   {
+      packed_t* p = (packed_t*)malloc(mesh->nv*sizeof(packed_t));
+      if (!p) Fatal("Cannot allocate %d vertices\n",mesh->nv);
+      //  Quantize to the model bounds so vertices shared with other
+      //  pieces land in exactly the same place
+      for (k=0;k<3;k++)
+      {
+         piece->center[k] = 0.5*(model->max[k]+model->min[k]);
+         piece->half[k]   = 0.5*(model->max[k]-model->min[k]);
+         if (piece->half[k]<=0) piece->half[k] = 1;
+      }
+      for (k=0;k<mesh->nv;k++)
+      {
+         int i;
+         for (i=0;i<3;i++)
+            p[k].xyz[i] = Snorm((mesh->xyz[3*k+i]-piece->center[i])/piece->half[i]);
+         p[k].xyz[3] = 0;
+         Octahedral(mesh->nrm+3*k,p[k].oct);
+         p[k].st[0] = Half(mesh->st[2*k]);
+         p[k].st[1] = Half(mesh->st[2*k+1]);
+      }
+      vtx  = p;
+      size = mesh->nv*sizeof(packed_t);
+   }
+   else
+   {
+      vertex_t* v = (vertex_t*)malloc(mesh->nv*sizeof(vertex_t));
+      if (!v) Fatal("Cannot allocate %d vertices\n",mesh->nv);
+      for (k=0;k<mesh->nv;k++)
+      {
+         memcpy(v[k].xyz,mesh->xyz+3*k,sizeof(v[k].xyz));
+         memcpy(v[k].nrm,mesh->nrm+3*k,sizeof(v[k].nrm));
+         memcpy(v[k].st ,mesh->st +2*k,sizeof(v[k].st));
+      }
+      vtx  = v;
+      size = mesh->nv*sizeof(vertex_t);
+   }
+   glGenBuffers(1,&piece->vbo);
+   glBindBuffer(GL_ARRAY_BUFFER,piece->vbo);
+   glBufferData(GL_ARRAY_BUFFER,size,vtx,GL_STATIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   model->bytes += size;
+   free(vtx);
+   //  Indices, 16 bit when they fit
+   glGenBuffers(1,&piece->ibo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,piece->ibo);
+   if (mesh->nv<=65536)
+   {
+      unsigned short* i16 = (unsigned short*)malloc(mesh->ni*sizeof(unsigned short));
+      if (!i16) Fatal("Cannot allocate %d indices\n",mesh->ni);
+      for (k=0;k<mesh->ni;k++)
+         i16[k] = mesh->idx[k];
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER,mesh->ni*sizeof(unsigned short),i16,GL_STATIC_DRAW);
+      piece->index = GL_UNSIGNED_SHORT;
+      free(i16);
+   }
+   else
+   {
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER,mesh->ni*sizeof(unsigned int),mesh->idx,GL_STATIC_DRAW);
+      piece->index = GL_UNSIGNED_INT;
+   }
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+   //  Meshlets for culling
+   piece->meshlet = MeshletBuild(mesh,&piece->nmeshlet);
+   if (piece->nmeshlet>Mrun)
+   {
+      Mrun = piece->nmeshlet;
+      visible = (char*)realloc(visible,Mrun);
+      count   = (int*)realloc(count,Mrun*sizeof(int));
+      offset  = (void**)realloc(offset,Mrun*sizeof(void*));
+      if (!visible || !count || !offset) Fatal("Cannot allocate %d meshlets\n",Mrun);
+   }
+   //  The buffers hold the vertices now
+   free(mesh->xyz);
+   free(mesh->nrm);
+   free(mesh->st);
+   free(mesh->idx);
+   mesh->xyz = mesh->nrm = mesh->st = NULL;
+   mesh->idx = NULL;
+   model->nv += piece->nv;
+   model->ni += piece->ni;
+   model->nmeshlet += piece->nmeshlet;
+}
+
+/*
+ *  Empty model
+ */
+static model_t* Model(const char* file,int format)
+{
+   model_t* model = (model_t*)calloc(1,sizeof(model_t));
+   if (!model) Fatal("Cannot allocate model\n");
+   model->format = format;
+   model->file = (char*)malloc(strlen(file)+1);
+   if (!model->file) Fatal("Cannot allocate model\n");
+   strcpy(model->file,file);
+   if (format==MODEL_COMPACT) DecodeShader();
+   return model;
+}
+
+/*
+ *  Report memory of a loaded model
+ */
+static void Report(const model_t* model)
+{
+   printf("Model %s: %d vertices %d triangles %d pieces %d meshlets %s vertex data %ldKB (float would be %ldKB)\n",
+      model->file,model->nv,model->ni/3,model->npiece,model->nmeshlet,model->format==MODEL_COMPACT?"compact":"float",
+      (model->bytes+1023)/1024,(long)(model->nv*sizeof(vertex_t)+1023)/1024);
+}
+
+/*
+ *  Load an OBJ file into vertex buffers in the given format
+ */
+model_t* ModelLoad(const char* file,int format)
+{
+   model_t* model = Model(file,format);
+   mesh_t*  mesh  = LoadMesh(file);
+   memcpy(model->min,mesh->min,sizeof(model->min));
+   memcpy(model->max,mesh->max,sizeof(model->max));
+   if (mesh->ni)
+      Upload(model,mesh);
+   else
+      FreeMesh(mesh);
+   Report(model);
+   return model;
+}
+
+/*
+ *  Start streaming an OBJ file in pieces of about tris triangles
+ *    Call ModelStream once a frame until it returns 0 (or -1)
+ *    When fatal is zero errors in the file do not end the program
+ */
+model_t* ModelOpen(const char* file,int format,int tris,int fatal)
+{
+   model_t* model = Model(file,format);
+   model->stream = MeshStreamOpen(file,fatal);
+   MeshStreamBounds(model->stream,model->min,model->max);
+   model->tris   = tris>0 ? tris : 1;
+   model->t0     = Elapsed();
+   return model;
+}
+
+/*
+ *  Read, optimize and upload the next piece of a streaming model
+ *    Returns 1 while there is more to read, or -1 if the file has an error
+ *    (MeshStreamError of the stream, which is left open, says what)
+ */
+int ModelStream(model_t* model)
+{
+   long bytes;
+   mesh_t* mesh;
+   if (!model->stream) return 0;
+   mesh = MeshStreamNext(model->stream,model->tris);
+   //  Loader memory is the coordinates read so far and this piece
+   bytes = MeshStreamBytes(model->stream);
+   if (mesh)
+   {
+      bytes += mesh->nv*(8*sizeof(float)) + mesh->ni*sizeof(unsigned int);
+      MeshOptimize(mesh);
+      Upload(model,mesh);
+   }
+   if (bytes>model->peak) model->peak = bytes;
+   if (mesh) return 1;
+   if (MeshStreamError(model->stream)) return -1;
+   //  Done
+   MeshStreamClose(model->stream);
+   model->stream = NULL;
+   Report(model);
+   printf("Streamed %s in %.3fs with at most %ldKB of loader memory\n",model->file,Elapsed()-model->t0,(model->peak+1023)/1024);
+   return 0;
+}
+
+/*
+ *  Delete a model with its buffers and material textures
+ */
+void ModelFree(model_t* model)
+{
+   int j,k;
+   if (!model) return;
+   if (model->stream) MeshStreamClose(model->stream);
+   for (j=0;j<model->npiece;j++)
+   {
+      piece_t* piece = model->piece+j;
+      glDeleteBuffers(1,&piece->vbo);
+      glDeleteBuffers(1,&piece->ibo);
+      free(piece->meshlet);
+      //  Pieces share the textures and later pieces have every material
+      if (j==model->npiece-1)
+         for (k=0;k<piece->mesh->nmtl;k++)
+            if (piece->mesh->mtl[k].map) glDeleteTextures(1,(unsigned int*)&piece->mesh->mtl[k].map);
+      FreeMesh(piece->mesh);
+   }
+   free(model->piece);
+   free(model->file);
+   free(model);
+}
+
+/*
+ *  Positions of the triangles of a model read back from its buffers
+ *    Returns nine floats a triangle (free it) and sets the triangle count
+ */
+float* ModelTriangles(const model_t* model,int* ntri)
+{
+   float* tri = (float*)malloc((model->ni/3*9+1)*sizeof(float));
+   int j,k,i,n=0;
+   if (!tri) Fatal("Cannot allocate %d triangles\n",model->ni/3);
+   for (j=0;j<model->npiece;j++)
+   {
+      const piece_t* piece = model->piece+j;
+      int stride = model->format==MODEL_COMPACT ? sizeof(packed_t) : sizeof(vertex_t);
+      int isize = piece->index==GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+      unsigned char* vtx = (unsigned char*)malloc((long)piece->nv*stride);
+      unsigned char* idx = (unsigned char*)malloc((long)piece->ni*isize);
+      if (!vtx || !idx) Fatal("Cannot allocate %d vertices\n",piece->nv);
+      glBindBuffer(GL_ARRAY_BUFFER,piece->vbo);
+      glGetBufferSubData(GL_ARRAY_BUFFER,0,(long)piece->nv*stride,vtx);
+      glBindBuffer(GL_ARRAY_BUFFER,0);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,piece->ibo);
+      glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER,0,(long)piece->ni*isize,idx);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+      for (k=0;k<piece->ni;k++)
+      {
+         unsigned int v = piece->index==GL_UNSIGNED_SHORT ? ((unsigned short*)idx)[k] : ((unsigned int*)idx)[k];
+         //  Undo the quantization of the compact format
+         if (model->format==MODEL_COMPACT)
+         {
+            const packed_t* p = (const packed_t*)(vtx+(long)v*stride);
+            for (i=0;i<3;i++)
+               tri[n++] = p->xyz[i]/32767.0*piece->half[i]+piece->center[i];
+         }
+         else
+         {
+            const vertex_t* p = (const vertex_t*)(vtx+(long)v*stride);
+            for (i=0;i<3;i++)
+               tri[n++] = p->xyz[i];
+         }
+      }
+      free(vtx);
+      free(idx);
+   }
+   *ntri = n/9;
+   return tri;
+}
+
+/*
+ *  Draw a model with the current transformation
+ *    Materials from the MTL file replace glColor
+ *    With cull only meshlets that may be seen are drawn
+ *    Returns the number of triangles drawn
+ */
+int ModelDraw(const model_t* model,int cull)
+{
+   int j,k,i,tris=0;
+   float mv[16],proj[16];
+   if (!model->npiece) return 0;
+   glPushAttrib(GL_ENABLE_BIT|GL_LIGHTING_BIT|GL_TEXTURE_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glDisable(GL_COLOR_MATERIAL);
+   if (model->format==MODEL_COMPACT)
+   {
+      int local;
+      glGetIntegerv(GL_LIGHT_MODEL_LOCAL_VIEWER,&local);
+      glUseProgram(decode);
+      glUniform1i(glGetUniformLocation(decode,"Lit"),glIsEnabled(GL_LIGHTING));
+      glUniform1i(glGetUniformLocation(decode,"Local"),local);
+      glEnableVertexAttribArray(ATTR_POS);
+      glEnableVertexAttribArray(ATTR_OCT);
+      glEnableVertexAttribArray(ATTR_TEX);
+   }
+   else
+   {
+      glEnableClientState(GL_VERTEX_ARRAY);
+      glEnableClientState(GL_NORMAL_ARRAY);
+      glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   }
+   //  Meshlets are culled against the uploaded matrices
+   if (cull)
+   {
+      glGetFloatv(GL_MODELVIEW_MATRIX,mv);
+      glGetFloatv(GL_PROJECTION_MATRIX,proj);
+   }
+   for (j=0;j<model->npiece;j++)
+   {
+      const piece_t* piece = model->piece+j;
+      int size = piece->index==GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+      if (cull)
+         MeshletCull(piece->meshlet,piece->nmeshlet,mv,proj,visible);
+      else
+         memset(visible,1,piece->nmeshlet);
+      glBindBuffer(GL_ARRAY_BUFFER,piece->vbo);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,piece->ibo);
+      if (model->format==MODEL_COMPACT)
+      {
+         glUniform3fv(glGetUniformLocation(decode,"Center"),1,piece->center);
+         glUniform3fv(glGetUniformLocation(decode,"Half"),1,piece->half);
+         glVertexAttribPointer(ATTR_POS,3,GL_SHORT,GL_TRUE,sizeof(packed_t),(void*)offsetof(packed_t,xyz));
+         glVertexAttribPointer(ATTR_OCT,2,GL_SHORT,GL_TRUE,sizeof(packed_t),(void*)offsetof(packed_t,oct));
+         glVertexAttribPointer(ATTR_TEX,2,GL_HALF_FLOAT,GL_FALSE,sizeof(packed_t),(void*)offsetof(packed_t,st));
+      }
+      else
+      {
+         glVertexPointer(3,GL_FLOAT,sizeof(vertex_t),(void*)offsetof(vertex_t,xyz));
+         glNormalPointer(GL_FLOAT,sizeof(vertex_t),(void*)offsetof(vertex_t,nrm));
+         glTexCoordPointer(2,GL_FLOAT,sizeof(vertex_t),(void*)offsetof(vertex_t,st));
+      }
+      //  One draw per material of the runs of visible meshlets
+      for (i=k=0;k<piece->mesh->ngroup;k++)
+      {
+         const mesh_group_t* g = piece->mesh->group+k;
+         int n=0;
+         for (;i<piece->nmeshlet && piece->meshlet[i].group==k;i++)
+         {
+            const meshlet_t* m = piece->meshlet+i;
+            if (!visible[i]) continue;
+            //  Extend the run if the last meshlet was visible too
+            if (n && i>0 && visible[i-1] && piece->meshlet[i-1].group==k)
+               count[n-1] += m->count;
+            else
+            {
+               count[n]  = m->count;
+               offset[n] = (void*)((size_t)m->first*size);
+               n++;
+            }
+            tris += m->count/3;
+         }
+         if (!n) continue;
+         if (g->mtl>=0) MeshMaterial(piece->mesh,g->mtl);
+         glMultiDrawElements(GL_TRIANGLES,count,piece->index,(const void* const*)offset,n);
+      }
+   }
+   //  Restore state
+   if (model->format==MODEL_COMPACT)
+   {
+      glDisableVertexAttribArray(ATTR_POS);
+      glDisableVertexAttribArray(ATTR_OCT);
+      glDisableVertexAttribArray(ATTR_TEX);
+      glUseProgram(0);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+   glPopClientAttrib();
+   glPopAttrib();
+   return tris;
+}
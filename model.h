@@ -0,0 +1,83 @@
+/*
+ *  Imported meshes in vertex buffers
+ *
+ *  A mesh from LoadMesh is uploaded in one of two vertex formats chosen at
+ *  load time.  The float format is 32 bytes per vertex drawn through the
+ *  fixed-function pipeline.  The compact format is 16 bytes per vertex:
+ *  16 bit positions relative to the mesh bounds, octahedral normals in two
+ *  16 bit values and half float texture coordinates.  A small vertex shader
+ *  decodes it and lights it like light 0 of the fixed-function pipeline, so
+ *  both formats look the same.
+ *
+ *  The mesh is also cut into meshlets (meshlet.h).  When culling is asked
+ *  for, only the index ranges of meshlets in the frustum and facing the eye
+ *  are drawn, with one multi-draw per material.
+ *
+ *  ModelOpen starts streaming a model instead.  Each ModelStream call reads
+ *  the next piece of about the given number of triangles, optimizes it and
+ *  uploads it to buffers of its own, so the model appears a piece at a time
+ *  and the loader only holds one piece besides the coordinates the faces
+ *  refer to.  The bounds of the whole file are read when it is opened, so
+ *  every piece is quantized to the same bounds and the model does not move
+ *  as it grows.  A model opened with fatal=0 reports errors in the file
+ *  instead of ending the program, for reloading a file being edited.
+ *
+ *  Since only the buffers keep the vertices, ModelTriangles reads them back
+ *  for work on the CPU such as ray queries.
+ */
+#ifndef MODEL_H
+#define MODEL_H
+
+#include "meshlet.h"
+
+//  Vertex formats
+#define MODEL_FLOAT   0
+#define MODEL_COMPACT 1
+
+//  Piece of a model with its own buffers
+typedef struct
+{
+   mesh_t*      mesh;     //  Groups, materials and bounds (vertex arrays freed)
+   unsigned int vbo,ibo;  //  Vertex and index buffers
+   int          nv,ni;    //  Vertices and indices
+   int          index;    //  Index type (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT)
+   float        center[3];//  Position offset (compact)
+   float        half[3];  //  Position scale (compact)
+   int          nmeshlet; //  Meshlets
+   meshlet_t*   meshlet;
+} piece_t;
+
+//  Uploaded mesh
+typedef struct
+{
+   int            format;   //  MODEL_FLOAT or MODEL_COMPACT
+   int            npiece;   //  Pieces uploaded
+   piece_t*       piece;
+   int            nv,ni;    //  Vertices and indices of all pieces
+   int            nmeshlet; //  Meshlets of all pieces
+   long           bytes;    //  Vertex buffer size of all pieces
+   float          min[3];   //  Bounds (of the whole file, even while streaming)
+   float          max[3];
+   mesh_stream_t* stream;   //  File still being read (NULL when loaded)
+   int            tris;     //  Triangles per piece while streaming
+   long           peak;     //  Most loader memory while streaming
+   double         t0;       //  Time streaming started
+   char*          file;     //  File name
+} model_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+model_t* ModelLoad(const char* file,int format);
+model_t* ModelOpen(const char* file,int format,int tris,int fatal);
+int      ModelStream(model_t* model);
+void     ModelFree(model_t* model);
+float*   ModelTriangles(const model_t* model,int* ntri);
+int      ModelDraw(const model_t* model,int cull);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
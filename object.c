@@ -1,5 +1,6 @@
 #include "CSCIx229.h"
 #include <ctype.h>
+#include <limits.h>
 
 //  Load an OBJ file
 //  Vertex, Normal and Texture coordinates are supported
@@ -17,18 +18,22 @@
 //  files may have correct surfaces, but the normals are complete junk and so
 //  the lighting is totally broken.  So beware of which OBJ files you use.
 
-//  Material structure
-typedef struct
+//  OBJ file being read in pieces
+struct mesh_stream
 {
-   char* name;                 //  Material name
-   float Ka[4],Kd[4],Ks[4],Ns; //  Colors and shininess
-   float d;                    //  Transparency
-   int map;                    //  Texture
-} mtl_t;
-
-//  Material count and array
-static int Nmtl=0;
-static mtl_t* mtl=NULL;
+   FILE*  f;              //  File
+   long   size;           //  File size
+   float  *V,*N,*T;       //  Vertex, normal and texture coordinates
+   int    Nv,Nn,Nt;       //  Number of each
+   int    Mv,Mn,Mt;       //  Allocated
+   float  min[3],max[3];  //  Bounds of all the vertexes
+   int    nmtl;           //  Materials
+   mtl_t* mtl;
+   int    cur;            //  Current material (-1 for none)
+   int    given;          //  Materials handed to meshes (they own the textures)
+   int    fatal;          //  Errors end the program
+   char   error[256];     //  First error (when not fatal)
+};
 
 //
 //  Return true if CR or LF
@@ -103,18 +108,38 @@ static char* getword(char** line)
    return word;
 }
 
+//
+//  Report an error reading a stream
+//    Ends the program unless the stream was opened with fatal=0, in which
+//    case the first error is kept for MeshStreamError
+//    Returns 0
+//
+static int Error(mesh_stream_t* s,const char* format,...)
+{
+   char msg[256];
+   va_list args;
+   va_start(args,format);
+   vsnprintf(msg,sizeof(msg),format,args);
+   va_end(args);
+   if (s->fatal) Fatal("%s",msg);
+   if (!s->error[0]) strcpy(s->error,msg);
+   return 0;
+}
+
 //
 //  Read n floats
+//    Returns 0 on error
 //
-static void readfloat(char* line,int n,float x[])
+static int readfloat(mesh_stream_t* s,char* line,int n,float x[])
 {
    int i;
    for (i=0;i<n;i++)
    {
       char* str = getword(&line);
-      if (!str)  Fatal("Premature EOL reading %d floats\n",n);
-      if (sscanf(str,"%f",x+i)!=1) Fatal("Error reading float %d\n",i);
+      if (!str) return Error(s,"Premature EOL reading %d floats\n",n);
+      if (sscanf(str,"%f",x+i)!=1) return Error(s,"Error reading float %d\n",i);
    }
+   return 1;
 }
 
 //
@@ -123,20 +148,22 @@ static void readfloat(char* line,int n,float x[])
 //    N is the coordinate index
 //    M is the number of coordinates
 //    x is the array
-//    This function adds more memory as needed in 8192 work chunks
+//    This function doubles the memory as needed starting at 8192 words
+//    Returns 0 on error
 //
-static void readcoord(char* line,int n,float* x[],int* N,int* M)
+static int readcoord(mesh_stream_t* s,char* line,int n,float* x[],int* N,int* M)
 {
    //  Allocate memory if necessary
    if (*N+n > *M)
    {
-      *M += 8192;
+      *M = *M ? 2*(*M) : 8192;
       *x = (float*)realloc(*x,(*M)*sizeof(float));
       if (!*x) Fatal("Cannot allocate memory\n");
    }
    //  Read n coordinates
-   readfloat(line,n,(*x)+*N);
+   if (!readfloat(s,line,n,(*x)+*N)) return 0;
    (*N)+=n;
+   return 1;
 }
 
 //
@@ -161,200 +188,583 @@ static char* readstr(char* line,const char* skip)
 
 //
 //  Load materials from file
+//    Returns 0 on error
 //
-static void LoadMaterial(const char* file)
+static int LoadMaterial(mesh_stream_t* s,const char* file)
 {
-   int k=-1;
+   int k=-1,ok=1;
    char* line;
    char* str;
 
-   //  Open file or return with warning on error
+   //  Open file or return with warning on error (an error when not fatal)
    FILE* f = fopen(file,"r");
-   if (!f)
+   if (!f && !s->fatal)
+      return Error(s,"Cannot open material file %s\n",file);
+   else if (!f)
    {
       fprintf(stderr,"Cannot open material file %s\n",file);
-      return;
+      return 1;
    }
 
    //  Read lines
-   while ((line = readline(f)))
+   while (ok && (line = readline(f)))
    {
       //  New material
       if ((str = readstr(line,"newmtl")))
       {
          int l = strlen(str);
          //  Allocate memory for structure
-         k = Nmtl++;
-         mtl = (mtl_t*)realloc(mtl,Nmtl*sizeof(mtl_t));
+         k = s->nmtl++;
+         s->mtl = (mtl_t*)realloc(s->mtl,s->nmtl*sizeof(mtl_t));
+         if (!s->mtl) Fatal("Cannot allocate %d materials\n",s->nmtl);
          //  Store name
-         mtl[k].name = (char*)malloc(l+1);
-         if (!mtl[k].name) Fatal("Cannot allocate %d for name\n",l+1);
-         strcpy(mtl[k].name,str);
+         s->mtl[k].name = (char*)malloc(l+1);
+         if (!s->mtl[k].name) Fatal("Cannot allocate %d for name\n",l+1);
+         strcpy(s->mtl[k].name,str);
          //  Initialize materials
-         mtl[k].Ka[0] = mtl[k].Ka[1] = mtl[k].Ka[2] = 0;   mtl[k].Ka[3] = 1;
-         mtl[k].Kd[0] = mtl[k].Kd[1] = mtl[k].Kd[2] = 0;   mtl[k].Kd[3] = 1;
-         mtl[k].Ks[0] = mtl[k].Ks[1] = mtl[k].Ks[2] = 0;   mtl[k].Ks[3] = 1;
-         mtl[k].Ns  = 0;
-         mtl[k].d   = 0;
-         mtl[k].map = 0;
+         s->mtl[k].Ka[0] = s->mtl[k].Ka[1] = s->mtl[k].Ka[2] = 0;   s->mtl[k].Ka[3] = 1;
+         s->mtl[k].Kd[0] = s->mtl[k].Kd[1] = s->mtl[k].Kd[2] = 0;   s->mtl[k].Kd[3] = 1;
+         s->mtl[k].Ks[0] = s->mtl[k].Ks[1] = s->mtl[k].Ks[2] = 0;   s->mtl[k].Ks[3] = 1;
+         s->mtl[k].Ns  = 0;
+         s->mtl[k].d   = 0;
+         s->mtl[k].map = 0;
       }
       //  If no material short circuit here
       else if (k<0)
       {}
       //  Ambient color
       else if (line[0]=='K' && line[1]=='a')
-         readfloat(line+2,3,mtl[k].Ka);
+         ok = readfloat(s,line+2,3,s->mtl[k].Ka);
       //  Diffuse color
       else if (line[0]=='K' && line[1] == 'd')
-         readfloat(line+2,3,mtl[k].Kd);
+         ok = readfloat(s,line+2,3,s->mtl[k].Kd);
       //  Specular color
       else if (line[0]=='K' && line[1] == 's')
-         readfloat(line+2,3,mtl[k].Ks);
+         ok = readfloat(s,line+2,3,s->mtl[k].Ks);
       //  Material Shininess
       else if (line[0]=='N' && line[1]=='s')
-         readfloat(line+2,1,&mtl[k].Ns);
+         ok = readfloat(s,line+2,1,&s->mtl[k].Ns);
       //  Textures (must be BMP - will fail if not)
       else if ((str = readstr(line,"map_Kd")))
-         mtl[k].map = LoadTexBMP(str);
+      {
+         if (s->fatal || CheckBMP(str))
+            s->mtl[k].map = LoadTexBMP(str);
+         else
+            ok = Error(s,"Cannot load texture %s\n",str);
+      }
       //  Ignore line if we get here
    }
    fclose(f);
+   return ok;
+}
+
+//
+//  Check that index K is in the range 1-N (0 means none)
+//    Returns 0 on error
+//
+static int Index(mesh_stream_t* s,const char* what,int K,int N)
+{
+   if (K<0 || K>N) return Error(s,"%s %d out of range 1-%d\n",what,K,N);
+   return 1;
+}
+
+//
+//  Find material by name
+//    Returns -1 with a warning if there is no match
+//
+static int FindMaterial(const mesh_stream_t* s,const char* name)
+{
+   int k;
+   for (k=0;k<s->nmtl;k++)
+      if (!strcmp(s->mtl[k].name,name)) return k;
+   fprintf(stderr,"Unknown material %s\n",name);
+   return -1;
+}
+
+//
+//  Set material k of a mesh
+//
+void MeshMaterial(const mesh_t* mesh,int k)
+{
+   const mtl_t* m = mesh->mtl+k;
+   //  Set material colors
+   glMaterialfv(GL_FRONT_AND_BACK,GL_AMBIENT  ,m->Ka);
+   glMaterialfv(GL_FRONT_AND_BACK,GL_DIFFUSE  ,m->Kd);
+   glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR ,m->Ks);
+   glMaterialfv(GL_FRONT_AND_BACK,GL_SHININESS,&m->Ns);
+   //  Bind texture if specified
+   if (m->map)
+   {
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture(GL_TEXTURE_2D,m->map);
+   }
+   else
+      glDisable(GL_TEXTURE_2D);
 }
 
 //
-//  Set material
+//  Vertex table
+//    Each distinct Vertex/Texture/Normal triplet becomes one vertex.  An
+//    open addressing hash on the triplet finds vertices already made.
+//
+static int  Nhash=0;     //  Hash table size (power of two)
+static int* hash=NULL;   //  Vertex+1 or 0 if empty
+static int* key=NULL;    //  Triplet of each vertex
+
+//
+//  Hash slot of a triplet
 //
-static void SetMaterial(const char* name)
+static unsigned int slot(const int t[3])
 {
+   unsigned int h = t[0]*73856093u ^ t[1]*19349663u ^ t[2]*83492791u;
+   return h & (Nhash-1);
+}
+
+//
+//  Vertex index of triplet t in mesh, adding it if new
+//
+static int vertex(mesh_t* mesh,const int t[3],const float* V,const float* T,const float* N,int* Mv)
+{
+   unsigned int h;
    int k;
-   //  Search materials for a matching name
-   for (k=0;k<Nmtl;k++)
-      if (!strcmp(mtl[k].name,name))
+   //  Grow and rehash at half full
+   if (2*mesh->nv>=Nhash)
+   {
+      Nhash = Nhash ? 2*Nhash : 8192;
+      hash = (int*)realloc(hash,Nhash*sizeof(int));
+      if (!hash) Fatal("Cannot allocate vertex hash\n");
+      memset(hash,0,Nhash*sizeof(int));
+      for (k=0;k<mesh->nv;k++)
       {
-         //  Set material colors
-         glMaterialfv(GL_FRONT_AND_BACK,GL_AMBIENT  ,mtl[k].Ka);
-         glMaterialfv(GL_FRONT_AND_BACK,GL_DIFFUSE  ,mtl[k].Kd);
-         glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR ,mtl[k].Ks);
-         glMaterialfv(GL_FRONT_AND_BACK,GL_SHININESS,&mtl[k].Ns);
-         //  Bind texture if specified
-         if (mtl[k].map)
+         for (h=slot(key+3*k);hash[h];h=(h+1)&(Nhash-1));
+         hash[h] = k+1;
+      }
+   }
+   //  Look up
+   for (h=slot(t);hash[h];h=(h+1)&(Nhash-1))
+   {
+      const int* u = key+3*(hash[h]-1);
+      if (u[0]==t[0] && u[1]==t[1] && u[2]==t[2]) return hash[h]-1;
+   }
+   //  New vertex
+   k = mesh->nv++;
+   if (mesh->nv>*Mv)
+   {
+      *Mv = *Mv ? 2*(*Mv) : 8192;
+      key       = (int*)realloc(key,3*(*Mv)*sizeof(int));
+      mesh->xyz = (float*)realloc(mesh->xyz,3*(*Mv)*sizeof(float));
+      mesh->nrm = (float*)realloc(mesh->nrm,3*(*Mv)*sizeof(float));
+      mesh->st  = (float*)realloc(mesh->st ,2*(*Mv)*sizeof(float));
+      if (!key || !mesh->xyz || !mesh->nrm || !mesh->st) Fatal("Cannot allocate %d vertices\n",*Mv);
+   }
+   memcpy(key+3*k,t,3*sizeof(int));
+   hash[h] = k+1;
+   memcpy(mesh->xyz+3*k,V+3*(t[0]-1),3*sizeof(float));
+   if (t[1])
+      memcpy(mesh->st+2*k,T+2*(t[1]-1),2*sizeof(float));
+   else
+      mesh->st[2*k] = mesh->st[2*k+1] = 0;
+   if (t[2])
+      memcpy(mesh->nrm+3*k,N+3*(t[2]-1),3*sizeof(float));
+   else
+      mesh->nrm[3*k] = mesh->nrm[3*k+1] = mesh->nrm[3*k+2] = 0;
+   return k;
+}
+
+//
+//  Start a new material group
+//
+static void group(mesh_t* mesh,int m)
+{
+   mesh_group_t* g;
+   //  Carry on with the last group if the material is the same
+   if (mesh->ngroup && mesh->group[mesh->ngroup-1].mtl==m)
+      return;
+   //  Reuse the last group if it is empty
+   if (mesh->ngroup && mesh->group[mesh->ngroup-1].count==0)
+      g = mesh->group+mesh->ngroup-1;
+   else
+   {
+      mesh->group = (mesh_group_t*)realloc(mesh->group,(mesh->ngroup+1)*sizeof(mesh_group_t));
+      if (!mesh->group) Fatal("Cannot allocate material groups\n");
+      g = mesh->group+mesh->ngroup++;
+      g->first = mesh->ni;
+      g->count = 0;
+   }
+   g->mtl = m;
+}
+
+//
+//  Open OBJ file to read in pieces
+//    When fatal is zero errors do not end the program: MeshStreamNext
+//    returns NULL and MeshStreamError says what went wrong
+//
+mesh_stream_t* MeshStreamOpen(const char* file,int fatal)
+{
+   int k;
+   char* line;
+   mesh_stream_t* s = (mesh_stream_t*)calloc(1,sizeof(mesh_stream_t));
+   if (!s) Fatal("Cannot allocate stream for %s\n",file);
+   s->fatal = fatal;
+   s->cur = -1;
+   //  Open file
+   s->f = fopen(file,"r");
+   if (!s->f)
+   {
+      Error(s,"Cannot open file %s\n",file);
+      return s;
+   }
+   //  Size for progress
+   fseek(s->f,0,SEEK_END);
+   s->size = ftell(s->f);
+   rewind(s->f);
+   //  Bounds of all the vertexes up front, so the first piece already
+   //  knows where the whole model is
+   for (k=0;k<3;k++)
+   {
+      s->min[k] = +1e30;
+      s->max[k] = -1e30;
+   }
+   while ((line = readline(s->f)))
+      if (line[0]=='v' && line[1]==' ')
+      {
+         float x[3];
+         if (!readfloat(s,line+2,3,x)) break;
+         for (k=0;k<3;k++)
          {
-            glEnable(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D,mtl[k].map);
+            if (x[k]<s->min[k]) s->min[k] = x[k];
+            if (x[k]>s->max[k]) s->max[k] = x[k];
          }
-         else
-            glDisable(GL_TEXTURE_2D);
-         return;
       }
-   //  No matches
-   fprintf(stderr,"Unknown material %s\n",name);
+   rewind(s->f);
+   return s;
 }
 
 //
-//  Load OBJ file
+//  Read the next piece of an OBJ file as an indexed triangle mesh
+//    Reads faces until the piece has maxtri triangles
+//    Polygons are split into triangle fans and the triangles are grouped
+//    by material.  The piece has its own copy of the materials.
+//    Returns NULL at the end of the file (or on an error when not fatal)
 //
-int LoadOBJ(const char* file)
+mesh_t* MeshStreamNext(mesh_stream_t* s,int maxtri)
 {
-   int k;
-   int  Nv,Nn,Nt;  //  Number of vertex, normal and textures
-   int  Mv,Mn,Mt;  //  Maximum vertex, normal and textures
-   float* V;       //  Array of vertexes
-   float* N;       //  Array of normals
-   float* T;       //  Array if textures coordinates
+   int k,ok=1;
+   int  Mvert=0;   //  Maximum mesh vertices
+   int  Mi=0;      //  Maximum indices
    char*  line;    //  Line pointer
    char*  str;     //  String pointer
+   mesh_t* mesh;
 
-   //  Open file
-   FILE* f = fopen(file,"r");
-   if (!f) Fatal("Cannot open file %s\n",file);
-
-   // Reset materials
-   mtl = NULL;
-   Nmtl = 0;
+   //  Nothing more after an error
+   if (s->error[0]) return NULL;
 
-   //  Start new displaylist
-   int list = glGenLists(1);
-   glNewList(list,GL_COMPILE);
-   //  Push attributes for textures
-   glPushAttrib(GL_TEXTURE_BIT);
+   //  Empty mesh with one group using the current material
+   mesh = (mesh_t*)calloc(1,sizeof(mesh_t));
+   if (!mesh) Fatal("Cannot allocate mesh\n");
+   group(mesh,s->cur);
 
    //  Read vertexes and facets
-   V  = N  = T  = NULL;
-   Nv = Nn = Nt = 0;
-   Mv = Mn = Mt = 0;
-   while ((line = readline(f)))
+   while (ok && mesh->ni/3<maxtri && (line = readline(s->f)))
    {
       //  Vertex coordinates (always 3)
       if (line[0]=='v' && line[1]==' ')
-         readcoord(line+2,3,&V,&Nv,&Mv);
+         ok = readcoord(s,line+2,3,&s->V,&s->Nv,&s->Mv);
       //  Normal coordinates (always 3)
       else if (line[0]=='v' && line[1] == 'n')
-         readcoord(line+2,3,&N,&Nn,&Mn);
+         ok = readcoord(s,line+2,3,&s->N,&s->Nn,&s->Mn);
       //  Texture coordinates (always 2)
       else if (line[0]=='v' && line[1] == 't')
-         readcoord(line+2,2,&T,&Nt,&Mt);
-      //  Read and draw facets
+         ok = readcoord(s,line+2,2,&s->T,&s->Nt,&s->Mt);
+      //  Read facets
       else if (line[0]=='f')
       {
+         int n=0,first=0,prev=0;
+         int Nv=s->Nv,Nn=s->Nn,Nt=s->Nt;
          line++;
          //  Read Vertex/Texture/Normal triplets
-         glBegin(GL_POLYGON);
          while ((str = getword(&line)))
          {
+            int t[3],v;
             int Kv,Kt,Kn;
             //  Try Vertex/Texture/Normal triplet
             if (sscanf(str,"%d/%d/%d",&Kv,&Kt,&Kn)==3)
-            {
-               if (Kv<0 || Kv>Nv/3) Fatal("Vertex %d out of range 1-%d\n",Kv,Nv/3);
-               if (Kn<0 || Kn>Nn/3) Fatal("Normal %d out of range 1-%d\n",Kn,Nn/3);
-               if (Kt<0 || Kt>Nt/2) Fatal("Texture %d out of range 1-%d\n",Kt,Nt/2);
-            }
+               ok = Index(s,"Vertex",Kv,Nv/3) && Index(s,"Normal",Kn,Nn/3) && Index(s,"Texture",Kt,Nt/2);
             //  Try Vertex//Normal pairs
             else if (sscanf(str,"%d//%d",&Kv,&Kn)==2)
             {
-               if (Kv<0 || Kv>Nv/3) Fatal("Vertex %d out of range 1-%d\n",Kv,Nv/3);
-               if (Kn<0 || Kn>Nn/3) Fatal("Normal %d out of range 1-%d\n",Kn,Nn/3);
+               ok = Index(s,"Vertex",Kv,Nv/3) && Index(s,"Normal",Kn,Nn/3);
                Kt = 0;
             }
             //  Try Vertex index
             else if (sscanf(str,"%d",&Kv)==1)
             {
-               if (Kv<0 || Kv>Nv/3) Fatal("Vertex %d out of range 1-%d\n",Kv,Nv/3);
+               ok = Index(s,"Vertex",Kv,Nv/3);
                Kn = 0;
                Kt = 0;
             }
             //  This is an error
             else
-               Fatal("Invalid facet %s\n",str);
-            //  Draw vectors
-            if (Kt) glTexCoord2fv(T+2*(Kt-1));
-            if (Kn) glNormal3fv(N+3*(Kn-1));
-            if (Kv) glVertex3fv(V+3*(Kv-1));
+               ok = Error(s,"Invalid facet %s\n",str);
+            if (!ok) break;
+            if (!Kv) continue;
+            if (Kt) mesh->hastex = 1;
+            if (Kn) mesh->hasnormal = 1;
+            //  Fan triangulation
+            t[0] = Kv;  t[1] = Kt;  t[2] = Kn;
+            v = vertex(mesh,t,s->V,s->T,s->N,&Mvert);
+            if (n==0)
+               first = v;
+            else if (n>=2)
+            {
+               if (mesh->ni+3>Mi)
+               {
+                  Mi = Mi ? 2*Mi : 3*8192;
+                  mesh->idx = (unsigned int*)realloc(mesh->idx,Mi*sizeof(unsigned int));
+                  if (!mesh->idx) Fatal("Cannot allocate %d indices\n",Mi);
+               }
+               mesh->idx[mesh->ni++] = first;
+               mesh->idx[mesh->ni++] = prev;
+               mesh->idx[mesh->ni++] = v;
+               mesh->group[mesh->ngroup-1].count += 3;
+            }
+            prev = v;
+            n++;
          }
-         glEnd();
       }
       //  Use material
       else if ((str = readstr(line,"usemtl")))
-         SetMaterial(str);
+      {
+         s->cur = FindMaterial(s,str);
+         group(mesh,s->cur);
+      }
       //  Load materials
       else if ((str = readstr(line,"mtllib")))
-         LoadMaterial(str);
+         ok = LoadMaterial(s,str);
       //  Skip this line
    }
+   //  Drop a trailing empty group
+   if (mesh->group[mesh->ngroup-1].count==0) mesh->ngroup--;
+
+   //  Free the vertex table
+   free(key);
+   free(hash);
+   key  = NULL;
+   hash = NULL;
+   Nhash = 0;
+
+   //  Nothing left (or an error)
+   if (!ok || mesh->ni==0)
+   {
+      FreeMesh(mesh);
+      return NULL;
+   }
+
+   //  Bounds
+   for (k=0;k<3;k++)
+   {
+      mesh->min[k] = +1e30;
+      mesh->max[k] = -1e30;
+   }
+   for (k=0;k<3*mesh->nv;k++)
+   {
+      if (mesh->xyz[k]<mesh->min[k%3]) mesh->min[k%3] = mesh->xyz[k];
+      if (mesh->xyz[k]>mesh->max[k%3]) mesh->max[k%3] = mesh->xyz[k];
+   }
+
+   //  Copy of the materials
+   mesh->nmtl = s->nmtl;
+   mesh->mtl  = (mtl_t*)malloc(s->nmtl*sizeof(mtl_t));
+   if (s->nmtl && !mesh->mtl) Fatal("Cannot allocate %d materials\n",s->nmtl);
+   for (k=0;k<s->nmtl;k++)
+   {
+      mesh->mtl[k] = s->mtl[k];
+      mesh->mtl[k].name = (char*)malloc(strlen(s->mtl[k].name)+1);
+      if (!mesh->mtl[k].name) Fatal("Cannot allocate material name\n");
+      strcpy(mesh->mtl[k].name,s->mtl[k].name);
+   }
+   s->given = s->nmtl;
+
+   return mesh;
+}
+
+//
+//  Fraction of the file read
+//
+float MeshStreamProgress(const mesh_stream_t* s)
+{
+   return s->f && s->size>0 ? (float)ftell(s->f)/s->size : 1;
+}
+
+//
+//  First error reading a stream opened with fatal=0 (NULL if none)
+//
+const char* MeshStreamError(const mesh_stream_t* s)
+{
+   return s->error[0] ? s->error : NULL;
+}
+
+//
+//  Bounds of all the vertexes in the file
+//    These are read when the stream is opened, so they do not change as
+//    pieces are read
+//
+void MeshStreamBounds(const mesh_stream_t* s,float min[3],float max[3])
+{
+   memcpy(min,s->min,sizeof(s->min));
+   memcpy(max,s->max,sizeof(s->max));
+}
+
+//
+//  Memory held by the stream (coordinates faces may still refer to)
+//
+long MeshStreamBytes(const mesh_stream_t* s)
+{
+   return (long)(s->Mv+s->Mn+s->Mt)*sizeof(float) + s->nmtl*sizeof(mtl_t);
+}
+
+//
+//  Close stream
+//    Deletes the textures of materials that were not handed to a mesh
+//
+void MeshStreamClose(mesh_stream_t* s)
+{
+   int k;
+   if (s->f) fclose(s->f);
+   for (k=0;k<s->nmtl;k++)
+   {
+      //  Textures of materials no mesh has (say the stream had an error)
+      if (k>=s->given && s->mtl[k].map) glDeleteTextures(1,(unsigned int*)&s->mtl[k].map);
+      free(s->mtl[k].name);
+   }
+   free(s->mtl);
+   free(s->V);
+   free(s->N);
+   free(s->T);
+   free(s);
+}
+
+//
+//  Check that the MTL files of an OBJ file and their map_Kd images exist
+//  without loading anything
+//    Prints a warning for each problem and returns how many there are.
+//    Sets n to the number of files checked.
+//
+int CheckOBJ(const char* file,int* n)
+{
+   int bad=0;
+   char* line;
+   char* str;
+   FILE* f = fopen(file,"r");
+   *n = 1;
+   if (!f)
+   {
+      fprintf(stderr,"Cannot open file %s\n",file);
+      return 1;
+   }
+   while ((line = readline(f)))
+      if ((str = readstr(line,"mtllib")))
+      {
+         //  Material file (the line buffer is reused while reading it)
+         FILE* m = fopen(str,"r");
+         (*n)++;
+         if (!m)
+         {
+            fprintf(stderr,"Cannot open material file %s\n",str);
+            bad++;
+            continue;
+         }
+         //  Texture images
+         while ((line = readline(m)))
+            if ((str = readstr(line,"map_Kd")))
+            {
+               (*n)++;
+               if (!CheckBMP(str)) bad++;
+            }
+         fclose(m);
+      }
    fclose(f);
+   return bad;
+}
+
+//
+//  Load OBJ file as an indexed triangle mesh
+//
+mesh_t* LoadMesh(const char* file)
+{
+   mesh_stream_t* s = MeshStreamOpen(file,1);
+   mesh_t* mesh = MeshStreamNext(s,INT_MAX);
+   MeshStreamClose(s);
+   //  Empty file
+   if (!mesh)
+   {
+      mesh = (mesh_t*)calloc(1,sizeof(mesh_t));
+      if (!mesh) Fatal("Cannot allocate mesh\n");
+      return mesh;
+   }
+
+   //  Reorder for the vertex cache, overdraw and vertex fetch
+   {
+      float acmr0,atvr0,acmr1,atvr1;
+      MeshCacheStats(mesh,16,&acmr0,&atvr0);
+      MeshOptimize(mesh);
+      MeshCacheStats(mesh,16,&acmr1,&atvr1);
+      printf("%s: %d triangles ACMR %.3f -> %.3f ATVR %.3f -> %.3f\n",file,mesh->ni/3,acmr0,acmr1,atvr0,atvr1);
+   }
+
+   return mesh;
+}
+
+//
+//  Free mesh from LoadMesh
+//
+void FreeMesh(mesh_t* mesh)
+{
+   int k;
+   if (!mesh) return;
+   for (k=0;k<mesh->nmtl;k++)
+      free(mesh->mtl[k].name);
+   free(mesh->mtl);
+   free(mesh->group);
+   free(mesh->idx);
+   free(mesh->xyz);
+   free(mesh->nrm);
+   free(mesh->st);
+   free(mesh);
+}
+
+//
+//  Load OBJ file into a display list
+//
+int LoadOBJ(const char* file)
+{
+   int i,k;
+   mesh_t* mesh = LoadMesh(file);
+
+   //  Start new displaylist
+   int list = glGenLists(1);
+   glNewList(list,GL_COMPILE);
+   //  Push attributes for textures
+   glPushAttrib(GL_TEXTURE_BIT);
+   //  Draw triangles by material
+   for (k=0;k<mesh->ngroup;k++)
+   {
+      const mesh_group_t* g = mesh->group+k;
+      if (g->mtl>=0) MeshMaterial(mesh,g->mtl);
+      glBegin(GL_TRIANGLES);
+      for (i=g->first;i<g->first+g->count;i++)
+      {
+         int v = mesh->idx[i];
+         if (mesh->hastex) glTexCoord2fv(mesh->st+2*v);
+         if (mesh->hasnormal) glNormal3fv(mesh->nrm+3*v);
+         glVertex3fv(mesh->xyz+3*v);
+      }
+      glEnd();
+   }
    //  Pop attributes (textures)
    glPopAttrib();
    glEndList();
 
-   //  Free materials
-   for (k=0;k<Nmtl;k++)
-      free(mtl[k].name);
-   free(mtl);
-
-   //  Free arrays
-   free(V);
-   free(T);
-   free(N);
-
+   FreeMesh(mesh);
    return list;
 }
@@ -0,0 +1,283 @@
+/*
+ *  CPU hierarchical-Z occlusion culling
+ *
+ *  Depth is stored as window z in [0,1].  Each worker rasterizes every
+ *  occluder triangle into its own band of rows, four pixels at a time with
+ *  SSE2 when available.  Pyramid texels hold the farthest depth of the
+ *  pixels they cover, so a box is hidden only if its nearest point is
+ *  behind every texel its screen rectangle touches.
+ */
+#include "CSCIx229.h"
+#include "scene.h"
+#include "occlude.h"
+#include "jobs.h"
+#include "arena.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//  Screen space triangle
+typedef struct
+{
+   float x[3],y[3],z[3];
+} tri_t;
+
+int occlusion = 1;
+
+static float  clipm[16];              //  Projection*modelview
+static float  pyramid[OCC_W*OCC_H*4/3+OCC_W];  //  All levels
+static float* level[OCC_LEVELS];      //  Start of each level
+static tri_t* tri=NULL;               //  Occluder triangles (frame arena)
+static int    Ntri=0;                 //  Triangle count
+
+/*
+ *  Transform point p to clip coordinates c
+ */
+static void Transform(const float m[16],const float p[3],float c[4])
+{
+   int i;
+   for (i=0;i<4;i++)
+      c[i] = m[i]*p[0] + m[4+i]*p[1] + m[8+i]*p[2] + m[12+i];
+}
+
+/*
+ *  Add triangle in clip coordinates
+ */
+static void AddTriangle(const float a[4],const float b[4],const float c[4])
+{
+   const float* v[3] = {a,b,c};
+   tri_t* t;
+   int k;
+   t = tri+Ntri++;
+   //  Perspective divide and viewport transform
+   for (k=0;k<3;k++)
+   {
+      float w = 1/v[k][3];
+      t->x[k] = (0.5*v[k][0]*w+0.5)*OCC_W;
+      t->y[k] = (0.5*v[k][1]*w+0.5)*OCC_H;
+      t->z[k] =  0.5*v[k][2]*w+0.5;
+   }
+}
+
+/*
+ *  Clip quad to the near plane and add it as triangles
+ */
+static void AddQuad(const float q[4][3],const float pos[3])
+{
+   float c[4][4],out[8][4];
+   int i,k,n=0;
+   for (k=0;k<4;k++)
+   {
+      float p[3] = {pos[0]+q[k][0],pos[1]+q[k][1],pos[2]+q[k][2]};
+      Transform(clipm,p,c[k]);
+   }
+   //  Sutherland-Hodgman against z+w>=0
+   for (k=0;k<4;k++)
+   {
+      const float* a = c[k];
+      const float* b = c[(k+1)%4];
+      float da = a[2]+a[3];
+      float db = b[2]+b[3];
+      if (da>=0) memcpy(out[n++],a,sizeof(c[k]));
+      if ((da>=0) != (db>=0))
+      {
+         float t = da/(da-db);
+         for (i=0;i<4;i++)
+            out[n][i] = a[i] + t*(b[i]-a[i]);
+         n++;
+      }
+   }
+   //  Fan triangulate
+   for (k=2;k<n;k++)
+      AddTriangle(out[0],out[k-1],out[k]);
+}
+
+/*
+ *  Rasterize triangle into rows y0 to y1-1
+ */
+static void RasterTriangle(const tri_t* t,int y0,int y1)
+{
+   float x0=t->x[0],y0f=t->y[0],z0=t->z[0];
+   float x1=t->x[1],y1f=t->y[1],z1=t->z[1];
+   float x2=t->x[2],y2f=t->y[2],z2=t->z[2];
+   float A[3],B[3],C[3],zA,zB,zC;
+   float area = (x1-x0)*(y2f-y0f) - (x2-x0)*(y1f-y0f);
+   int   minx,maxx,miny,maxy,x,y;
+
+   if (area==0) return;
+   //  Make counterclockwise
+   if (area<0)
+   {
+      float tmp;
+      tmp = x1;  x1  = x2;  x2  = tmp;
+      tmp = y1f; y1f = y2f; y2f = tmp;
+      tmp = z1;  z1  = z2;  z2  = tmp;
+      area = -area;
+   }
+   //  Bounding box clamped to the band
+   minx = floor(fmin(x0,fmin(x1,x2)));
+   maxx = ceil (fmax(x0,fmax(x1,x2)));
+   miny = floor(fmin(y0f,fmin(y1f,y2f)));
+   maxy = ceil (fmax(y0f,fmax(y1f,y2f)));
+   if (minx<0) minx = 0;
+   if (maxx>OCC_W-1) maxx = OCC_W-1;
+   if (miny<y0) miny = y0;
+   if (maxy>y1-1) maxy = y1-1;
+   if (minx>maxx || miny>maxy) return;
+   minx &= ~3;
+
+   //  Edge functions E = A*x+B*y+C (positive inside)
+   A[0] = y0f-y1f;  B[0] = x1-x0;  C[0] = -A[0]*x0 -B[0]*y0f;
+   A[1] = y1f-y2f;  B[1] = x2-x1;  C[1] = -A[1]*x1 -B[1]*y1f;
+   A[2] = y2f-y0f;  B[2] = x0-x2;  C[2] = -A[2]*x2 -B[2]*y2f;
+   //  Depth plane z = zA*x+zB*y+zC
+   zA = ((z1-z0)*(y2f-y0f) - (z2-z0)*(y1f-y0f))/area;
+   zB = ((x1-x0)*(z2-z0) - (x2-x0)*(z1-z0))/area;
+   zC = z0 - zA*x0 - zB*y0f;
+
+   for (y=miny;y<=maxy;y++)
+   {
+      float  py  = y+0.5;
+      float* row = level[0]+y*OCC_W;
+#ifdef __SSE2__
+      __m128 px0 = _mm_set_ps(3.5,2.5,1.5,0.5);
+      __m128 zero = _mm_setzero_ps();
+      __m128 a0 = _mm_set1_ps(A[0]), r0 = _mm_set1_ps(B[0]*py+C[0]);
+      __m128 a1 = _mm_set1_ps(A[1]), r1 = _mm_set1_ps(B[1]*py+C[1]);
+      __m128 a2 = _mm_set1_ps(A[2]), r2 = _mm_set1_ps(B[2]*py+C[2]);
+      __m128 za = _mm_set1_ps(zA),   rz = _mm_set1_ps(zB*py+zC);
+      for (x=minx;x<=maxx;x+=4)
+      {
+         __m128 px = _mm_add_ps(_mm_set1_ps(x),px0);
+         __m128 e0 = _mm_add_ps(_mm_mul_ps(a0,px),r0);
+         __m128 e1 = _mm_add_ps(_mm_mul_ps(a1,px),r1);
+         __m128 e2 = _mm_add_ps(_mm_mul_ps(a2,px),r2);
+         __m128 in = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0,zero),_mm_cmpge_ps(e1,zero)),_mm_cmpge_ps(e2,zero));
+         if (_mm_movemask_ps(in))
+         {
+            __m128 z = _mm_add_ps(_mm_mul_ps(za,px),rz);
+            __m128 d = _mm_loadu_ps(row+x);
+            __m128 n = _mm_min_ps(d,z);
+            _mm_storeu_ps(row+x,_mm_or_ps(_mm_and_ps(in,n),_mm_andnot_ps(in,d)));
+         }
+      }
+#else
+      for (x=minx;x<=maxx;x++)
+      {
+         float px = x+0.5;
+         if (A[0]*px+B[0]*py+C[0]>=0 && A[1]*px+B[1]*py+C[1]>=0 && A[2]*px+B[2]*py+C[2]>=0)
+         {
+            float z = zA*px+zB*py+zC;
+            if (z<row[x]) row[x] = z;
+         }
+      }
+#endif
+   }
+}
+
+/*
+ *  Clear and rasterize one band of rows
+ */
+static void Raster(int part,int parts,void* arg)
+{
+   int k;
+   int y0 = OCC_H*part/parts;
+   int y1 = OCC_H*(part+1)/parts;
+   for (k=y0*OCC_W;k<y1*OCC_W;k++)
+      level[0][k] = 1;
+   for (k=0;k<Ntri;k++)
+      RasterTriangle(tri+k,y0,y1);
+}
+
+/*
+ *  Rasterize occluders and build the depth pyramid for this frame
+ */
+void OcclusionBegin(const float clip[16])
+{
+   int k,l,x,y,n=0;
+   if (!occlusion) return;
+   //  Level pointers
+   if (!level[0])
+   {
+      level[0] = pyramid;
+      for (l=1;l<OCC_LEVELS;l++)
+         level[l] = level[l-1] + (OCC_W>>(l-1))*(OCC_H>>(l-1));
+   }
+   //  Occluder triangles
+   memcpy(clipm,clip,sizeof(clipm));
+   //  A quad clipped by the near plane has at most 5 corners (3 triangles)
+   for (k=0;k<Nscene;k++)
+   {
+      int i;
+      ObjectOccluder(scene+k,&i);
+      n += i;
+   }
+   tri = (tri_t*)ArenaAlloc(0,3*n*sizeof(tri_t));
+   Ntri = 0;
+   for (k=0;k<Nscene;k++)
+   {
+      int i,n;
+      const occluder_t* q = ObjectOccluder(scene+k,&n);
+      float pos[3] = {scene[k].x,scene[k].y,scene[k].z};
+      for (i=0;i<n;i++)
+         AddQuad(q[i],pos);
+   }
+   //  Rasterize in bands
+   JobsRun(Raster,NULL);
+   //  Max depth pyramid
+   for (l=1;l<OCC_LEVELS;l++)
+   {
+      int w = OCC_W>>l;
+      int h = OCC_H>>l;
+      const float* src = level[l-1];
+      float* dst = level[l];
+      for (y=0;y<h;y++)
+         for (x=0;x<w;x++)
+         {
+            const float* s = src+2*y*2*w+2*x;
+            dst[y*w+x] = fmax(fmax(s[0],s[1]),fmax(s[2*w],s[2*w+1]));
+         }
+   }
+}
+
+/*
+ *  True unless the box is hidden behind the occluders
+ *    Safe to call from several threads after OcclusionBegin
+ */
+int OcclusionTest(const float min[3],const float max[3])
+{
+   float x0=1e30,x1=-1e30,y0=1e30,y1=-1e30,zmin=1;
+   int   ix0,ix1,iy0,iy1,x,y,k,l=0;
+   if (!occlusion) return 1;
+   //  Screen rectangle and nearest depth of the corners
+   for (k=0;k<8;k++)
+   {
+      float c[4],w;
+      float p[3] = {k&1?max[0]:min[0],k&2?max[1]:min[1],k&4?max[2]:min[2]};
+      Transform(clipm,p,c);
+      //  Boxes crossing the near plane are visible
+      if (c[3]<=1e-6 || c[2]<-c[3]) return 1;
+      w = 1/c[3];
+      x0 = fmin(x0,c[0]*w);  x1 = fmax(x1,c[0]*w);
+      y0 = fmin(y0,c[1]*w);  y1 = fmax(y1,c[1]*w);
+      zmin = fmin(zmin,0.5*c[2]*w+0.5);
+   }
+   //  Pixel rectangle grown by one pixel to stay conservative
+   ix0 = floor((0.5*x0+0.5)*OCC_W)-1;
+   ix1 = floor((0.5*x1+0.5)*OCC_W)+1;
+   iy0 = floor((0.5*y0+0.5)*OCC_H)-1;
+   iy1 = floor((0.5*y1+0.5)*OCC_H)+1;
+   if (ix1<0 || iy1<0 || ix0>=OCC_W || iy0>=OCC_H) return 1;
+   if (ix0<0) ix0 = 0;
+   if (iy0<0) iy0 = 0;
+   if (ix1>OCC_W-1) ix1 = OCC_W-1;
+   if (iy1>OCC_H-1) iy1 = OCC_H-1;
+   //  Coarsest level where the rectangle covers at most 4x4 texels
+   while (l<OCC_LEVELS-1 && ((ix1>>l)-(ix0>>l)>3 || (iy1>>l)-(iy0>>l)>3))
+      l++;
+   //  Visible if in front of any texel
+   for (y=iy0>>l;y<=iy1>>l;y++)
+      for (x=ix0>>l;x<=ix1>>l;x++)
+         if (zmin<=level[l][y*(OCC_W>>l)+x]) return 1;
+   return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ *  CPU hierarchical-Z occlusion culling
+ *
+ *  The occluder quads of the buildings are rasterized into a small software
+ *  depth buffer on the worker threads each frame.  A max-depth pyramid is
+ *  built from it and object bounding boxes are tested against the pyramid
+ *  before they are added to the draw lists.
+ */
+#ifndef OCCLUDE_H
+#define OCCLUDE_H
+
+#define OCC_W      256  //  Depth buffer width (multiple of 4)
+#define OCC_H      128  //  Depth buffer height
+#define OCC_LEVELS   6  //  Pyramid levels
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int occlusion;  //  Occlusion culling enabled
+
+void OcclusionBegin(const float clip[16]);
+int  OcclusionTest(const float min[3],const float max[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
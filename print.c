@@ -1,20 +1,233 @@
 /*
  *  Convenience routine to output raster text
  *  Use VARARGS to make this more flexible
+ *
+ *  The font is drawn once with glutBitmapCharacter into a glyph atlas.
+ *  Print adds one textured quad per character at the current raster
+ *  position and PrintFlush draws all the quads of a frame with a single
+ *  glDrawArrays, so text costs the same however many strings there are.
  */
 #include "CSCIx229.h"
+#include <stddef.h>
 
-#define LEN 8192  //  Maximum length of text string
+#define LEN   8192  //  Maximum length of text string
+#define FONT  GLUT_BITMAP_HELVETICA_18
+#define FIRST 32    //  First character in the atlas
+#define LAST  126   //  Last character in the atlas
+#define COLS  16    //  Characters per atlas row
+#define CELLH 28    //  Cell height (Helvetica 18 is 23 pixels with 5 below the baseline)
+#define BASE  7     //  Baseline height in a cell
+
+//  Vertex of a character quad
+typedef struct
+{
+   float         x,y,z;    //  Window position and depth
+   float         s,t;      //  Atlas position
+   unsigned char rgba[4];  //  Raster color
+} glyph_t;
+
+static unsigned int atlas=0;      //  Glyph atlas texture
+static unsigned int vbo=0;        //  Vertex buffer
+static int          cellw;        //  Cell width
+static int          aw,ah;        //  Atlas size
+static int          adv[LAST+1];  //  Advance of each character
+static int          box[LAST+1][4];  //  Ink in each cell (x0,y0,x1,y1)
+static glyph_t*     vtx=NULL;     //  Quads waiting for PrintFlush
+static int          Nvtx=0,Mvtx=0;
+
+/*
+ *  Draw the font into the atlas
+ */
+static void Glyphs(void)
+{
+   unsigned int fbo;
+   unsigned char* ink;
+   int c,prev;
+   //  Cell width from the widest character
+   cellw = 0;
+   for (c=FIRST;c<=LAST;c++)
+   {
+      adv[c] = glutBitmapWidth(FONT,c);
+      if (adv[c]>cellw) cellw = adv[c];
+   }
+   cellw += 2;
+   aw = COLS*cellw;
+   ah = ((LAST-FIRST)/COLS+1)*CELLH;
+   //  Atlas texture, sampled one texel per pixel
+   glGenTextures(1,&atlas);
+   glBindTexture(GL_TEXTURE_2D,atlas);
+   glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,aw,ah,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+   glBindTexture(GL_TEXTURE_2D,0);
+   //  Render the characters into it in white on transparent
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING,&prev);
+   glPushAttrib(GL_ALL_ATTRIB_BITS);
+   glGenFramebuffers(1,&fbo);
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,atlas,0);
+   if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+      Fatal("Cannot create glyph atlas\n");
+   glViewport(0,0,aw,ah);
+   glDisable(GL_SCISSOR_TEST);
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_TEXTURE_2D);
+   glDisable(GL_ALPHA_TEST);
+   glDisable(GL_BLEND);
+   glClearColor(0,0,0,0);
+   glClear(GL_COLOR_BUFFER_BIT);
+   glColor4f(1,1,1,1);
+   for (c=FIRST;c<=LAST;c++)
+   {
+      int k = c-FIRST;
+      glWindowPos2i((k%COLS)*cellw+1,(k/COLS)*CELLH+BASE);
+      glutBitmapCharacter(FONT,c);
+   }
+   //  Bounds of the set pixels so quads only cover ink
+   ink = (unsigned char*)malloc(aw*ah);
+   if (!ink) Fatal("Cannot allocate glyph atlas\n");
+   glPixelStorei(GL_PACK_ALIGNMENT,1);
+   glReadPixels(0,0,aw,ah,GL_ALPHA,GL_UNSIGNED_BYTE,ink);
+   for (c=FIRST;c<=LAST;c++)
+   {
+      int k = c-FIRST;
+      int i,j,*b=box[c];
+      b[0] = b[1] = 1<<30;
+      b[2] = b[3] = 0;
+      for (j=0;j<CELLH;j++)
+         for (i=0;i<cellw;i++)
+            if (ink[((k/COLS)*CELLH+j)*aw+(k%COLS)*cellw+i])
+            {
+               if (i<b[0]) b[0] = i;
+               if (j<b[1]) b[1] = j;
+               if (i>=b[2]) b[2] = i+1;
+               if (j>=b[3]) b[3] = j+1;
+            }
+   }
+   free(ink);
+   glBindFramebuffer(GL_FRAMEBUFFER,prev);
+   glDeleteFramebuffers(1,&fbo);
+   glPopAttrib();
+   glGenBuffers(1,&vbo);
+}
+
+/*
+ *  Add the quads for a string at the current raster position
+ */
 void Print(const char* format , ...)
 {
    char    buf[LEN];
    char*   ch=buf;
    va_list args;
+   float   pos[4],color[4];
+   int     valid,x,y,start,k;
+   unsigned char rgba[4];
    //  Turn the parameters into a character string
    va_start(args,format);
    vsnprintf(buf,LEN,format,args);
    va_end(args);
-   //  Display the characters one at a time at the current raster position
-   while (*ch)
-      glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
+   //  Nothing is drawn if the raster position is clipped
+   glGetIntegerv(GL_CURRENT_RASTER_POSITION_VALID,&valid);
+   if (!valid) return;
+   if (!atlas) Glyphs();
+   glGetFloatv(GL_CURRENT_RASTER_POSITION,pos);
+   glGetFloatv(GL_CURRENT_RASTER_COLOR,color);
+   for (k=0;k<4;k++)
+      rgba[k] = color[k]<0 ? 0 : color[k]>1 ? 255 : 255*color[k]+0.5;
+   //  Cell corners relative to the pen as glBitmap would place them
+   x = start = floor(pos[0])-1;
+   y = floor(pos[1])-BASE;
+   //  Four vertices per character
+   for (;*ch;ch++)
+   {
+      int c = (unsigned char)*ch;
+      const int* b = box[c];
+      int   x0,y0,x1,y1;
+      float s0,t0,s1,t1;
+      glyph_t* v;
+      if (c<FIRST || c>LAST) continue;
+      //  Blank characters only move the pen
+      if (b[2]<=b[0])
+      {
+         x += adv[c];
+         continue;
+      }
+      if (Nvtx+4>Mvtx)
+      {
+         Mvtx += 4096;
+         vtx = (glyph_t*)realloc(vtx,Mvtx*sizeof(glyph_t));
+         if (!vtx) Fatal("Cannot allocate text buffer\n");
+      }
+      v = vtx+Nvtx;
+      Nvtx += 4;
+      //  Inked part of the atlas cell
+      x0 = x+b[0];  x1 = x+b[2];
+      y0 = y+b[1];  y1 = y+b[3];
+      s0 = (float)(((c-FIRST)%COLS)*cellw+b[0])/aw;
+      s1 = (float)(((c-FIRST)%COLS)*cellw+b[2])/aw;
+      t0 = (float)(((c-FIRST)/COLS)*CELLH+b[1])/ah;
+      t1 = (float)(((c-FIRST)/COLS)*CELLH+b[3])/ah;
+      v[0].x = x0;  v[0].y = y0;  v[0].s = s0;  v[0].t = t0;
+      v[1].x = x1;  v[1].y = y0;  v[1].s = s1;  v[1].t = t0;
+      v[2].x = x1;  v[2].y = y1;  v[2].s = s1;  v[2].t = t1;
+      v[3].x = x0;  v[3].y = y1;  v[3].s = s0;  v[3].t = t1;
+      for (k=0;k<4;k++)
+      {
+         v[k].z = -pos[2];
+         memcpy(v[k].rgba,rgba,4);
+      }
+      x += adv[c];
+   }
+   //  Move the raster position past the string as glutBitmapCharacter does
+   glBitmap(0,0,0,0,x-start,0,NULL);
+}
+
+/*
+ *  Draw everything printed since the last call
+ *    Call once per frame before swapping buffers
+ */
+void PrintFlush(void)
+{
+   int vp[4];
+   if (!Nvtx) return;
+   //  Window coordinates (depth -z is the raster depth)
+   glGetIntegerv(GL_VIEWPORT,vp);
+   glPushAttrib(GL_ENABLE_BIT|GL_COLOR_BUFFER_BIT|GL_TEXTURE_BIT|GL_TRANSFORM_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glOrtho(vp[0],vp[0]+vp[2],vp[1],vp[1]+vp[3],0,1);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   //  Depth test is left as it is, since glBitmap uses the raster depth
+   glDisable(GL_LIGHTING);
+   glDisable(GL_CULL_FACE);
+   glDisable(GL_BLEND);
+   glEnable(GL_TEXTURE_2D);
+   glBindTexture(GL_TEXTURE_2D,atlas);
+   glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
+   glEnable(GL_ALPHA_TEST);
+   glAlphaFunc(GL_GREATER,0.5);
+   //  One draw for all quads
+   glBindBuffer(GL_ARRAY_BUFFER,vbo);
+   glBufferData(GL_ARRAY_BUFFER,Nvtx*sizeof(glyph_t),vtx,GL_STREAM_DRAW);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   glEnableClientState(GL_COLOR_ARRAY);
+   glVertexPointer(3,GL_FLOAT,sizeof(glyph_t),(void*)offsetof(glyph_t,x));
+   glTexCoordPointer(2,GL_FLOAT,sizeof(glyph_t),(void*)offsetof(glyph_t,s));
+   glColorPointer(4,GL_UNSIGNED_BYTE,sizeof(glyph_t),(void*)offsetof(glyph_t,rgba));
+   glDrawArrays(GL_QUADS,0,Nvtx);
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   //  Restore state
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPopMatrix();
+   glPopClientAttrib();
+   glPopAttrib();
+   Nvtx = 0;
 }
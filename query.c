@@ -0,0 +1,162 @@
+/*
+ *  GPU occlusion queries with temporal coherence
+ */
+#include "CSCIx229.h"
+#include "scene.h"
+#include "query.h"
+#include "xform.h"
+#include "glstats.h"
+
+//  Query state of one object
+typedef struct
+{
+   unsigned int id;  //  Query object
+   int pending;      //  Result not yet read
+   int visible;      //  Last known result
+   int seen;         //  Last frame the object was in view
+} query_t;
+
+int queries = 0;
+
+static query_t* query=NULL;  //  One per scene object
+static int*     test=NULL;   //  Hidden objects to re-test this frame
+static int      Ntest=0;
+static int      frame=0;
+static int      active=0;    //  A query is open around a draw
+static int      Nvisible,Nhidden,Nissued,Nwaiting;  //  Statistics
+
+/*
+ *  Start of frame
+ */
+void QueryFrame(void)
+{
+   int k;
+   if (!query)
+   {
+      query = (query_t*)malloc(Nscene*sizeof(query_t));
+      test  = (int*)malloc(Nscene*sizeof(int));
+      if (!query || !test) Fatal("Cannot allocate occlusion queries\n");
+      for (k=0;k<Nscene;k++)
+      {
+         glGenQueries(1,&query[k].id);
+         query[k].pending = 0;
+         query[k].visible = 1;
+         query[k].seen    = -2;
+      }
+   }
+   frame++;
+   Ntest = 0;
+   Nvisible = Nhidden = Nissued = Nwaiting = 0;
+}
+
+/*
+ *  Decide whether to draw obj
+ *    Returns 1 if it should be drawn, in which case QueryEnd must follow
+ */
+int QueryBegin(int k)
+{
+   query_t* q = query+k;
+   //  Pick up the result of an earlier query if it is ready
+   if (q->pending)
+   {
+      unsigned int ready,samples;
+      glGetQueryObjectuiv(q->id,GL_QUERY_RESULT_AVAILABLE,&ready);
+      if (ready)
+      {
+         glGetQueryObjectuiv(q->id,GL_QUERY_RESULT,&samples);
+         q->visible = samples>0;
+         q->pending = 0;
+      }
+      else
+         Nwaiting++;
+   }
+   //  Objects coming back into view have no valid result
+   if (q->seen!=frame-1) q->visible = 1;
+   q->seen = frame;
+   //  Visible: draw it, querying the draw itself if we can
+   if (q->visible)
+   {
+      Nvisible++;
+      active = !q->pending;
+      if (active)
+      {
+         glBeginQuery(GL_SAMPLES_PASSED,q->id);
+         q->pending = 1;
+         Nissued++;
+      }
+      return 1;
+   }
+   //  Hidden: skip it and re-test its box when its turn comes
+   Nhidden++;
+   if (!q->pending && (frame+k)%QUERY_STAGGER==0)
+      test[Ntest++] = k;
+   return 0;
+}
+
+/*
+ *  End of a draw started with QueryBegin
+ */
+void QueryEnd(void)
+{
+   if (active) glEndQuery(GL_SAMPLES_PASSED);
+   active = 0;
+}
+
+/*
+ *  Test bounding boxes of hidden objects against the finished depth buffer
+ */
+void QueryFlush(void)
+{
+   int i,k;
+   if (!Ntest) return;
+   STATS_BEGIN;
+   //  Boxes write neither color nor depth
+   glPushAttrib(GL_ENABLE_BIT|GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_TEXTURE_2D);
+   glDisable(GL_CULL_FACE);
+   glColorMask(0,0,0,0);
+   glDepthMask(0);
+   for (i=0;i<Ntest;i++)
+   {
+      float m[3],M[3];
+      k = test[i];
+      m[0] = xform.min[0][k];  M[0] = xform.max[0][k];
+      m[1] = xform.min[1][k];  M[1] = xform.max[1][k];
+      m[2] = xform.min[2][k];  M[2] = xform.max[2][k];
+      glBeginQuery(GL_SAMPLES_PASSED,query[k].id);
+      glBegin(GL_QUAD_STRIP);
+      glVertex3f(m[0],m[1],m[2]); glVertex3f(m[0],M[1],m[2]);
+      glVertex3f(M[0],m[1],m[2]); glVertex3f(M[0],M[1],m[2]);
+      glVertex3f(M[0],m[1],M[2]); glVertex3f(M[0],M[1],M[2]);
+      glVertex3f(m[0],m[1],M[2]); glVertex3f(m[0],M[1],M[2]);
+      glVertex3f(m[0],m[1],m[2]); glVertex3f(m[0],M[1],m[2]);
+      glEnd();
+      glBegin(GL_QUADS);
+      glVertex3f(m[0],m[1],m[2]); glVertex3f(M[0],m[1],m[2]);
+      glVertex3f(M[0],m[1],M[2]); glVertex3f(m[0],m[1],M[2]);
+      glVertex3f(m[0],M[1],m[2]); glVertex3f(m[0],M[1],M[2]);
+      glVertex3f(M[0],M[1],M[2]); glVertex3f(M[0],M[1],m[2]);
+      glEnd();
+      glEndQuery(GL_SAMPLES_PASSED);
+      query[k].pending = 1;
+      Nissued++;
+   }
+   glPopAttrib();
+   STATS_END;
+}
+
+/*
+ *  Results for this frame
+ *    visible  objects drawn
+ *    hidden   objects skipped
+ *    issued   queries started
+ *    waiting  results not yet available
+ */
+void QueryStats(int* visible,int* hidden,int* issued,int* waiting)
+{
+   *visible = Nvisible;
+   *hidden  = Nhidden;
+   *issued  = Nissued;
+   *waiting = Nwaiting;
+}
@@ -0,0 +1,30 @@
+/*
+ *  GPU occlusion queries with temporal coherence
+ *
+ *  Each object's visibility is taken from the query issued for it in an
+ *  earlier frame, so the CPU never waits for a result.  Visible objects are
+ *  queried while they are drawn; hidden objects are not drawn and their
+ *  bounding boxes are re-tested on a staggered schedule.
+ */
+#ifndef QUERY_H
+#define QUERY_H
+
+#define QUERY_STAGGER 4  //  Hidden objects are re-tested every this many frames
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int queries;  //  Occlusion queries enabled
+
+void QueryFrame(void);
+int  QueryBegin(int obj);
+void QueryEnd(void);
+void QueryFlush(void);
+void QueryStats(int* visible,int* hidden,int* issued,int* waiting);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
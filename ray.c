@@ -0,0 +1,483 @@
+/*
+ *  Ray queries against the static scene
+ */
+#include "CSCIx229.h"
+#include "scene.h"
+#include "ray.h"
+#include <float.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define RAY_EPS 1e-4  //  Ends of a line of sight left out of the test
+
+//  Box or triangle in world coordinates
+typedef struct
+{
+   float v[3][3];  //  Box min and max, or triangle corners
+   int   object;   //  Scene object, or -1 for a model triangle
+   int   tri;      //  Model triangle
+} prim_t;
+
+//  Node of the binary tree while building
+typedef struct
+{
+   float min[3],max[3];
+   int   left;         //  First child (the second follows it), or -1 for a leaf
+   int   first,count;  //  Primitives below it
+} bnode_t;
+
+//  Node with four children, their boxes stored axis by axis
+typedef struct
+{
+   float min[3][4],max[3][4];
+   int   child[4];  //  Node, or ~(first<<3|count) for a leaf
+   int   n;         //  Children used
+} node_t;
+
+static prim_t*  prim=NULL;     //  Primitives in leaf order
+static int      Nprim=0;
+static node_t*  node=NULL;     //  Root first
+static int      Nnode=0;
+static int      visited=0;     //  Nodes visited by the last query
+static double   last=0;        //  Time of the last query (s)
+
+//  Build state
+static bnode_t* bnode=NULL;
+static int      Nbnode=0;
+static int*     order=NULL;    //  Primitives in the order of the binary leaves
+static float  (*lo)[3]=NULL;   //  Primitive bounds
+static float  (*hi)[3]=NULL;
+static float  (*mid)[3]=NULL;  //  Primitive centroids
+
+/*
+ *  Half the surface area of a box
+ */
+static float Area(const float min[3],const float max[3])
+{
+   float dx = max[0]-min[0],dy = max[1]-min[1],dz = max[2]-min[2];
+   return dx*dy + dy*dz + dz*dx;
+}
+
+/*
+ *  Grow box [min,max] to take in box [a,b]
+ */
+static void Grow(float min[3],float max[3],const float a[3],const float b[3])
+{
+   int i;
+   for (i=0;i<3;i++)
+   {
+      if (a[i]<min[i]) min[i] = a[i];
+      if (b[i]>max[i]) max[i] = b[i];
+   }
+}
+
+/*
+ *  Empty box
+ */
+static void Empty(float min[3],float max[3])
+{
+   min[0] = min[1] = min[2] = +FLT_MAX;
+   max[0] = max[1] = max[2] = -FLT_MAX;
+}
+
+/*
+ *  Bin of a centroid coordinate
+ */
+static int Bin(float c,float cmin,float scale)
+{
+   int b = (int)((c-cmin)*scale);
+   return b<RAY_BINS ? b : RAY_BINS-1;
+}
+
+/*
+ *  Split binary node k where the surface area heuristic is least
+ */
+static void Split(int k)
+{
+   bnode_t* b = bnode+k;
+   int first = b->first,count = b->count;
+   float cmin[3],cmax[3],best=FLT_MAX,scale=0;
+   int i,j,axis=-1,split=0,half;
+   //  Bounds of the node and of the centroids
+   Empty(b->min,b->max);
+   Empty(cmin,cmax);
+   for (i=first;i<first+count;i++)
+   {
+      Grow(b->min,b->max,lo[order[i]],hi[order[i]]);
+      Grow(cmin,cmax,mid[order[i]],mid[order[i]]);
+   }
+   b->left = -1;
+   if (count<=RAY_LEAF) return;
+   //  Cost of the split between each pair of bins on each axis
+   for (j=0;j<3;j++)
+   {
+      int   n[RAY_BINS]={0},right=0;
+      float bmin[RAY_BINS][3],bmax[RAY_BINS][3],rmin[3],rmax[3],area[RAY_BINS];
+      float s = cmax[j]>cmin[j] ? RAY_BINS/(cmax[j]-cmin[j]) : 0;
+      if (s==0) continue;
+      for (i=0;i<RAY_BINS;i++)
+         Empty(bmin[i],bmax[i]);
+      for (i=first;i<first+count;i++)
+      {
+         int p = order[i],bin = Bin(mid[p][j],cmin[j],s);
+         n[bin]++;
+         Grow(bmin[bin],bmax[bin],lo[p],hi[p]);
+      }
+      //  Right side sweep, then left side sweep pricing each split
+      Empty(rmin,rmax);
+      for (i=RAY_BINS-1;i>0;i--)
+      {
+         Grow(rmin,rmax,bmin[i],bmax[i]);
+         right += n[i];
+         area[i] = right*(right ? Area(rmin,rmax) : 0);
+      }
+      Empty(rmin,rmax);
+      right = 0;
+      for (i=1;i<RAY_BINS;i++)
+      {
+         float cost;
+         Grow(rmin,rmax,bmin[i-1],bmax[i-1]);
+         right += n[i-1];
+         cost = right*(right ? Area(rmin,rmax) : 0) + area[i];
+         if (right && right<count && cost<best)
+         {
+            best  = cost;
+            axis  = j;
+            split = i;
+            scale = s;
+         }
+      }
+   }
+   //  Primitives below the split bin go first
+   if (axis>=0)
+   {
+      i = first;
+      j = first+count-1;
+      while (i<=j)
+         if (Bin(mid[order[i]][axis],cmin[axis],scale)<split)
+            i++;
+         else
+         {
+            int t = order[i];
+            order[i] = order[j];
+            order[j--] = t;
+         }
+      half = i-first;
+   }
+   //  All centroids in one place
+   else
+      half = count/2;
+   b->left = Nbnode;
+   Nbnode += 2;
+   bnode[b->left].first   = first;
+   bnode[b->left].count   = half;
+   bnode[b->left+1].first = first+half;
+   bnode[b->left+1].count = count-half;
+   Split(b->left);
+   Split(b->left+1);
+}
+
+/*
+ *  Make a four child node from binary node k and the nodes below it
+ *    Returns the index of the node
+ */
+static int Collapse(int k)
+{
+   int kids[4]={k},n=1,i,j,c=Nnode++;
+   node_t* q = node+c;
+   //  Open the inner child with the largest area until there are four
+   while (n<4)
+   {
+      float a=-1;
+      int open=-1;
+      for (i=0;i<n;i++)
+         if (bnode[kids[i]].left>=0 && Area(bnode[kids[i]].min,bnode[kids[i]].max)>a)
+         {
+            a = Area(bnode[kids[i]].min,bnode[kids[i]].max);
+            open = i;
+         }
+      if (open<0) break;
+      kids[n++] = bnode[kids[open]].left+1;
+      kids[open] = bnode[kids[open]].left;
+   }
+   q->n = n;
+   for (i=0;i<4;i++)
+   {
+      const bnode_t* b = bnode+kids[i<n ? i : 0];
+      for (j=0;j<3;j++)
+      {
+         q->min[j][i] = i<n ? b->min[j] : +FLT_MAX;
+         q->max[j][i] = i<n ? b->max[j] : -FLT_MAX;
+      }
+      q->child[i] = i<n && b->left<0 ? ~(b->first<<3|b->count) : 0;
+   }
+   for (i=0;i<n;i++)
+      if (bnode[kids[i]].left>=0)
+         q->child[i] = Collapse(kids[i]);
+   return c;
+}
+
+/*
+ *  Build the hierarchy over the scene and ntri world space triangles
+ *    (nine floats each), replacing the last one
+ */
+void RayBuild(const float* tri,int ntri)
+{
+   float part[OBJ_PARTS][2][3];
+   int k,i,n;
+   prim_t* p;
+   //  Scene boxes then model triangles
+   for (n=k=0;k<Nscene;k++)
+      n += ObjectParts(scene+k,part);
+   Nprim = n+ntri;
+   p     = (prim_t*)malloc(Nprim*sizeof(prim_t));
+   lo    = (float(*)[3])malloc(Nprim*sizeof(*lo));
+   hi    = (float(*)[3])malloc(Nprim*sizeof(*hi));
+   mid   = (float(*)[3])malloc(Nprim*sizeof(*mid));
+   order = (int*)malloc(Nprim*sizeof(int));
+   bnode = (bnode_t*)malloc(2*Nprim*sizeof(bnode_t));
+   if (!p || !lo || !hi || !mid || !order || !bnode) Fatal("Cannot allocate %d ray primitives\n",Nprim);
+   for (n=k=0;k<Nscene;k++)
+   {
+      int m = ObjectParts(scene+k,part);
+      for (i=0;i<m;i++,n++)
+      {
+         memcpy(p[n].v,part[i],sizeof(part[i]));
+         p[n].object = k;
+         p[n].tri    = -1;
+      }
+   }
+   for (k=0;k<ntri;k++,n++)
+   {
+      memcpy(p[n].v,tri+9*k,sizeof(p[n].v));
+      p[n].object = -1;
+      p[n].tri    = k;
+   }
+   //  Bounds and centroids
+   for (k=0;k<Nprim;k++)
+   {
+      if (p[k].object>=0)
+      {
+         memcpy(lo[k],p[k].v[0],sizeof(lo[k]));
+         memcpy(hi[k],p[k].v[1],sizeof(hi[k]));
+      }
+      else
+      {
+         Empty(lo[k],hi[k]);
+         for (i=0;i<3;i++)
+            Grow(lo[k],hi[k],p[k].v[i],p[k].v[i]);
+      }
+      for (i=0;i<3;i++)
+         mid[k][i] = 0.5*(lo[k][i]+hi[k][i]);
+      order[k] = k;
+   }
+   //  Binary tree, then four child nodes (never more nodes than binary ones)
+   bnode[0].first = 0;
+   bnode[0].count = Nprim;
+   Nbnode = 1;
+   Split(0);
+   free(node);
+   node  = (node_t*)malloc(Nbnode*sizeof(node_t));
+   if (!node) Fatal("Cannot allocate %d ray nodes\n",Nbnode);
+   Nnode = 0;
+   Collapse(0);
+   //  Primitives in leaf order
+   free(prim);
+   prim = (prim_t*)malloc(Nprim*sizeof(prim_t));
+   if (!prim) Fatal("Cannot allocate %d ray primitives\n",Nprim);
+   for (k=0;k<Nprim;k++)
+      prim[k] = p[order[k]];
+   free(p);
+   free(lo);
+   free(hi);
+   free(mid);
+   free(order);
+   free(bnode);
+   lo = hi = mid = NULL;
+   order = NULL;
+   bnode = NULL;
+}
+
+/*
+ *  Distance along the ray to a primitive
+ *    Returns 1 if it is hit between tmin and tmax
+ */
+static int Intersect(const prim_t* p,const float org[3],const float dir[3],const float inv[3],float tmin,float tmax,float* t)
+{
+   int i;
+   //  Slab test for a box
+   if (p->object>=0)
+   {
+      for (i=0;i<3;i++)
+      {
+         float t0 = (p->v[0][i]-org[i])*inv[i],t1 = (p->v[1][i]-org[i])*inv[i];
+         if (t0>t1)
+         {
+            float s = t0;
+            t0 = t1;
+            t1 = s;
+         }
+         if (t0>tmin) tmin = t0;
+         if (t1<tmax) tmax = t1;
+      }
+      *t = tmin;
+      return tmin<=tmax;
+   }
+   //  Moller-Trumbore for a triangle
+   else
+   {
+      float e1[3],e2[3],s[3],pv[3],qv[3],det,u,v;
+      for (i=0;i<3;i++)
+      {
+         e1[i] = p->v[1][i]-p->v[0][i];
+         e2[i] = p->v[2][i]-p->v[0][i];
+         s[i]  = org[i]-p->v[0][i];
+      }
+      pv[0] = dir[1]*e2[2]-dir[2]*e2[1];
+      pv[1] = dir[2]*e2[0]-dir[0]*e2[2];
+      pv[2] = dir[0]*e2[1]-dir[1]*e2[0];
+      det = e1[0]*pv[0]+e1[1]*pv[1]+e1[2]*pv[2];
+      if (fabs(det)<1e-12) return 0;
+      det = 1/det;
+      u = (s[0]*pv[0]+s[1]*pv[1]+s[2]*pv[2])*det;
+      if (u<0 || u>1) return 0;
+      qv[0] = s[1]*e1[2]-s[2]*e1[1];
+      qv[1] = s[2]*e1[0]-s[0]*e1[2];
+      qv[2] = s[0]*e1[1]-s[1]*e1[0];
+      v = (dir[0]*qv[0]+dir[1]*qv[1]+dir[2]*qv[2])*det;
+      if (v<0 || u+v>1) return 0;
+      *t = (e2[0]*qv[0]+e2[1]*qv[1]+e2[2]*qv[2])*det;
+      return *t>=tmin && *t<=tmax;
+   }
+}
+
+/*
+ *  Walk the hierarchy along a ray between tmin and tmax
+ *    With any set stops at the first hit, otherwise finds the closest
+ */
+static int Trace(const float org[3],const float dir[3],float tmin,float tmax,int any,rayhit_t* hit)
+{
+   int   stack[RAY_STACK];
+   float tstack[RAY_STACK];
+   float inv[3];
+   int   i,sp=0,found=0;
+   double t0 = Elapsed();
+   //  A huge finite inverse keeps 0*inv out of the slab tests
+   for (i=0;i<3;i++)
+      inv[i] = dir[i]!=0 ? 1/dir[i] : 1e30;
+   visited = 0;
+   if (Nnode)
+   {
+      stack[sp] = 0;
+      tstack[sp++] = tmin;
+   }
+   while (sp)
+   {
+      const node_t* q;
+      float tn[4],t;
+      int   mask,k,m=0,near[4];
+      if (tstack[--sp]>tmax) continue;
+      q = node+stack[sp];
+      visited++;
+      //  Slab test of the four children
+#ifdef __SSE__
+      {
+         __m128 enter = _mm_set1_ps(tmin),leave = _mm_set1_ps(tmax);
+         for (i=0;i<3;i++)
+         {
+            __m128 o = _mm_set1_ps(org[i]),d = _mm_set1_ps(inv[i]);
+            __m128 a = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(q->min[i]),o),d);
+            __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(q->max[i]),o),d);
+            enter = _mm_max_ps(enter,_mm_min_ps(a,b));
+            leave = _mm_min_ps(leave,_mm_max_ps(a,b));
+         }
+         mask = _mm_movemask_ps(_mm_cmple_ps(enter,leave)) & ((1<<q->n)-1);
+         _mm_storeu_ps(tn,enter);
+      }
+#else
+      mask = 0;
+      for (k=0;k<q->n;k++)
+      {
+         float enter=tmin,leave=tmax;
+         for (i=0;i<3;i++)
+         {
+            float a = (q->min[i][k]-org[i])*inv[i],b = (q->max[i][k]-org[i])*inv[i];
+            if ((a<b ? a : b)>enter) enter = a<b ? a : b;
+            if ((a<b ? b : a)<leave) leave = a<b ? b : a;
+         }
+         tn[k] = enter;
+         if (enter<=leave) mask |= 1<<k;
+      }
+#endif
+      //  Test the primitives of leaves now and sort the inner children
+      for (k=0;k<4;k++)
+         if (mask & (1<<k))
+         {
+            int c = q->child[k];
+            if (c<0)
+            {
+               int first = ~c>>3,count = ~c&7;
+               for (i=first;i<first+count;i++)
+                  if (Intersect(prim+i,org,dir,inv,tmin,tmax,&t))
+                  {
+                     found = 1;
+                     if (any) break;
+                     tmax = t;
+                     hit->t      = t;
+                     hit->object = prim[i].object;
+                     hit->tri    = prim[i].tri;
+                  }
+               if (found && any) break;
+            }
+            else
+            {
+               for (i=m++;i>0 && tn[near[i-1]]<tn[k];i--)
+                  near[i] = near[i-1];
+               near[i] = k;
+            }
+         }
+      if (found && any) break;
+      //  Nearest child on top
+      if (sp+m>RAY_STACK) Fatal("Ray stack overflow\n");
+      for (i=0;i<m;i++)
+      {
+         stack[sp]    = q->child[near[i]];
+         tstack[sp++] = tn[near[i]];
+      }
+   }
+   if (found && !any)
+      for (i=0;i<3;i++)
+         hit->p[i] = org[i]+hit->t*dir[i];
+   last = Elapsed()-t0;
+   return found;
+}
+
+/*
+ *  Closest hit along org + t*dir for t in [0,tmax]
+ *    Returns 0 if nothing is hit
+ */
+int RayCast(const float org[3],const float dir[3],float tmax,rayhit_t* hit)
+{
+   return Trace(org,dir,0,tmax,0,hit);
+}
+
+/*
+ *  Is anything between points a and b
+ */
+int RayOccluded(const float a[3],const float b[3])
+{
+   float d[3] = {b[0]-a[0],b[1]-a[1],b[2]-a[2]};
+   return Trace(a,d,RAY_EPS,1-RAY_EPS,1,NULL);
+}
+
+/*
+ *  Size of the hierarchy and the cost of the last query
+ */
+void RayStats(int* nodes,int* prims,int* nvisited,double* us)
+{
+   *nodes = Nnode;
+   *prims = Nprim;
+   *nvisited = visited;
+   *us = 1e6*last;
+}
@@ -0,0 +1,43 @@
+/*
+ *  Ray queries against the static scene
+ *
+ *  The solid boxes of the objects and the triangles of the imported model
+ *  are kept in a bounding volume hierarchy.  It is built top down with the
+ *  surface area heuristic evaluated over RAY_BINS bins on each axis, then
+ *  the binary tree is collapsed into nodes of four children whose boxes are
+ *  stored axis by axis, so with SSE one slab test checks all four children.
+ *  RayCast visits children nearest first and skips any farther than the
+ *  closest hit so far, so its cost grows with the depth of the tree rather
+ *  than the number of objects.  RayOccluded stops at the first hit, for
+ *  line of sight checks between two points.
+ */
+#ifndef RAY_H
+#define RAY_H
+
+#define RAY_BINS  16   //  Split candidates on each axis
+#define RAY_LEAF  4    //  Most primitives in a leaf
+#define RAY_STACK 256  //  Traversal stack depth
+
+//  Closest hit along a ray
+typedef struct
+{
+   float t;       //  Distance along the ray in lengths of its direction
+   float p[3];    //  Point hit
+   int   object;  //  Scene object hit, or -1 for the model
+   int   tri;     //  Model triangle hit, or -1 for a scene object
+} rayhit_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void RayBuild(const float* tri,int ntri);
+int  RayCast(const float org[3],const float dir[3],float tmax,rayhit_t* hit);
+int  RayOccluded(const float a[3],const float b[3]);
+void RayStats(int* nodes,int* prims,int* visited,double* us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
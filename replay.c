@@ -0,0 +1,116 @@
+/*
+ *  Input recording and replay
+ */
+#include "CSCIx229.h"
+#include "replay.h"
+
+#define MAGIC "CITYREC1"  //  File header
+
+static FILE*        rec    = NULL;  //  Recording file
+static FILE*        play   = NULL;  //  Replay file
+static event_t      next;           //  Next event to replay
+static int          more   = 0;     //  Next event is valid
+static unsigned int frame  = 0;     //  Current frame
+static long         end    = -1;    //  Frames in the recording (-1 if not marked)
+
+/*
+ *  Flush recording at exit
+ */
+static void RecordClose(void)
+{
+   if (!rec) return;
+   //  Mark the number of frames so a replay draws them all
+   RecordEvent(EVENT_END,0,0,0);
+   fclose(rec);
+   rec = NULL;
+}
+
+/*
+ *  Start recording input events to file
+ */
+void RecordOpen(const char* file)
+{
+   rec = fopen(file,"wb");
+   if (!rec) Fatal("Cannot open recording file %s\n",file);
+   if (fwrite(MAGIC,8,1,rec)!=1) Fatal("Cannot write header to %s\n",file);
+   atexit(RecordClose);
+}
+
+/*
+ *  Log an event in the current frame
+ */
+void RecordEvent(int type,int key,int x,int y)
+{
+   event_t e;
+   if (!rec) return;
+   memset(&e,0,sizeof(e));
+   e.frame = frame;
+   e.type  = type;
+   e.key   = key;
+   e.x     = x;
+   e.y     = y;
+   if (fwrite(&e,sizeof(e),1,rec)!=1) Fatal("Error writing recording\n");
+}
+
+/*
+ *  Mark the end of a frame
+ */
+void RecordFrame(void)
+{
+   frame++;
+}
+
+/*
+ *  Read the next event from the replay file
+ */
+static void ReadEvent(void)
+{
+   more = fread(&next,sizeof(next),1,play)==1 && next.type!=EVENT_END;
+}
+
+/*
+ *  Start replaying input events from file
+ */
+void ReplayOpen(const char* file)
+{
+   char magic[8];
+   play = fopen(file,"rb");
+   if (!play) Fatal("Cannot open replay file %s\n",file);
+   if (fread(magic,8,1,play)!=1 || memcmp(magic,MAGIC,8))
+      Fatal("%s is not a recording\n",file);
+   //  Frame count from the end mark (the events of that frame, such as the
+   //  ESC that ended the recording, come after the last frame drawn)
+   if (!fseek(play,-(long)sizeof(next),SEEK_END) && fread(&next,sizeof(next),1,play)==1 && next.type==EVENT_END)
+      end = next.frame;
+   if (fseek(play,8,SEEK_SET)) Fatal("Cannot read %s\n",file);
+   ReadEvent();
+}
+
+/*
+ *  Return the next event due in the current frame
+ *    Returns 0 when all events for this frame have been delivered
+ */
+int ReplayEvent(event_t* e)
+{
+   if (!play || !more || next.frame>frame) return 0;
+   *e = next;
+   ReadEvent();
+   return 1;
+}
+
+/*
+ *  True once every recorded frame has been drawn
+ *    Recordings without an end mark stop after their last event
+ */
+int ReplayDone(void)
+{
+   return play && (end<0 ? !more : frame>=end);
+}
+
+/*
+ *  Frames since start
+ */
+unsigned int ReplayFrames(void)
+{
+   return frame;
+}
@@ -0,0 +1,47 @@
+/*
+ *  Input recording and replay
+ *
+ *  Every input event is logged with the frame it arrived in so that a
+ *  session can be fed back frame for frame.  The file is a short header
+ *  followed by fixed size event records in native byte order, closed by an
+ *  EVENT_END record so a replay draws the frames after the last input too.
+ *  Window size changes during a replay come only from the recording.
+ */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+//  Event types
+#define EVENT_KEY     'k'  //  Keyboard (key)
+#define EVENT_SPECIAL 's'  //  Special key (key)
+#define EVENT_RESHAPE 'r'  //  Window size (x,y)
+#define EVENT_TICK    't'  //  Animation clock (x in ms)
+#define EVENT_MOUSE   'm'  //  Mouse button press (key is the button, at x,y)
+#define EVENT_END     'e'  //  End of the recording (frame is the number of frames)
+
+//  Event record
+typedef struct
+{
+   unsigned int  frame; //  Frame the event arrived in
+   unsigned char type;  //  Event type
+   unsigned char key;   //  Key code
+   short         pad;   //  Unused
+   int           x,y;   //  Event arguments
+} event_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void RecordOpen(const char* file);
+void RecordEvent(int type,int key,int x,int y);
+void RecordFrame(void);
+void ReplayOpen(const char* file);
+int  ReplayEvent(event_t* e);
+int  ReplayDone(void);
+unsigned int ReplayFrames(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
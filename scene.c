@@ -0,0 +1,222 @@
+/*
+ *  Static scene description
+ */
+#include "CSCIx229.h"
+#include "scene.h"
+
+#define S 0.3  //  Scale of every object in the city
+
+const object_t scene[] =
+{
+   //  City frame
+   {OBJ_FRAME, 1,1,1, S,S,S, 90},
+   //  City foundation
+   {OBJ_GROUND, 1,1,1,      S,S,S, 90},
+   {OBJ_GROUND, 15,1.3,1,   S,S,S, 90},
+   {OBJ_GROUND, 1,1,15,     S,S,S, 90},
+   {OBJ_GROUND, 15,1.3,15,  S,S,S, 90},
+   //  Street lights
+   {OBJ_STREETLIGHT, -2,1,-1.5,     S,S,S, 0},
+   {OBJ_STREETLIGHT, -2,1,3.75,     S,S,S, 0},
+   {OBJ_STREETLIGHT, -2,1,-10.5,    S,S,S, 0},
+   {OBJ_STREETLIGHT, -2,1,-15.75,   S,S,S, 0},
+   {OBJ_STREETLIGHT, -2,1,12.5,     S,S,S, 0},
+   {OBJ_STREETLIGHT, -2,1,17.75,    S,S,S, 0},
+   {OBJ_STREETLIGHT, 12,1,-1.5,     S,S,S, 0},
+   {OBJ_STREETLIGHT, 12,1,3.75,     S,S,S, 0},
+   {OBJ_STREETLIGHT, 12,1,-10.5,    S,S,S, 0},
+   {OBJ_STREETLIGHT, 12,1,-15.75,   S,S,S, 0},
+   {OBJ_STREETLIGHT, 12,1,12.5,     S,S,S, 0},
+   {OBJ_STREETLIGHT, 12,1,17.75,    S,S,S, 0},
+   {OBJ_STREETLIGHT, -16,.5,-1.5,   S,S,S, 0},
+   {OBJ_STREETLIGHT, -16,.5,3.75,   S,S,S, 0},
+   {OBJ_STREETLIGHT, -16,.5,-10.5,  S,S,S, 0},
+   {OBJ_STREETLIGHT, -16,.5,-15.75, S,S,S, 0},
+   {OBJ_STREETLIGHT, -16,.5,12.5,   S,S,S, 0},
+   {OBJ_STREETLIGHT, -16,.5,17.75,  S,S,S, 0},
+   //  Stop lights (street lights across the road)
+   {OBJ_STREETLIGHT, -1.6,1,-1.375,    S,S,S, 5},
+   {OBJ_STREETLIGHT, -6.6,1,-1.375,    S,S,S, 5},
+   {OBJ_STREETLIGHT, -15.6,.5,-1.375,  S,S,S, 5},
+   {OBJ_STREETLIGHT, -20.6,.5,-1.375,  S,S,S, 5},
+   {OBJ_STREETLIGHT, 7.4,1,-1.375,     S,S,S, 5},
+   {OBJ_STREETLIGHT, 12.4,1,-1.375,    S,S,S, 5},
+   {OBJ_STREETLIGHT, -1.6,1,12.6,      S,S,S, 5},
+   {OBJ_STREETLIGHT, -6.6,1,12.6,      S,S,S, 5},
+   {OBJ_STREETLIGHT, -1.6,1,-15.6,     S,S,S, 5},
+   {OBJ_STREETLIGHT, -6.6,1,-15.6,     S,S,S, 5},
+   {OBJ_STREETLIGHT, -15.6,.5,-15.6,   S,S,S, 5},
+   {OBJ_STREETLIGHT, -20.6,.5,-15.6,   S,S,S, 5},
+   {OBJ_STREETLIGHT, -15.6,.5,12.6,    S,S,S, 5},
+   {OBJ_STREETLIGHT, -20.6,.5,12.6,    S,S,S, 5},
+   {OBJ_STREETLIGHT, 7.4,1,-15.6,      S,S,S, 5},
+   {OBJ_STREETLIGHT, 12.4,1,-15.6,     S,S,S, 5},
+   {OBJ_STREETLIGHT, 7.4,1,12.6,       S,S,S, 5},
+   {OBJ_STREETLIGHT, 12.4,1,12.6,      S,S,S, 5},
+   //  Street lamps
+   {OBJ_LAMP, 7.5,1,12.5,    S,S,S, 90},
+   {OBJ_LAMP, 7.5,1,17.5,    S,S,S, 90},
+   {OBJ_LAMP, 7.5,1,-1.25,   S,S,S, 90},
+   {OBJ_LAMP, 7.5,1,3.5,     S,S,S, 90},
+   {OBJ_LAMP, 7.5,1,-15.4,   S,S,S, 90},
+   {OBJ_LAMP, 7.5,1,-10.65,  S,S,S, 90},
+   {OBJ_LAMP, -6.5,1,-10.65, S,S,S, 90},
+   {OBJ_LAMP, -6.5,1,-15.4,  S,S,S, 90},
+   {OBJ_LAMP, -6.5,1,12.5,   S,S,S, 90},
+   {OBJ_LAMP, -6.5,1,17.5,   S,S,S, 90},
+   {OBJ_LAMP, -6.5,1,-1.25,  S,S,S, 90},
+   {OBJ_LAMP, -6.5,1,3.5,    S,S,S, 90},
+   //  Arch buildings
+   {OBJ_ARCH, 5,1,1.75,   S,S,S, 90},
+   {OBJ_ARCH, 5,1,-4,     S,S,S, 90},
+   {OBJ_ARCH, 5,10,-1.25, S,S,S, 90},
+   //  Skyscraper
+   {OBJ_SKYSCRAPER, -5.2,1,-5, S,S,S, 90},
+};
+const int Nscene = sizeof(scene)/sizeof(object_t);
+
+//  Bounds of each object type relative to its position
+//  (worked out from the transforms in the draw functions at scale S;
+//  XformBake measures the drawn geometry, these are for use before that)
+static const float bounds[OBJ_TYPES][2][3] =
+{
+   {{-37.6,-3.3,-37.6},{37.6,-1.9,37.6}},  //  OBJ_FRAME
+   {{-21.6,-2.5,-21.6},{ 7.5,-1.8, 7.6}},  //  OBJ_GROUND
+   {{ -0.1,-2.0, -0.1},{ 5.1, 1.1, 0.1}},  //  OBJ_STREETLIGHT
+   {{ -0.2,-2.1, -0.2},{ 0.2, 0.1, 0.2}},  //  OBJ_LAMP
+   {{ -1.5,-2.5, -4.5},{ 1.5, 6.9, 3.2}},  //  OBJ_ARCH
+   {{ -3.6,-2.6, -3.6},{ 3.6,16.1, 3.6}},  //  OBJ_SKYSCRAPER
+};
+//  Stop light variant of OBJ_STREETLIGHT (th=5)
+//  (the lamp heads hang from the cable at x+4.75 on both sides of it)
+static const float stoplight[2][3] = {{4.5,-2.0,-0.1},{4.9,1.1,5.1}};
+
+/*
+ *  World space bounding box of an object
+ */
+void ObjectBounds(const object_t* obj,float min[3],float max[3])
+{
+   const float (*b)[3] = (obj->type==OBJ_STREETLIGHT && obj->th==5) ? stoplight : bounds[obj->type];
+   min[0] = obj->x+b[0][0];  max[0] = obj->x+b[1][0];
+   min[1] = obj->y+b[0][1];  max[1] = obj->y+b[1][1];
+   min[2] = obj->z+b[0][2];  max[2] = obj->z+b[1][2];
+}
+
+//  Arch building walls and floors (exactly the quads it draws)
+static const occluder_t arch[] =
+{
+   {{1.500,4.769,1.672},{-1.500,4.769,1.672},{-1.500,-2.429,1.528},{1.500,-2.429,1.528}},
+   {{1.500,6.669,3.090},{-1.500,6.669,3.090},{-1.500,-2.329,2.910},{1.500,-2.329,2.910}},
+   {{1.500,4.671,2.810},{-1.500,4.671,2.810},{-1.500,4.731,-0.190},{1.500,4.731,-0.190}},
+   {{1.500,4.721,0.110},{-1.500,4.721,0.110},{-1.500,4.781,-2.890},{1.500,4.781,-2.890}},
+   {{1.500,6.671,3.110},{-1.500,6.671,3.110},{-1.500,6.731,0.110},{1.500,6.731,0.110}},
+   {{1.500,6.721,0.310},{-1.500,6.721,0.310},{-1.500,6.781,-2.690},{1.500,6.781,-2.690}},
+   {{1.500,6.721,-1.190},{-1.500,6.721,-1.190},{-1.500,6.781,-4.190},{1.500,6.781,-4.190}},
+   {{1.450,6.714,1.640},{1.450,6.684,3.140},{1.450,-2.314,2.960},{1.450,-2.284,1.460}},
+   {{-1.450,6.714,1.640},{-1.450,6.684,3.140},{-1.450,-2.314,2.960},{-1.450,-2.284,1.460}},
+   {{1.500,6.769,-4.260},{-1.500,6.769,-4.260},{-1.500,-2.229,-4.440},{1.500,-2.229,-4.440}},
+   {{1.500,4.869,-2.828},{-1.500,4.869,-2.828},{-1.500,-2.329,-2.972},{1.500,-2.329,-2.972}},
+   {{1.450,6.814,-4.260},{1.450,6.784,-2.760},{1.450,-2.214,-2.940},{1.450,-2.184,-4.440}},
+   {{-1.450,6.814,-4.260},{-1.450,6.784,-2.760},{-1.450,-2.214,-2.940},{-1.450,-2.184,-4.440}},
+   {{1.500,6.860,-2.978},{1.500,6.740,3.020},{1.500,4.640,2.978},{1.500,4.760,-3.020}},
+   {{-1.400,6.860,-2.978},{-1.400,6.740,3.020},{-1.400,4.640,2.978},{-1.400,4.760,-3.020}},
+};
+
+//  Skyscraper cone as two boxes inscribed in it
+#define A 1.55  //  Half width of lower box (radius 2.25 or more)
+#define B 1.0   //  Half width of upper box (radius 1.5 or more)
+static const occluder_t skyscraper[] =
+{
+   {{-A,-2.5,-A},{ A,-2.5,-A},{ A, 5.0,-A},{-A, 5.0,-A}},
+   {{-A,-2.5, A},{ A,-2.5, A},{ A, 5.0, A},{-A, 5.0, A}},
+   {{-A,-2.5,-A},{-A,-2.5, A},{-A, 5.0, A},{-A, 5.0,-A}},
+   {{ A,-2.5,-A},{ A,-2.5, A},{ A, 5.0, A},{ A, 5.0,-A}},
+   {{-B, 5.0,-B},{ B, 5.0,-B},{ B,12.5,-B},{-B,12.5,-B}},
+   {{-B, 5.0, B},{ B, 5.0, B},{ B,12.5, B},{-B,12.5, B}},
+   {{-B, 5.0,-B},{-B, 5.0, B},{-B,12.5, B},{-B,12.5,-B}},
+   {{ B, 5.0,-B},{ B, 5.0, B},{ B,12.5, B},{ B,12.5,-B}},
+};
+#undef A
+#undef B
+
+/*
+ *  Simplified occluder geometry of an object
+ *    Returns NULL for objects that do not hide others
+ *    The quads lie inside what the object actually draws
+ */
+const occluder_t* ObjectOccluder(const object_t* obj,int* n)
+{
+   switch (obj->type)
+   {
+      case OBJ_ARCH:
+         *n = sizeof(arch)/sizeof(occluder_t);
+         return arch;
+      case OBJ_SKYSCRAPER:
+         *n = sizeof(skyscraper)/sizeof(occluder_t);
+         return skyscraper;
+      default:
+         *n = 0;
+         return NULL;
+   }
+}
+
+//  Solid boxes of the objects that are not solid over their bounds
+//  (around the parts the draw functions make at scale S)
+static const float streetlight_parts[][2][3] =
+{
+   {{-0.1,-2.0,-0.1},{0.1,1.1,0.1}},
+   {{ 4.9,-2.0,-0.1},{5.1,1.1,0.1}},
+};
+static const float stoplight_parts[][2][3] =
+{
+   {{4.5,-2.0,-0.1},{4.7,1.1,0.1}},
+   {{4.5,-2.0, 4.9},{4.7,1.1,5.1}},
+};
+static const float arch_parts[][2][3] =  //  Towers and the floors between them
+{
+   {{-1.5,-2.5, 1.5},{1.5,6.9, 3.2}},
+   {{-1.5,-2.5,-4.5},{1.5,6.9,-2.8}},
+   {{-1.5, 4.6,-2.9},{1.5,6.9, 3.1}},
+};
+static const float skyscraper_parts[][2][3] =  //  Cone as stacked boxes
+{
+   {{-2.6,-2.6,-2.6},{2.6, 3.0,2.6}},
+   {{-1.8, 3.0,-1.8},{1.8, 9.0,1.8}},
+   {{-0.9, 9.0,-0.9},{0.9,16.1,0.9}},
+};
+
+/*
+ *  World space boxes around the solid parts of an object
+ *    Returns the number of boxes (at most OBJ_PARTS)
+ *    Objects without parts are solid over their bounds
+ */
+int ObjectParts(const object_t* obj,float part[][2][3])
+{
+   const float (*b)[2][3];
+   int k,n;
+   switch (obj->type)
+   {
+      case OBJ_STREETLIGHT:
+         b = obj->th==5 ? stoplight_parts : streetlight_parts;
+         n = 2;
+         break;
+      case OBJ_ARCH:
+         b = arch_parts;
+         n = sizeof(arch_parts)/sizeof(arch_parts[0]);
+         break;
+      case OBJ_SKYSCRAPER:
+         b = skyscraper_parts;
+         n = sizeof(skyscraper_parts)/sizeof(skyscraper_parts[0]);
+         break;
+      default:
+         ObjectBounds(obj,part[0][0],part[0][1]);
+         return 1;
+   }
+   for (k=0;k<n;k++)
+   {
+      part[k][0][0] = obj->x+b[k][0][0];  part[k][1][0] = obj->x+b[k][1][0];
+      part[k][0][1] = obj->y+b[k][0][1];  part[k][1][1] = obj->y+b[k][1][1];
+      part[k][0][2] = obj->z+b[k][0][2];  part[k][1][2] = obj->z+b[k][1][2];
+   }
+   return n;
+}
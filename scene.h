@@ -0,0 +1,52 @@
+/*
+ *  Static scene description
+ *
+ *  Every object display() draws is one entry in the scene table, so the
+ *  per-frame work (culling, level of detail, ordering) can be done on data
+ *  instead of by calling the draw functions.
+ */
+#ifndef SCENE_H
+#define SCENE_H
+
+#define OBJ_PARTS 3  //  Most solid boxes of one object
+
+//  Object types
+enum
+{
+   OBJ_FRAME,        //  city_frame
+   OBJ_GROUND,       //  draw_ground
+   OBJ_STREETLIGHT,  //  draw_streetlights
+   OBJ_LAMP,         //  draw_lamp
+   OBJ_ARCH,         //  draw_arch_building
+   OBJ_SKYSCRAPER,   //  draw_skyscraper
+   OBJ_TYPES
+};
+
+//  Object placement (the arguments of its draw function)
+typedef struct
+{
+   int    type;      //  Object type
+   double x,y,z;     //  Position
+   double dx,dy,dz;  //  Scale
+   double th;        //  Angle or variant
+} object_t;
+
+//  Occluder quad (corners relative to the object position)
+typedef float occluder_t[4][3];
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const object_t scene[];
+extern const int      Nscene;
+
+void ObjectBounds(const object_t* obj,float min[3],float max[3]);
+int  ObjectParts(const object_t* obj,float part[][2][3]);
+const occluder_t* ObjectOccluder(const object_t* obj,int* n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ *  Spheres, cylinders, tori and the city frame disc
+ */
+#include "CSCIx229.h"
+#include "glstats.h"
+#include "shapes.h"
+#include "tables.h"
+
+static float* buf=NULL;  //  Cylinder vertices (normal and position)
+static int    Nbuf=0;    //  Floats allocated
+
+/*
+ *  Vertex in polar coordinates with normal
+ */
+static void Vertex(double th,double ph)
+{
+   double x = Sin(th)*Cos(ph);
+   double y = Cos(th)*Cos(ph);
+   double z =         Sin(ph);
+   //  For a sphere at the origin, the position
+   //  and normal vectors are the same
+   glNormal3d(x,y,z);
+   glVertex3d(x,y,z);
+}
+
+/*
+ *  Unit sphere as quad strips inc degrees apart
+ */
+void Sphere(int inc)
+{
+   int th,ph,k;
+   for (k=0;k<SPHERES;k++)
+      if (sphere_inc[k]==inc)
+      {
+         //  Each band is one strip of 2*(360/(2*inc)+1) vertices
+         int n = 2*(180/inc+1);
+         glEnableClientState(GL_VERTEX_ARRAY);
+         glEnableClientState(GL_NORMAL_ARRAY);
+         glVertexPointer(3,GL_FLOAT,0,sphere_v[k]);
+         glNormalPointer(GL_FLOAT,0,sphere_v[k]);
+         for (ph=0;ph<180/inc;ph++)
+            glDrawArrays(GL_QUAD_STRIP,n*ph,n);
+         glDisableClientState(GL_VERTEX_ARRAY);
+         glDisableClientState(GL_NORMAL_ARRAY);
+         return;
+      }
+   //  Bands of latitude
+   for (ph=-90;ph<90;ph+=inc)
+   {
+      glBegin(GL_QUAD_STRIP);
+      for (th=0;th<=360;th+=2*inc)
+      {
+         Vertex(th,ph);
+         Vertex(th,ph+inc);
+      }
+      glEnd();
+   }
+}
+
+/*
+ *  Shared quadric for cylinders without a table (created once)
+ */
+static GLUquadric* quadric()
+{
+   static GLUquadric* qobj=NULL;
+   if (!qobj)
+   {
+      qobj = gluNewQuadric();
+      gluQuadricNormals(qobj, GLU_SMOOTH);
+   }
+   return qobj;
+}
+
+/*
+ *  Cylinder along z with smooth normals
+ *    Same vertices and strips as gluCylinder
+ */
+void Cylinder(float base,float top,float height,int slices,int stacks)
+{
+   const float (*sc)[2] = NULL;
+   float dr = base-top;
+   float length = sqrt(dr*dr+height*height);
+   float xy = height/length;
+   float zn = dr/length;
+   int i,j,k,n=0,m;
+   for (k=0;k<CIRCLES;k++)
+      if (circle_slices[k]==slices)
+      {
+         sc = circle_v[k];
+         n  = circle_n[k];
+      }
+   if (!sc)
+   {
+      gluCylinder(quadric(),base,top,height,slices,stacks);
+      return;
+   }
+   //  Normal and position of every vertex, one strip per stack
+   m = 2*(n+1);
+   if (Nbuf<6*m*stacks)
+   {
+      Nbuf = 6*m*stacks;
+      buf = (float*)realloc(buf,Nbuf*sizeof(float));
+      if (!buf) Fatal("Cannot allocate %d floats for cylinder\n",Nbuf);
+   }
+   for (j=0;j<stacks;j++)
+   {
+      float z0 = j*height/stacks;
+      float z1 = (j+1)*height/stacks;
+      float r0 = base - dr*((float)j/stacks);
+      float r1 = base - dr*((float)(j+1)/stacks);
+      float* v = buf+6*m*j;
+      for (i=0;i<=n;i++)
+      {
+         float s = sc[i][0];
+         float c = sc[i][1];
+         v[0] = v[6] = xy*s;
+         v[1] = v[7] = xy*c;
+         v[2] = v[8] = zn;
+         v[3] = r0*s;  v[4] = r0*c;  v[5]  = z0;
+         v[9] = r1*s;  v[10] = r1*c; v[11] = z1;
+         v += 12;
+      }
+   }
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_NORMAL_ARRAY);
+   glNormalPointer(GL_FLOAT,6*sizeof(float),buf);
+   glVertexPointer(3,GL_FLOAT,6*sizeof(float),buf+3);
+   for (j=0;j<stacks;j++)
+      glDrawArrays(GL_QUAD_STRIP,m*j,m);
+   glDisableClientState(GL_VERTEX_ARRAY);
+   glDisableClientState(GL_NORMAL_ARRAY);
+}
+
+/*
+ *  Torus in the xy plane with tube radius r and center radius R
+ *    Same vertices and strips as glutSolidTorus
+ */
+void Torus(float r,float R,int sides,int rings)
+{
+   int i,k;
+   for (k=0;k<TORI;k++)
+      if (r==1 && R==2 && sides==rings && torus_sides[k]==sides)
+      {
+         int n = 2*(rings+1);
+         glEnableClientState(GL_VERTEX_ARRAY);
+         glEnableClientState(GL_NORMAL_ARRAY);
+         glVertexPointer(3,GL_FLOAT,0,torus_v[k]);
+         glNormalPointer(GL_FLOAT,0,torus_n[k]);
+         for (i=0;i<sides;i++)
+            glDrawElements(GL_TRIANGLE_STRIP,n,GL_UNSIGNED_SHORT,torus_i[k]+n*i);
+         glDisableClientState(GL_VERTEX_ARRAY);
+         glDisableClientState(GL_NORMAL_ARRAY);
+         return;
+      }
+   glutSolidTorus(r,R,sides,rings);
+}
+
+/*
+ *  Textured face of the city frame disc at z (+1 or -1)
+ *    The texture is mapped into st (s0,t0,s1,t1)
+ *    The caller sets the normal
+ */
+void DiscFace(int z,const float st[4])
+{
+   int k,n = sizeof(disc)/sizeof(disc[0]);
+   float s0=0.5*(st[0]+st[2]),t0=0.5*(st[1]+st[3]);
+   float ds=0.5*(st[2]-st[0]),dt=0.5*(st[3]-st[1]);
+   glBegin(GL_TRIANGLE_FAN);
+   glTexCoord2f(s0,t0);
+   glVertex3f(0,0,z);
+   for (k=0;k<n;k++)
+   {
+      glTexCoord2f(s0+ds*disc[k][0],t0+dt*disc[k][1]);
+      glVertex3f(z*disc[k][0],disc[k][1],z);
+   }
+   glEnd();
+}
+
+/*
+ *  Edge of the city frame disc between z=-1 and z=+1
+ *    The texture is mapped into st (s0,t0,s1,t1) once per segment, since
+ *    an atlas image cannot repeat
+ */
+void DiscEdge(const float st[4])
+{
+   int k,n = sizeof(disc)/sizeof(disc[0]);
+   glBegin(GL_QUADS);
+   for (k=0;k+1<n;k++)
+   {
+      double c0 = disc[k][0],  s0 = disc[k][1];
+      double c1 = disc[k+1][0],s1 = disc[k+1][1];
+      glNormal3f(c0,s0,0);
+      glTexCoord2f(st[0],st[1]); glVertex3f(c0,s0,+1);
+      glTexCoord2f(st[2],st[1]); glVertex3f(c0,s0,-1);
+      glNormal3f(c1,s1,0);
+      glTexCoord2f(st[2],st[3]); glVertex3f(c1,s1,-1);
+      glTexCoord2f(st[0],st[3]); glVertex3f(c1,s1,+1);
+   }
+   glEnd();
+}
@@ -0,0 +1,25 @@
+/*
+ *  Spheres, cylinders, tori and the city frame disc
+ *
+ *  The sizes used by the levels of detail are drawn as vertex arrays from
+ *  tables generated at build time (tessgen.c), so no sines or cosines are
+ *  computed while drawing.  Other sizes fall back to computing the shape.
+ */
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void Sphere(int inc);
+void Cylinder(float base,float top,float height,int slices,int stacks);
+void Torus(float r,float R,int sides,int rings);
+void DiscFace(int z,const float st[4]);
+void DiscEdge(const float st[4]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
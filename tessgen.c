@@ -0,0 +1,159 @@
+/*
+ *  Generate the tessellation tables used by shapes.c
+ *
+ *  make runs this to write tables.h, so the sines and cosines of the
+ *  standard shapes are worked out once at build time and the tables are
+ *  read-only data in the executable.  Each table repeats the arithmetic of
+ *  the code it replaces (the Cos/Sin macros, gluCylinder and
+ *  glutSolidTorus) so the geometry is unchanged.
+ *
+ *  The sizes are the levels of detail in city.c.  Shapes asked for with
+ *  other sizes are computed at run time as before.
+ */
+#include <stdio.h>
+#include <math.h>
+
+//  As in CSCIx229.h
+#define Cos(th) cos(3.1415926/180*(th))
+#define Sin(th) sin(3.1415926/180*(th))
+
+//  Sizes to generate
+static const int sphere[] = {10,15,30};    //  Sphere increments (degrees)
+static const int cyl[]    = {20000,64,16}; //  Cylinder slices
+static const int torus[]  = {100,32,12};   //  Torus sides and rings
+#define N(a) (int)(sizeof(a)/sizeof(a[0]))
+
+//  gluCylinder caches at most this many slices less one
+#define GLU_CACHE 240
+
+/*
+ *  Unit sphere as quad strips of latitude inc
+ *    Position and normal are the same
+ */
+static void Sphere(int inc)
+{
+   int th,ph,n=0;
+   printf("static const float sphere%d[][3] =\n{\n",inc);
+   for (ph=-90;ph<90;ph+=inc)
+      for (th=0;th<=360;th+=2*inc)
+      {
+         int k;
+         for (k=0;k<2;k++)
+         {
+            int p = ph+k*inc;
+            printf("   {%.9g,%.9g,%.9g},\n",(float)(Sin(th)*Cos(p)),(float)(Cos(th)*Cos(p)),(float)Sin(p));
+            n++;
+         }
+      }
+   printf("};  //  %d vertices\n\n",n);
+}
+
+/*
+ *  Sine and cosine of each slice as gluCylinder computes them
+ */
+static void Circle(int slices)
+{
+   int i,n = slices<GLU_CACHE ? slices : GLU_CACHE-1;
+   printf("static const float circle%d[][2] =\n{\n",slices);
+   for (i=0;i<=n;i++)
+   {
+      float angle = 2*M_PI*(i%n)/n;
+      printf("   {%.9g,%.9g},\n",(float)sin(angle),(float)cos(angle));
+   }
+   printf("};\n\n");
+}
+
+/*
+ *  Torus vertices, normals and strip indices as glutSolidTorus makes them
+ *    Inner radius 1, outer radius 2
+ */
+static void Torus(int n)
+{
+   float s[2][n+1],c[2][n+1];
+   int i,j,k;
+   //  Circle tables (rings, then sides clockwise)
+   for (k=0;k<2;k++)
+   {
+      float angle = 2*(float)M_PI/(float)(k?-n:n);
+      s[k][0] = 0;
+      c[k][0] = 1;
+      for (i=1;i<n;i++)
+      {
+         s[k][i] = sin(angle*i);
+         c[k][i] = cos(angle*i);
+      }
+   }
+   printf("static const float torus%d_v[][3] =\n{\n",n);
+   for (j=0;j<n;j++)
+      for (i=0;i<n;i++)
+         printf("   {%.9g,%.9g,%.9g},\n",c[0][j]*(2.0f+c[1][i]*1.0f),s[0][j]*(2.0f+c[1][i]*1.0f),s[1][i]*1.0f);
+   printf("};\n\n");
+   printf("static const float torus%d_n[][3] =\n{\n",n);
+   for (j=0;j<n;j++)
+      for (i=0;i<n;i++)
+         printf("   {%.9g,%.9g,%.9g},\n",c[0][j]*c[1][i],s[0][j]*c[1][i],s[1][i]);
+   printf("};\n\n");
+   //  One strip per side, closed by repeating the first ring
+   printf("static const unsigned short torus%d_i[] =\n{\n",n);
+   for (i=0;i<n;i++)
+   {
+      int ioff = i==n-1 ? -i : 1;
+      printf("  ");
+      for (j=0;j<=n;j++)
+         printf(" %d,%d,",(j%n)*n+i,(j%n)*n+i+ioff);
+      printf("\n");
+   }
+   printf("};\n\n");
+}
+
+/*
+ *  Generate all tables
+ */
+int main(void)
+{
+   int k;
+   printf("/*\n *  Tessellation tables (generated by tessgen, do not edit)\n */\n\n");
+
+   //  Spheres
+   for (k=0;k<N(sphere);k++)
+      Sphere(sphere[k]);
+   printf("#define SPHERES %d\n",N(sphere));
+   printf("static const int sphere_inc[] = {");
+   for (k=0;k<N(sphere);k++) printf("%s%d",k?",":"",sphere[k]);
+   printf("};\nstatic const float (*const sphere_v[])[3] = {");
+   for (k=0;k<N(sphere);k++) printf("%ssphere%d",k?",":"",sphere[k]);
+   printf("};\n\n");
+
+   //  Cylinders
+   for (k=0;k<N(cyl);k++)
+      Circle(cyl[k]);
+   printf("#define CIRCLES %d\n",N(cyl));
+   printf("static const int circle_slices[] = {");
+   for (k=0;k<N(cyl);k++) printf("%s%d",k?",":"",cyl[k]);
+   printf("};\nstatic const int circle_n[] = {");
+   for (k=0;k<N(cyl);k++) printf("%s%d",k?",":"",cyl[k]<GLU_CACHE?cyl[k]:GLU_CACHE-1);
+   printf("};\nstatic const float (*const circle_v[])[2] = {");
+   for (k=0;k<N(cyl);k++) printf("%scircle%d",k?",":"",cyl[k]);
+   printf("};\n\n");
+
+   //  Tori
+   for (k=0;k<N(torus);k++)
+      Torus(torus[k]);
+   printf("#define TORI %d\n",N(torus));
+   printf("static const int torus_sides[] = {");
+   for (k=0;k<N(torus);k++) printf("%s%d",k?",":"",torus[k]);
+   printf("};\nstatic const float (*const torus_v[])[3] = {");
+   for (k=0;k<N(torus);k++) printf("%storus%d_v",k?",":"",torus[k]);
+   printf("};\nstatic const float (*const torus_n[])[3] = {");
+   for (k=0;k<N(torus);k++) printf("%storus%d_n",k?",":"",torus[k]);
+   printf("};\nstatic const unsigned short* const torus_i[] = {");
+   for (k=0;k<N(torus);k++) printf("%storus%d_i",k?",":"",torus[k]);
+   printf("};\n\n");
+
+   //  City frame disc (10 degree steps, as doubles like Cos/Sin)
+   printf("static const double disc[][2] =\n{\n");
+   for (k=0;k<=360;k+=10)
+      printf("   {%.17g,%.17g},\n",Cos(k),Sin(k));
+   printf("};\n");
+   return 0;
+}
@@ -0,0 +1,365 @@
+/*
+ *  Single precision vectors, matrices and a CPU matrix stack
+ *
+ *  Matrix element (row i, column j) is m[4*j+i].  The stack keeps the
+ *  current matrix on top and a flag telling whether OpenGL has a stale copy.
+ *  While recording or replaying, the camera is kept aside in view.
+ */
+#include "CSCIx229.h"
+#include "glstats.h"
+#include "vecmath.h"
+
+static mat4_t stack[MAT_DEPTH];  //  Matrix stack
+static int    top=0;             //  Current matrix
+static int    dirty=1;           //  OpenGL modelview differs from the top
+static int    mode=0;            //  0=compute 1=record 2=replay
+static mat4_t view;              //  Camera while recording or replaying
+static mat4_t* part=NULL;        //  Recorded or replayed world matrices
+static int    Npart=0;           //  Matrices used so far
+static int    Mpart=0;           //  Matrices available to replay
+
+/*
+ *  Vector from components
+ */
+vec3_t Vec3(float x,float y,float z)
+{
+   vec3_t v = {x,y,z};
+   return v;
+}
+
+/*
+ *  a+b
+ */
+vec3_t Vec3Add(vec3_t a,vec3_t b)
+{
+   return Vec3(a.x+b.x,a.y+b.y,a.z+b.z);
+}
+
+/*
+ *  a-b
+ */
+vec3_t Vec3Sub(vec3_t a,vec3_t b)
+{
+   return Vec3(a.x-b.x,a.y-b.y,a.z-b.z);
+}
+
+/*
+ *  s*a
+ */
+vec3_t Vec3Scale(vec3_t a,float s)
+{
+   return Vec3(s*a.x,s*a.y,s*a.z);
+}
+
+/*
+ *  a.b
+ */
+float Vec3Dot(vec3_t a,vec3_t b)
+{
+   return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+/*
+ *  a x b
+ */
+vec3_t Vec3Cross(vec3_t a,vec3_t b)
+{
+   return Vec3(a.y*b.z-a.z*b.y,a.z*b.x-a.x*b.z,a.x*b.y-a.y*b.x);
+}
+
+/*
+ *  |a|
+ */
+float Vec3Length(vec3_t a)
+{
+   return sqrtf(Vec3Dot(a,a));
+}
+
+/*
+ *  a/|a| (zero vector unchanged)
+ */
+vec3_t Vec3Normalize(vec3_t a)
+{
+   float l = Vec3Length(a);
+   return l>0 ? Vec3Scale(a,1/l) : a;
+}
+
+/*
+ *  m = I
+ */
+void Mat4Identity(mat4_t* m)
+{
+   static const mat4_t I = {{1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1}};
+   *m = I;
+}
+
+/*
+ *  r = a*b (r may be a or b)
+ */
+void Mat4Mul(mat4_t* r,const mat4_t* a,const mat4_t* b)
+{
+   mat4_t t;
+   int j;
+#ifdef __SSE__
+   //  Column j of the product is a times column j of b
+   for (j=0;j<4;j++)
+      t.c[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a->c[0],_mm_set1_ps(b->m[4*j  ])),
+                                     _mm_mul_ps(a->c[1],_mm_set1_ps(b->m[4*j+1]))),
+                          _mm_add_ps(_mm_mul_ps(a->c[2],_mm_set1_ps(b->m[4*j+2])),
+                                     _mm_mul_ps(a->c[3],_mm_set1_ps(b->m[4*j+3]))));
+#else
+   int i;
+   for (j=0;j<4;j++)
+      for (i=0;i<4;i++)
+         t.m[4*j+i] = a->m[i]*b->m[4*j] + a->m[4+i]*b->m[4*j+1] + a->m[8+i]*b->m[4*j+2] + a->m[12+i]*b->m[4*j+3];
+#endif
+   *r = t;
+}
+
+/*
+ *  m = m*T(x,y,z)
+ */
+void Mat4Translate(mat4_t* m,float x,float y,float z)
+{
+   int i;
+   for (i=0;i<4;i++)
+      m->m[12+i] += m->m[i]*x + m->m[4+i]*y + m->m[8+i]*z;
+}
+
+/*
+ *  m = m*S(x,y,z)
+ */
+void Mat4Scale(mat4_t* m,float x,float y,float z)
+{
+   int i;
+   for (i=0;i<4;i++)
+   {
+      m->m[i]   *= x;
+      m->m[4+i] *= y;
+      m->m[8+i] *= z;
+   }
+}
+
+/*
+ *  m = m*R(th,x,y,z)
+ *    th is in degrees and the axis need not be unit length.  Like glRotate
+ *    a (near) zero axis leaves m unchanged.  Multiples of 90 degrees use
+ *    exact sines so axis aligned rotations add no rounding.
+ */
+void Mat4Rotate(mat4_t* m,float th,float x,float y,float z)
+{
+   float R[3][3],c[3][4],s,co,C;
+   float xx,yy,zz,xy,yz,zx,xs,ys,zs;
+   float l = sqrtf(x*x+y*y+z*z);
+   int i,j;
+   if (l<=1e-4) return;
+   x /= l;  y /= l;  z /= l;
+   th = fmodf(th,360);
+   if (th<0) th += 360;
+   if (th==0)        {s =  0; co =  1;}
+   else if (th==90)  {s =  1; co =  0;}
+   else if (th==180) {s =  0; co = -1;}
+   else if (th==270) {s = -1; co =  0;}
+   else
+   {
+      s  = sinf(th*(float)(M_PI/180));
+      co = cosf(th*(float)(M_PI/180));
+   }
+   //  R[i][j] is row i column j
+   C = 1-co;
+   xx = x*x;  yy = y*y;  zz = z*z;
+   xy = x*y;  yz = y*z;  zx = z*x;
+   xs = x*s;  ys = y*s;  zs = z*s;
+   R[0][0] = C*xx+co;  R[0][1] = C*xy-zs;  R[0][2] = C*zx+ys;
+   R[1][0] = C*xy+zs;  R[1][1] = C*yy+co;  R[1][2] = C*yz-xs;
+   R[2][0] = C*zx-ys;  R[2][1] = C*yz+xs;  R[2][2] = C*zz+co;
+   //  Only the first three columns change
+   memcpy(c,m->m,sizeof(c));
+   for (j=0;j<3;j++)
+      for (i=0;i<4;i++)
+         m->m[4*j+i] = c[0][i]*R[0][j] + c[1][i]*R[1][j] + c[2][i]*R[2][j];
+}
+
+/*
+ *  m*v
+ */
+vec4_t Mat4Transform(const mat4_t* m,vec4_t v)
+{
+   vec4_t r;
+#ifdef __SSE__
+   r.q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m->c[0],_mm_set1_ps(v.v[0])),
+                               _mm_mul_ps(m->c[1],_mm_set1_ps(v.v[1]))),
+                    _mm_add_ps(_mm_mul_ps(m->c[2],_mm_set1_ps(v.v[2])),
+                               _mm_mul_ps(m->c[3],_mm_set1_ps(v.v[3]))));
+#else
+   int i;
+   for (i=0;i<4;i++)
+      r.v[i] = m->m[i]*v.v[0] + m->m[4+i]*v.v[1] + m->m[8+i]*v.v[2] + m->m[12+i]*v.v[3];
+#endif
+   return r;
+}
+
+/*
+ *  Transform point p (w=1, no divide)
+ */
+vec3_t Mat4Point(const mat4_t* m,vec3_t p)
+{
+   return Vec3(m->m[0]*p.x + m->m[4]*p.y + m->m[8] *p.z + m->m[12],
+               m->m[1]*p.x + m->m[5]*p.y + m->m[9] *p.z + m->m[13],
+               m->m[2]*p.x + m->m[6]*p.y + m->m[10]*p.z + m->m[14]);
+}
+
+/*
+ *  Normal matrix of m (inverse transpose of the upper 3x3, column major)
+ *    The cofactors divided by the determinant
+ */
+void Mat4Normal(const mat4_t* m,float n[9])
+{
+   const float* a = m->m;
+   float det;
+   int i;
+   n[0] = a[5]*a[10]-a[6]*a[9];
+   n[1] = a[6]*a[8] -a[4]*a[10];
+   n[2] = a[4]*a[9] -a[5]*a[8];
+   n[3] = a[9]*a[2] -a[10]*a[1];
+   n[4] = a[10]*a[0]-a[8]*a[2];
+   n[5] = a[8]*a[1] -a[9]*a[0];
+   n[6] = a[1]*a[6] -a[2]*a[5];
+   n[7] = a[2]*a[4] -a[0]*a[6];
+   n[8] = a[0]*a[5] -a[1]*a[4];
+   det = a[0]*n[0] + a[1]*n[1] + a[2]*n[2];
+   if (det==0) return;
+   for (i=0;i<9;i++)
+      n[i] /= det;
+}
+
+/*
+ *  Replace the current matrix
+ *    Normally the camera from glGetFloatv(GL_MODELVIEW_MATRIX)
+ */
+void MatLoad(const float m[16])
+{
+   memcpy(stack[top].m,m,sizeof(stack[top].m));
+   dirty = 1;
+}
+
+/*
+ *  Duplicate the current matrix
+ */
+void MatPush(void)
+{
+   if (mode==2) return;
+   if (top==MAT_DEPTH-1) Fatal("Matrix stack overflow\n");
+   stack[top+1] = stack[top];
+   top++;
+}
+
+/*
+ *  Return to the matrix saved by MatPush
+ */
+void MatPop(void)
+{
+   if (mode==2) return;
+   if (top==0) Fatal("Matrix stack underflow\n");
+   top--;
+   dirty = 1;
+}
+
+/*
+ *  Multiply the current matrix by a translation
+ */
+void MatTranslate(float x,float y,float z)
+{
+   if (mode==2) return;
+   Mat4Translate(stack+top,x,y,z);
+   dirty = 1;
+}
+
+/*
+ *  Multiply the current matrix by a rotation of th degrees about (x,y,z)
+ */
+void MatRotate(float th,float x,float y,float z)
+{
+   if (mode==2) return;
+   Mat4Rotate(stack+top,th,x,y,z);
+   dirty = 1;
+}
+
+/*
+ *  Multiply the current matrix by a scale
+ */
+void MatScale(float x,float y,float z)
+{
+   if (mode==2) return;
+   Mat4Scale(stack+top,x,y,z);
+   dirty = 1;
+}
+
+/*
+ *  Current matrix
+ */
+const mat4_t* MatTop(void)
+{
+   return stack+top;
+}
+
+/*
+ *  Make the OpenGL modelview matrix equal the current matrix
+ *    Call before drawing and after the last MatPop
+ */
+void MatSync(void)
+{
+   mat4_t m;
+   //  Camera times the next world matrix
+   if (mode)
+   {
+      if (mode==1 && Npart==MAT_PARTS)
+         Fatal("More than %d matrices recorded for one object\n",MAT_PARTS);
+      if (mode==2 && Npart==Mpart)
+         Fatal("Only %d matrices recorded for this object\n",Mpart);
+      if (mode==1) part[Npart] = stack[top];
+      Mat4Mul(&m,&view,part+Npart++);
+      glLoadMatrixf(m.m);
+      return;
+   }
+   if (!dirty) return;
+   glLoadMatrixf(stack[top].m);
+   dirty = 0;
+}
+
+/*
+ *  Save the world matrix of every MatSync in world (MAT_PARTS long)
+ */
+void MatRecord(mat4_t* world)
+{
+   view = stack[top];
+   Mat4Identity(stack+top);
+   part  = world;
+   Npart = 0;
+   mode  = 1;
+}
+
+/*
+ *  Use the n matrices saved by MatRecord instead of the transform calls
+ */
+void MatReplay(const mat4_t* world,int n)
+{
+   view  = stack[top];
+   part  = (mat4_t*)world;
+   Npart = 0;
+   Mpart = n;
+   mode  = 2;
+}
+
+/*
+ *  Stop recording or replaying
+ *    Returns the number of matrices used
+ */
+int MatEnd(void)
+{
+   if (mode==1 && top) Fatal("Matrix stack not balanced while recording\n");
+   stack[top] = view;
+   mode  = 0;
+   dirty = 1;
+   return Npart;
+}
@@ -0,0 +1,86 @@
+/*
+ *  Single precision vectors, matrices and a CPU matrix stack
+ *
+ *  Matrices are column major like OpenGL so they can be passed straight to
+ *  glLoadMatrixf.  With SSE the columns are kept in registers and products
+ *  are four multiply-adds per column.  The stack follows the fixed function
+ *  conventions: MatTranslate, MatRotate and MatScale multiply on the right,
+ *  and MatRotate normalizes its axis as glRotate does.  Nothing is sent to
+ *  OpenGL until MatSync, so transforms can be computed and kept without a
+ *  current context.
+ *
+ *  Between MatRecord and MatEnd the stack starts from the identity, so each
+ *  MatSync saves a world matrix and uploads it times the camera.  Between
+ *  MatReplay and MatEnd the transform calls are skipped and each MatSync
+ *  uploads the next saved matrix instead.
+ */
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define MAT_DEPTH 32  //  Matrix stack depth
+#define MAT_PARTS 64  //  Most matrices recorded for one object
+
+typedef struct
+{
+   float x,y,z;
+} vec3_t;
+
+typedef union
+{
+   float v[4];
+#ifdef __SSE__
+   __m128 q;
+#endif
+} vec4_t;
+
+typedef union
+{
+   float m[16];    //  Column major
+#ifdef __SSE__
+   __m128 c[4];    //  Columns
+#endif
+} mat4_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+vec3_t Vec3(float x,float y,float z);
+vec3_t Vec3Add(vec3_t a,vec3_t b);
+vec3_t Vec3Sub(vec3_t a,vec3_t b);
+vec3_t Vec3Scale(vec3_t a,float s);
+float  Vec3Dot(vec3_t a,vec3_t b);
+vec3_t Vec3Cross(vec3_t a,vec3_t b);
+float  Vec3Length(vec3_t a);
+vec3_t Vec3Normalize(vec3_t a);
+
+void   Mat4Identity(mat4_t* m);
+void   Mat4Mul(mat4_t* r,const mat4_t* a,const mat4_t* b);
+void   Mat4Translate(mat4_t* m,float x,float y,float z);
+void   Mat4Rotate(mat4_t* m,float th,float x,float y,float z);
+void   Mat4Scale(mat4_t* m,float x,float y,float z);
+vec4_t Mat4Transform(const mat4_t* m,vec4_t v);
+vec3_t Mat4Point(const mat4_t* m,vec3_t p);
+void   Mat4Normal(const mat4_t* m,float n[9]);
+
+void   MatLoad(const float m[16]);
+void   MatPush(void);
+void   MatPop(void);
+void   MatTranslate(float x,float y,float z);
+void   MatRotate(float th,float x,float y,float z);
+void   MatScale(float x,float y,float z);
+const mat4_t* MatTop(void);
+void   MatSync(void);
+void   MatRecord(mat4_t* world);
+void   MatReplay(const mat4_t* world,int n);
+int    MatEnd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
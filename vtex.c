@@ -0,0 +1,743 @@
+/*
+ *  Virtual texture for the ground
+ *
+ *  The file is a header followed by the tiles of level 0 row by row, then
+ *  the tiles of level 1 and so on up to the single tile of the coarsest
+ *  level.  A stored tile is VT_STRIDE x VT_STRIDE RGB texels, the tile and
+ *  its border, with the bottom row first.
+ */
+#include "CSCIx229.h"
+#include "glstats.h"
+#include "vtex.h"
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define VT_STRIDE (VT_TILE+2*VT_BORDER)  //  Texels on a side of a stored tile
+#define VT_CACHE  (VT_SLOTS*VT_STRIDE)   //  Texels on a side of the cache
+#define VT_LEVELS 16                     //  Most mipmap levels
+#define VT_MAGIC  0x31305456             //  "VT01"
+
+//  File header
+typedef struct
+{
+   unsigned int magic;   //  VT_MAGIC
+   int          size;    //  Texels on a side of level 0
+   int          tile;    //  VT_TILE
+   int          border;  //  VT_BORDER
+   int          blocks;  //  Ground blocks
+   int          levels;  //  Mipmap levels
+} header_t;
+
+//  Tile read by the loader
+typedef struct
+{
+   int            tile;  //  Tile index
+   unsigned char* pix;   //  Texels
+} loaded_t;
+
+int vtex = 1;
+
+static header_t       hdr;                      //  Header of the open file
+static int            grid;                     //  Blocks on a side
+static int            first[VT_LEVELS];         //  Index of the first tile of each level
+static int            Ntile=0;                  //  Tiles in all levels
+static unsigned char* level=NULL;               //  Level of each tile
+static int*           slotof=NULL;              //  Cache slot of each tile (-1 if none)
+static int*           used=NULL;                //  Frame each tile was last needed
+static char*          pending=NULL;             //  Tile is being read
+static int*           miss=NULL;                //  Tiles needed and not resident
+static int            tileat[VT_SLOTS*VT_SLOTS];//  Tile in each slot (-1 if free)
+static unsigned char* table[VT_LEVELS];         //  Page table levels (RGBA)
+static int            dirty=0;                  //  Page table changed
+static int            Nres=0,Nload=0;           //  Tiles resident and being read
+static unsigned int   cache=0,ptex=0;           //  Cache and page table textures
+static unsigned int   prog[2];                  //  Draw and feedback programs
+static int            replace;                  //  Location of the Replace uniform
+static int            feedback=0;               //  Drawing feedback
+static int            active=-1;                //  Program in use (-1 if none)
+static unsigned int   fbo=0,color=0,depth=0;    //  Feedback target
+static int            fw=0,fh=0;                //  Feedback size
+static int            prev;                     //  Framebuffer bound before feedback
+static unsigned int   pbo[2];                   //  Feedback read back on alternate frames
+static int            pw[2],ph[2];              //  Size of the feedback in each PBO
+static int            filled[2];                //  PBO holds feedback
+static int            frame=0;                  //  Frame number
+//  Loader thread
+static FILE*           file=NULL;
+static int*            queue=NULL;              //  Tiles to read (ring)
+static int             qhead=0,Nqueue=0;
+static loaded_t*       done=NULL;               //  Tiles read (ring)
+static int             dhead=0,Ndone=0;
+static pthread_t       loader;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond = PTHREAD_COND_INITIALIZER;
+
+//  Look up the tile and level each pixel needs in the page table, then the
+//  texel in the cache.  Vertices are transformed and lit by the
+//  fixed-function pipeline.
+static const char* draw_frag =
+   "#version 120\n"
+   "uniform sampler2D Table;\n"
+   "uniform sampler2D Cache;\n"
+   "uniform float Size;\n"
+   "uniform float Tile;\n"
+   "uniform float Border;\n"
+   "uniform float Stride;\n"
+   "uniform float Slots;\n"
+   "uniform float Bias;\n"
+   "uniform bool Replace;\n"
+   "void main()\n"
+   "{\n"
+   "   vec2 uv = gl_TexCoord[0].st;\n"
+   "   //  A page table texel covers a tile, so bias by log2(Tile) for the texel level\n"
+   "   vec3 e = floor(255.0*texture2D(Table,uv,Bias).rgb+0.5);\n"
+   "   vec2 t = fract(uv*Size/(Tile*exp2(e.b)));\n"
+   "   vec4 c = texture2D(Cache,(e.rg*Stride+Border+t*Tile)/(Slots*Stride));\n"
+   "   gl_FragColor = Replace ? c : c*gl_Color;\n"
+   "}\n";
+
+//  Write the tile and level each pixel needs
+//  (at 1/VT_SCALE resolution, so log2(VT_SCALE) less detail than it seems)
+static const char* feedback_frag =
+   "#version 120\n"
+   "uniform float Size;\n"
+   "uniform float Tile;\n"
+   "uniform float Levels;\n"
+   "uniform float Scale;\n"
+   "void main()\n"
+   "{\n"
+   "   vec2 uv = gl_TexCoord[0].st*Size;\n"
+   "   vec2 dx = dFdx(uv);\n"
+   "   vec2 dy = dFdy(uv);\n"
+   "   float lod = 0.5*log2(max(dot(dx,dx),dot(dy,dy)))-Scale;\n"
+   "   float l = clamp(floor(lod+0.5),0.0,Levels-1.0);\n"
+   "   float n = Size/(Tile*exp2(l));\n"
+   "   vec2 t = clamp(floor(uv/(Tile*exp2(l))),0.0,n-1.0);\n"
+   "   gl_FragColor = vec4(t,l,255.0)/255.0;\n"
+   "}\n";
+
+/*
+ *  Tiles on a side of level l
+ */
+static int Tiles(int l)
+{
+   return (hdr.size/VT_TILE)>>l;
+}
+
+/*
+ *  Hash of three integers
+ */
+static unsigned int Hash(unsigned int x,unsigned int y,unsigned int z)
+{
+   unsigned int h = x*0x8DA6B343 ^ y*0xD8163841 ^ z*0xCB1AB31F;
+   h ^= h>>13;
+   h *= 0x5BD1E995;
+   return h^(h>>15);
+}
+
+/*
+ *  Smooth value noise in [0,1] with a lattice every 2^shift texels
+ */
+static float Noise(int b,int i,int j,int shift)
+{
+   int   x = i>>shift,y = j>>shift;
+   float fx = (i&((1<<shift)-1))/(float)(1<<shift);
+   float fy = (j&((1<<shift)-1))/(float)(1<<shift);
+   float n00 = (Hash(x  ,y  ,b)&0xFFFF)/65535.0;
+   float n10 = (Hash(x+1,y  ,b)&0xFFFF)/65535.0;
+   float n01 = (Hash(x  ,y+1,b)&0xFFFF)/65535.0;
+   float n11 = (Hash(x+1,y+1,b)&0xFFFF)/65535.0;
+   fx = fx*fx*(3-2*fx);
+   fy = fy*fy*(3-2*fy);
+   return (n00*(1-fx)+n10*fx)*(1-fy) + (n01*(1-fx)+n11*fx)*fy;
+}
+
+//  Making the file
+static unsigned char* src=NULL;          //  Source image
+static int            sw,sh,srow;        //  Its size and row length
+static unsigned char* ring[VT_LEVELS];   //  Last VT_STRIDE rows of each level
+static FILE*          out=NULL;          //  File being written
+static const char*    outname;
+
+/*
+ *  Row y of level l in its ring
+ */
+static unsigned char* Ring(int l,int y)
+{
+   return ring[l]+3*(size_t)(hdr.size>>l)*(y%VT_STRIDE);
+}
+
+/*
+ *  Make row j of level 0
+ *    Each block is the source with its own tint, grime and grain
+ */
+static void Texels(int j,unsigned char* p)
+{
+   int i,k;
+   for (i=0;i<hdr.size;i++,p+=3)
+   {
+      int b = (j/VT_BLOCK)*grid+i/VT_BLOCK;
+      if (i>=grid*VT_BLOCK || j>=grid*VT_BLOCK || b>=hdr.blocks)
+         p[0] = p[1] = p[2] = 64;
+      else
+      {
+         //  Bilinear sample of the source
+         float x = ((i%VT_BLOCK)+0.5)*sw/VT_BLOCK-0.5;
+         float y = ((j%VT_BLOCK)+0.5)*sh/VT_BLOCK-0.5;
+         int   x0 = x<0 ? 0 : (int)x,y0 = y<0 ? 0 : (int)y;
+         int   x1 = x0+1<sw ? x0+1 : sw-1,y1 = y0+1<sh ? y0+1 : sh-1;
+         float fx = x<0 ? 0 : x-x0,fy = y<0 ? 0 : y-y0;
+         float grime = 0.75+0.25*Noise(b,i,j,6)+0.1*Noise(b+7919,i,j,3);
+         int   grain = (int)(Hash(i,j,b)&15)-8;
+         for (k=0;k<3;k++)
+         {
+            float tint = 0.9+0.2*((Hash(b,k,0)&255)/255.0);
+            float c = (src[srow*y0+3*x0+k]*(1-fx)+src[srow*y0+3*x1+k]*fx)*(1-fy)
+                    + (src[srow*y1+3*x0+k]*(1-fx)+src[srow*y1+3*x1+k]*fx)*fy;
+            c = c*tint*grime+grain;
+            p[k] = c<0 ? 0 : c>255 ? 255 : (unsigned char)c;
+         }
+      }
+   }
+}
+
+/*
+ *  Write the tiles of row ty of level l with borders from their neighbours
+ *    The rows they cover are still in the ring
+ */
+static void Emit(int l,int ty)
+{
+   unsigned char tile[3*VT_STRIDE*VT_STRIDE];
+   int W = hdr.size>>l,T = Tiles(l),tx,i,j;
+   if (fseek(out,sizeof(header_t)+(first[l]+ty*T)*(long)sizeof(tile),SEEK_SET)) Fatal("Cannot write %s\n",outname);
+   for (tx=0;tx<T;tx++)
+   {
+      for (j=0;j<VT_STRIDE;j++)
+      {
+         int y = ty*VT_TILE+j-VT_BORDER;
+         const unsigned char* r;
+         if (y<0) y = 0;
+         if (y>=W) y = W-1;
+         r = Ring(l,y);
+         for (i=0;i<VT_STRIDE;i++)
+         {
+            int x = tx*VT_TILE+i-VT_BORDER;
+            if (x<0) x = 0;
+            if (x>=W) x = W-1;
+            memcpy(tile+3*(j*VT_STRIDE+i),r+3*x,3);
+         }
+      }
+      if (fwrite(tile,sizeof(tile),1,out)!=1) Fatal("Cannot write %s\n",outname);
+   }
+}
+
+/*
+ *  Row y of level l is in its ring
+ *    Writes the row of tiles it completes, and every second row makes a
+ *    row of the next level with a 2x2 box filter
+ */
+static void Row(int l,int y)
+{
+   int W = hdr.size>>l,ty,i,k;
+   //  Tiles whose last row (with border) this is
+   for (ty=0;ty<Tiles(l);ty++)
+   {
+      int last = ty*VT_TILE+VT_TILE+VT_BORDER-1;
+      if ((last<W ? last : W-1)==y) Emit(l,ty);
+   }
+   //  Next level
+   if (l+1<hdr.levels && (y&1))
+   {
+      const unsigned char* a = Ring(l,y-1);
+      const unsigned char* b = Ring(l,y);
+      unsigned char* c = Ring(l+1,y/2);
+      for (i=0;i<W/2;i++)
+         for (k=0;k<3;k++)
+            c[3*i+k] = (a[6*i+k]+a[6*i+3+k]+b[6*i+k]+b[6*i+3+k]+2)/4;
+      Row(l+1,y/2);
+   }
+}
+
+/*
+ *  Write the virtual texture of blocks made from the source image
+ *    Level 0 is made a row at a time and each level only keeps the rows
+ *    its next row of tiles needs, so the whole texture is never in memory
+ */
+static void Create(const char* name,const char* source)
+{
+   int j,l;
+   double t0 = Elapsed();
+   src = ReadBMP(source,&sw,&sh);
+   if (!src) Fatal("Cannot make virtual texture from %s\n",source);
+   srow = (3*sw+3)&~3;
+   for (l=0;l<hdr.levels;l++)
+   {
+      ring[l] = (unsigned char*)malloc(3*(size_t)(hdr.size>>l)*VT_STRIDE);
+      if (!ring[l]) Fatal("Cannot allocate %dx%d virtual texture rows\n",hdr.size>>l,VT_STRIDE);
+   }
+   out = fopen(name,"wb");
+   outname = name;
+   if (!out || fwrite(&hdr,sizeof(hdr),1,out)!=1) Fatal("Cannot write %s\n",name);
+   for (j=0;j<hdr.size;j++)
+   {
+      Texels(j,Ring(0,j));
+      Row(0,j);
+   }
+   if (fclose(out)) Fatal("Cannot write %s\n",name);
+   out = NULL;
+   for (l=0;l<hdr.levels;l++)
+   {
+      free(ring[l]);
+      ring[l] = NULL;
+   }
+   free(src);
+   src = NULL;
+   printf("Made %s: %dx%d virtual texture for %d blocks in %d tiles in %.2fs\n",name,hdr.size,hdr.size,hdr.blocks,Ntile,Elapsed()-t0);
+}
+
+/*
+ *  True if the file needs to be made again
+ */
+static int Stale(const char* name,const char* source)
+{
+   struct stat sf,ss;
+   header_t h;
+   FILE* f;
+   if (stat(name,&sf) || (!stat(source,&ss) && ss.st_mtime>sf.st_mtime)) return 1;
+   f = fopen(name,"rb");
+   if (!f) return 1;
+   if (fread(&h,sizeof(h),1,f)!=1) h.magic = 0;
+   fclose(f);
+   return memcmp(&h,&hdr,sizeof(h))!=0;
+}
+
+/*
+ *  Read tiles in the order they were asked for
+ */
+static void* Loader(void* arg)
+{
+   const long size = 3*VT_STRIDE*VT_STRIDE;
+   for (;;)
+   {
+      int k;
+      unsigned char* pix;
+      pthread_mutex_lock(&lock);
+      while (!Nqueue)
+         pthread_cond_wait(&cond,&lock);
+      k = queue[qhead];
+      qhead = (qhead+1)%Ntile;
+      Nqueue--;
+      pthread_mutex_unlock(&lock);
+      pix = (unsigned char*)malloc(size);
+      if (!pix) Fatal("Cannot allocate virtual texture tile\n");
+      if (fseek(file,sizeof(header_t)+k*size,SEEK_SET) || fread(pix,size,1,file)!=1)
+         Fatal("Cannot read tile %d of virtual texture\n",k);
+      pthread_mutex_lock(&lock);
+      done[(dhead+Ndone)%Ntile].tile = k;
+      done[(dhead+Ndone)%Ntile].pix  = pix;
+      Ndone++;
+      pthread_mutex_unlock(&lock);
+   }
+   return NULL;
+}
+
+/*
+ *  Put tile k in cache slot s
+ */
+static void Place(int k,int s,const unsigned char* pix)
+{
+   if (tileat[s]>=0)
+      slotof[tileat[s]] = -1;
+   else
+      Nres++;
+   tileat[s] = k;
+   slotof[k] = s;
+   glBindTexture(GL_TEXTURE_2D,cache);
+   glTexSubImage2D(GL_TEXTURE_2D,0,(s%VT_SLOTS)*VT_STRIDE,(s/VT_SLOTS)*VT_STRIDE,VT_STRIDE,VT_STRIDE,GL_RGB,GL_UNSIGNED_BYTE,pix);
+   glBindTexture(GL_TEXTURE_2D,0);
+   dirty = 1;
+}
+
+/*
+ *  Point each tile at its slot or the slot of its nearest resident ancestor
+ */
+static void Table(void)
+{
+   int l,x,y;
+   glBindTexture(GL_TEXTURE_2D,ptex);
+   for (l=hdr.levels-1;l>=0;l--)
+   {
+      int T = Tiles(l);
+      for (y=0;y<T;y++)
+         for (x=0;x<T;x++)
+         {
+            int s = slotof[first[l]+y*T+x];
+            unsigned char* e = table[l]+4*(y*T+x);
+            if (s>=0)
+            {
+               e[0] = s%VT_SLOTS;
+               e[1] = s/VT_SLOTS;
+               e[2] = l;
+               e[3] = 255;
+            }
+            else
+               memcpy(e,table[l+1]+4*((y/2)*(T/2)+x/2),4);
+         }
+      glTexSubImage2D(GL_TEXTURE_2D,l,0,0,T,T,GL_RGBA,GL_UNSIGNED_BYTE,table[l]);
+   }
+   glBindTexture(GL_TEXTURE_2D,0);
+   dirty = 0;
+}
+
+/*
+ *  Compile and link a fragment shader
+ */
+static unsigned int Program(const char* name,const char* src)
+{
+   char log[2048];
+   int status;
+   unsigned int frag = glCreateShader(GL_FRAGMENT_SHADER);
+   unsigned int prog;
+   glShaderSource(frag,1,&src,NULL);
+   glCompileShader(frag);
+   glGetShaderiv(frag,GL_COMPILE_STATUS,&status);
+   if (!status)
+   {
+      glGetShaderInfoLog(frag,sizeof(log),NULL,log);
+      Fatal("Cannot compile %s shader\n%s\n",name,log);
+   }
+   prog = glCreateProgram();
+   glAttachShader(prog,frag);
+   glLinkProgram(prog);
+   glGetProgramiv(prog,GL_LINK_STATUS,&status);
+   if (!status)
+   {
+      glGetProgramInfoLog(prog,sizeof(log),NULL,log);
+      Fatal("Cannot link %s shader\n%s\n",name,log);
+   }
+   glDeleteShader(frag);
+   return prog;
+}
+
+/*
+ *  Open the virtual texture for blocks ground blocks, making it from the
+ *  source image if the file is missing or out of date
+ */
+void VTexOpen(const char* name,const char* source,int blocks)
+{
+   int k,l;
+   unsigned char* pix;
+   //  Blocks in a square of tiles
+   for (grid=1;grid*grid<blocks;grid++);
+   hdr.magic  = VT_MAGIC;
+   hdr.size   = VT_TILE;
+   while (hdr.size<grid*VT_BLOCK) hdr.size *= 2;
+   hdr.tile   = VT_TILE;
+   hdr.border = VT_BORDER;
+   hdr.blocks = blocks;
+   for (hdr.levels=1;(VT_TILE<<(hdr.levels-1))<hdr.size;hdr.levels++);
+   //  Feedback and the page table hold tile coordinates in 8 bits
+   if (Tiles(0)>256 || hdr.levels>VT_LEVELS) Fatal("Virtual texture too large (%d blocks need %d tiles on a side, 256 at most)\n",blocks,Tiles(0));
+   for (Ntile=0,l=0;l<hdr.levels;l++)
+   {
+      first[l] = Ntile;
+      Ntile += Tiles(l)*Tiles(l);
+   }
+   if (Stale(name,source)) Create(name,source);
+   file = fopen(name,"rb");
+   if (!file) Fatal("Cannot open %s\n",name);
+
+   //  Tile bookkeeping
+   level   = (unsigned char*)malloc(Ntile);
+   slotof  = (int*)malloc(Ntile*sizeof(int));
+   used    = (int*)calloc(Ntile,sizeof(int));
+   pending = (char*)calloc(Ntile,1);
+   miss    = (int*)malloc(Ntile*sizeof(int));
+   queue   = (int*)malloc(Ntile*sizeof(int));
+   done    = (loaded_t*)malloc(Ntile*sizeof(loaded_t));
+   if (!level || !slotof || !used || !pending || !miss || !queue || !done) Fatal("Cannot allocate virtual texture tables\n");
+   for (l=0;l<hdr.levels;l++)
+   {
+      table[l] = (unsigned char*)malloc(4*Tiles(l)*Tiles(l));
+      if (!table[l]) Fatal("Cannot allocate page table\n");
+      for (k=first[l];k<first[l]+Tiles(l)*Tiles(l);k++)
+         level[k] = l;
+   }
+   for (k=0;k<Ntile;k++)
+      slotof[k] = -1;
+   for (k=0;k<VT_SLOTS*VT_SLOTS;k++)
+      tileat[k] = -1;
+
+   //  Cache without mipmaps (each tile holds one level)
+   glGenTextures(1,&cache);
+   glBindTexture(GL_TEXTURE_2D,cache);
+   glTexImage2D(GL_TEXTURE_2D,0,GL_RGB8,VT_CACHE,VT_CACHE,0,GL_RGB,GL_UNSIGNED_BYTE,NULL);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+   //  Page table with one level per level of the virtual texture
+   glGenTextures(1,&ptex);
+   glBindTexture(GL_TEXTURE_2D,ptex);
+   for (l=0;l<hdr.levels;l++)
+      glTexImage2D(GL_TEXTURE_2D,l,GL_RGBA8,Tiles(l),Tiles(l),0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,hdr.levels-1);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST_MIPMAP_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+   glBindTexture(GL_TEXTURE_2D,0);
+
+   //  Shaders
+   prog[0] = Program("virtual texture",draw_frag);
+   glUseProgram(prog[0]);
+   glUniform1i(glGetUniformLocation(prog[0],"Table"),1);
+   glUniform1i(glGetUniformLocation(prog[0],"Cache"),2);
+   glUniform1f(glGetUniformLocation(prog[0],"Size"),hdr.size);
+   glUniform1f(glGetUniformLocation(prog[0],"Tile"),VT_TILE);
+   glUniform1f(glGetUniformLocation(prog[0],"Border"),VT_BORDER);
+   glUniform1f(glGetUniformLocation(prog[0],"Stride"),VT_STRIDE);
+   glUniform1f(glGetUniformLocation(prog[0],"Slots"),VT_SLOTS);
+   glUniform1f(glGetUniformLocation(prog[0],"Bias"),log2(VT_TILE));
+   replace = glGetUniformLocation(prog[0],"Replace");
+   prog[1] = Program("virtual texture feedback",feedback_frag);
+   glUseProgram(prog[1]);
+   glUniform1f(glGetUniformLocation(prog[1],"Size"),hdr.size);
+   glUniform1f(glGetUniformLocation(prog[1],"Tile"),VT_TILE);
+   glUniform1f(glGetUniformLocation(prog[1],"Levels"),hdr.levels);
+   glUniform1f(glGetUniformLocation(prog[1],"Scale"),log2(VT_SCALE));
+   glUseProgram(0);
+   glGenBuffers(2,pbo);
+
+   //  The coarsest tile is always resident
+   pix = (unsigned char*)malloc(3*VT_STRIDE*VT_STRIDE);
+   if (!pix) Fatal("Cannot allocate virtual texture tile\n");
+   if (fseek(file,sizeof(header_t)+(Ntile-1)*3L*VT_STRIDE*VT_STRIDE,SEEK_SET) || fread(pix,3*VT_STRIDE*VT_STRIDE,1,file)!=1)
+      Fatal("Cannot read %s\n",name);
+   Place(Ntile-1,0,pix);
+   free(pix);
+   Table();
+
+   if (pthread_create(&loader,NULL,Loader,NULL)) Fatal("Cannot start virtual texture loader\n");
+   pthread_detach(loader);
+}
+
+/*
+ *  Ask for the tiles in the feedback that are not resident
+ */
+static void Request(const unsigned char* pix,int n)
+{
+   int i,l,Nmiss=0;
+   for (i=0;i<n;i++,pix+=4)
+   {
+      int x=pix[0],y=pix[1];
+      if (pix[3]!=255) continue;
+      //  The tile and its ancestors (coarser tiles stand in while it loads)
+      for (l=pix[2];l<hdr.levels;l++,x/=2,y/=2)
+      {
+         int k;
+         if (x>=Tiles(l) || y>=Tiles(l)) break;
+         k = first[l]+y*Tiles(l)+x;
+         if (used[k]==frame) break;
+         used[k] = frame;
+         if (slotof[k]<0 && !pending[k]) miss[Nmiss++] = k;
+      }
+   }
+   //  Coarse tiles first, no more at a time than fit in the cache
+   pthread_mutex_lock(&lock);
+   for (l=hdr.levels-1;l>=0;l--)
+      for (i=0;i<Nmiss && Nload<VT_SLOTS*VT_SLOTS;i++)
+         if (level[miss[i]]==l)
+         {
+            queue[(qhead+Nqueue)%Ntile] = miss[i];
+            Nqueue++;
+            pending[miss[i]] = 1;
+            Nload++;
+         }
+   pthread_cond_signal(&cond);
+   pthread_mutex_unlock(&lock);
+}
+
+/*
+ *  Slot for a new tile: a free one or the one needed least recently,
+ *  never one needed this frame or the coarsest tile
+ *    Returns -1 if there is none
+ */
+static int Slot(void)
+{
+   int s,best=-1;
+   for (s=0;s<VT_SLOTS*VT_SLOTS;s++)
+   {
+      if (tileat[s]<0) return s;
+      if (tileat[s]==Ntile-1 || used[tileat[s]]>=frame) continue;
+      if (best<0 || used[tileat[s]]<used[tileat[best]]) best = s;
+   }
+   return best;
+}
+
+/*
+ *  Act on the feedback of two frames ago and upload the tiles read since
+ *    Call at the start of a frame
+ */
+void VTexUpdate(void)
+{
+   int k,n;
+   if (!Ntile) return;
+   frame++;
+   //  Feedback written in the frame before last has arrived by now
+   k = frame&1;
+   if (filled[k])
+   {
+      const unsigned char* pix;
+      glBindBuffer(GL_PIXEL_PACK_BUFFER,pbo[k]);
+      pix = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
+      if (pix)
+      {
+         Request(pix,pw[k]*ph[k]);
+         glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+      filled[k] = 0;
+   }
+   //  Tiles read by the loader
+   for (n=0;n<VT_UPLOADS;n++)
+   {
+      loaded_t t;
+      int s;
+      pthread_mutex_lock(&lock);
+      if (!Ndone)
+      {
+         pthread_mutex_unlock(&lock);
+         break;
+      }
+      t = done[dhead];
+      dhead = (dhead+1)%Ntile;
+      Ndone--;
+      pending[t.tile] = 0;
+      Nload--;
+      pthread_mutex_unlock(&lock);
+      s = Slot();
+      if (s>=0) Place(t.tile,s,t.pix);
+      free(t.pix);
+   }
+   if (dirty) Table();
+}
+
+/*
+ *  Draw with the virtual texture (or its feedback shader) until VTexEnd
+ *    Call again after changing the texture environment
+ *    Texture coordinates come from VTexCoord
+ */
+void VTexBegin(void)
+{
+   if (active!=feedback)
+   {
+      active = feedback;
+      glUseProgram(prog[active]);
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D,ptex);
+      glActiveTexture(GL_TEXTURE2);
+      glBindTexture(GL_TEXTURE_2D,cache);
+      glActiveTexture(GL_TEXTURE0);
+   }
+   //  Follow the texture environment of the fixed-function pipeline
+   if (!feedback)
+   {
+      int mode;
+      glGetTexEnviv(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,&mode);
+      glUniform1i(replace,mode==GL_REPLACE);
+   }
+}
+
+/*
+ *  Back to the fixed-function pipeline
+ */
+void VTexEnd(void)
+{
+   glUseProgram(0);
+   active = -1;
+}
+
+/*
+ *  Set texture coordinate (s,t) of a ground block
+ *    Half a texel is left at the edges so blocks do not blend together
+ */
+void VTexCoord(int block,float s,float t)
+{
+   float e = 0.5/VT_BLOCK;
+   float b = (float)VT_BLOCK/hdr.size;
+   s = e+s*(1-2*e);
+   t = e+t*(1-2*e);
+   glTexCoord2f((block%grid+s)*b,(block/grid+t)*b);
+}
+
+/*
+ *  Draw the ground for feedback until VTexFeedbackEnd
+ */
+void VTexFeedbackBegin(void)
+{
+   int vp[4],w,h;
+   glGetIntegerv(GL_VIEWPORT,vp);
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING,&prev);
+   w = vp[2]/VT_SCALE>0 ? vp[2]/VT_SCALE : 1;
+   h = vp[3]/VT_SCALE>0 ? vp[3]/VT_SCALE : 1;
+   //  Render target at the new size
+   if (w!=fw || h!=fh)
+   {
+      fw = w;
+      fh = h;
+      if (!fbo)
+      {
+         glGenFramebuffers(1,&fbo);
+         glGenRenderbuffers(1,&color);
+         glGenRenderbuffers(1,&depth);
+      }
+      glBindRenderbuffer(GL_RENDERBUFFER,color);
+      glRenderbufferStorage(GL_RENDERBUFFER,GL_RGBA8,fw,fh);
+      glBindRenderbuffer(GL_RENDERBUFFER,depth);
+      glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT24,fw,fh);
+      glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_RENDERBUFFER,color);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,depth);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+         Fatal("Cannot create virtual texture feedback target\n");
+   }
+   glPushAttrib(GL_VIEWPORT_BIT|GL_COLOR_BUFFER_BIT);
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   glViewport(0,0,fw,fh);
+   glClearColor(0,0,0,0);
+   glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+   feedback = 1;
+}
+
+/*
+ *  Start reading the feedback back
+ */
+void VTexFeedbackEnd(void)
+{
+   int k = frame&1;
+   glBindBuffer(GL_PIXEL_PACK_BUFFER,pbo[k]);
+   if (pw[k]!=fw || ph[k]!=fh)
+   {
+      pw[k] = fw;
+      ph[k] = fh;
+      glBufferData(GL_PIXEL_PACK_BUFFER,4*fw*fh,NULL,GL_STREAM_READ);
+   }
+   glReadPixels(0,0,fw,fh,GL_RGBA,GL_UNSIGNED_BYTE,0);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+   filled[k] = 1;
+   glBindFramebuffer(GL_FRAMEBUFFER,prev);
+   glPopAttrib();
+   feedback = 0;
+}
+
+/*
+ *  Tiles resident, slots in the cache, tiles being read and tiles in all
+ */
+void VTexStats(int* resident,int* slots,int* loading,int* tiles)
+{
+   *resident = Nres;
+   *slots    = VT_SLOTS*VT_SLOTS;
+   *loading  = Nload;
+   *tiles    = Ntile;
+}
@@ -0,0 +1,48 @@
+/*
+ *  Virtual texture for the ground
+ *
+ *  Every ground block gets a unique VT_BLOCK x VT_BLOCK region of one large
+ *  virtual texture.  The texture is kept on disk as tiles of each mipmap
+ *  level with a border copied from their neighbours, so only the tiles that
+ *  are seen have to be in memory.  A fixed cache texture holds
+ *  VT_SLOTS x VT_SLOTS tiles, so the memory used does not grow with the
+ *  number of blocks.
+ *
+ *  The ground is also drawn at 1/VT_SCALE of the window with a shader that
+ *  writes the tile and level each pixel needs.  That feedback is read back
+ *  asynchronously and the missing tiles are read by a loader thread.  Up to
+ *  VT_UPLOADS of them a frame replace the least recently used tiles in the
+ *  cache, and a mipmapped page table (one texel per tile) points each tile
+ *  at its slot or the slot of the nearest coarser tile that is resident.
+ *  The coarsest tile is always resident.
+ */
+#ifndef VTEX_H
+#define VTEX_H
+
+#define VT_TILE    128   //  Texels on a side of a tile
+#define VT_BORDER  4     //  Texels of border on each side of a tile
+#define VT_SLOTS   8     //  Cache is VT_SLOTS x VT_SLOTS tiles
+#define VT_BLOCK   1024  //  Texels on a side of a ground block
+#define VT_SCALE   8     //  Feedback resolution divisor
+#define VT_UPLOADS 8     //  Most tiles uploaded a frame
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int vtex;  //  Virtual texture enabled
+
+void VTexOpen(const char* file,const char* source,int blocks);
+void VTexUpdate(void);
+void VTexBegin(void);
+void VTexEnd(void);
+void VTexCoord(int block,float s,float t);
+void VTexFeedbackBegin(void);
+void VTexFeedbackEnd(void);
+void VTexStats(int* resident,int* slots,int* loading,int* tiles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ *  Baked world transforms and bounds of the scene
+ */
+#include "CSCIx229.h"
+#include "scene.h"
+#include "xform.h"
+
+#define XF_RANGE 1000  //  Half size of the cube objects are baked in
+#define XF_SIZE  1000  //  Viewport size while baking
+#define XF_PAD   0.01  //  Margin for coarser levels of detail and rounding
+
+xform_t xform;
+
+static int      valid=0;       //  Table is baked
+static int      current=-1;    //  Object between XformBegin and XformEnd
+static mat4_t   rec[MAT_PARTS];//  Matrices being recorded
+static GLfloat* fb=NULL;       //  Feedback buffer
+static int      Nfb=0;
+
+/*
+ *  Allocate n floats
+ */
+static float* Floats(float* p,int n)
+{
+   p = (float*)realloc(p,n*sizeof(float));
+   if (!p) Fatal("Cannot allocate transform table for %d objects\n",n);
+   return p;
+}
+
+/*
+ *  Grow box [min,max] to take in the vertices in a feedback buffer
+ */
+static void Feedback(const GLfloat* b,int n,float min[3],float max[3])
+{
+   int i=0,j,k;
+   while (i<n)
+   {
+      int token = b[i++],nv;
+      if (token==GL_POLYGON_TOKEN)
+         nv = b[i++];
+      else if (token==GL_LINE_TOKEN || token==GL_LINE_RESET_TOKEN)
+         nv = 2;
+      else if (token==GL_PASS_THROUGH_TOKEN)
+      {
+         i++;
+         continue;
+      }
+      else
+         nv = 1;
+      //  Window coordinates back to world coordinates
+      for (j=0;j<nv;j++,i+=3)
+      {
+         float p[3] = {(2*b[i]/XF_SIZE-1)*XF_RANGE,(2*b[i+1]/XF_SIZE-1)*XF_RANGE,(1-2*b[i+2])*XF_RANGE};
+         for (k=0;k<3;k++)
+         {
+            if (p[k]<min[k]) min[k] = p[k];
+            if (p[k]>max[k]) max[k] = p[k];
+         }
+      }
+   }
+}
+
+/*
+ *  Draw object k once, recording its matrices and the box around what it draws
+ */
+static void Bake(int k,void (*draw)(int obj),float min[3],float max[3])
+{
+   int n,parts = xform.parts;
+   for (;;)
+   {
+      glFeedbackBuffer(Nfb,GL_3D,fb);
+      glRenderMode(GL_FEEDBACK);
+      XformBegin(k);
+      draw(k);
+      XformEnd();
+      n = glRenderMode(GL_RENDER);
+      if (n>=0) break;
+      //  Buffer too small: forget the parts and draw it again
+      xform.parts = parts;
+      xform.first[k] = -1;
+      Nfb *= 2;
+      fb = (GLfloat*)realloc(fb,Nfb*sizeof(GLfloat));
+      if (!fb) Fatal("Cannot allocate %d floats of feedback\n",Nfb);
+   }
+   min[0] = min[1] = min[2] = +1e30;
+   max[0] = max[1] = max[2] = -1e30;
+   Feedback(fb,n,min,max);
+}
+
+/*
+ *  Build the table the first time it is called
+ *    Every object is drawn once with draw in feedback mode, so nothing
+ *    reaches the framebuffer.  Call with a current context before the
+ *    bounds are used.
+ */
+void XformBake(void (*draw)(int obj))
+{
+   const mat4_t I = {{1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1}};
+   mat4_t M;
+   int i,k;
+   if (valid) return;
+   xform.n = Nscene;
+   for (i=0;i<3;i++)
+   {
+      xform.min[i]    = Floats(xform.min[i],Nscene);
+      xform.max[i]    = Floats(xform.max[i],Nscene);
+      xform.center[i] = Floats(xform.center[i],Nscene);
+   }
+   xform.radius = Floats(xform.radius,Nscene);
+   xform.first  = (int*)realloc(xform.first,Nscene*sizeof(int));
+   xform.count  = (int*)realloc(xform.count,Nscene*sizeof(int));
+   if (!xform.first || !xform.count) Fatal("Cannot allocate transform table for %d objects\n",Nscene);
+   for (k=0;k<Nscene;k++)
+   {
+      xform.first[k] = -1;
+      xform.count[k] = 0;
+   }
+   xform.parts = 0;
+   if (!fb)
+   {
+      Nfb = 1<<16;
+      fb = (GLfloat*)malloc(Nfb*sizeof(GLfloat));
+      if (!fb) Fatal("Cannot allocate %d floats of feedback\n",Nfb);
+   }
+   //  World coordinates map straight to the window (with z flipped)
+   glPushAttrib(GL_ENABLE_BIT|GL_VIEWPORT_BIT|GL_TRANSFORM_BIT);
+   glDisable(GL_CULL_FACE);
+   glViewport(0,0,XF_SIZE,XF_SIZE);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glOrtho(-XF_RANGE,+XF_RANGE,-XF_RANGE,+XF_RANGE,-XF_RANGE,+XF_RANGE);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   M = *MatTop();
+   MatLoad(I.m);
+   for (k=0;k<Nscene;k++)
+   {
+      float min[3],max[3],r=0;
+      Bake(k,draw,min,max);
+      //  Objects that draw nothing keep their tabulated bounds
+      if (min[0]>max[0])
+         ObjectBounds(scene+k,min,max);
+      for (i=0;i<3;i++)
+      {
+         min[i] -= XF_PAD;
+         max[i] += XF_PAD;
+      }
+      for (i=0;i<3;i++)
+      {
+         xform.min[i][k]    = min[i];
+         xform.max[i][k]    = max[i];
+         xform.center[i][k] = 0.5*(min[i]+max[i]);
+         r += (max[i]-min[i])*(max[i]-min[i]);
+      }
+      xform.radius[k] = 0.5*sqrt(r);
+   }
+   MatLoad(M.m);
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPopMatrix();
+   glPopAttrib();
+   valid = 1;
+}
+
+/*
+ *  Start drawing object obj
+ *    Its matrices are replayed if recorded, or recorded now
+ *    Must be balanced by XformEnd
+ */
+void XformBegin(int obj)
+{
+   current = obj;
+   if (xform.first[obj]>=0)
+      MatReplay(xform.world+xform.first[obj],xform.count[obj]);
+   else
+      MatRecord(rec);
+}
+
+/*
+ *  Finish drawing the object and keep any matrices it recorded
+ */
+void XformEnd(void)
+{
+   int k,n,obj=current;
+   int replay = xform.first[obj]>=0;
+   n = MatEnd();
+   current = -1;
+   if (replay) return;
+   //  Append to the parts
+   if (xform.parts+n>xform.mparts)
+   {
+      xform.mparts = 2*(xform.parts+n);
+      xform.world  = (mat4_t*)realloc(xform.world,xform.mparts*sizeof(mat4_t));
+      if (!xform.world) Fatal("Cannot allocate %d object matrices\n",xform.mparts);
+   }
+   xform.first[obj] = xform.parts;
+   xform.count[obj] = n;
+   for (k=0;k<n;k++)
+      xform.world[xform.parts+k] = rec[k];
+   xform.parts += n;
+}
@@ -0,0 +1,47 @@
+/*
+ *  Baked world transforms and bounds of the scene
+ *
+ *  Object bounds are computed once into a structure of arrays so culling,
+ *  sorting and level of detail read contiguous floats.  The matrices a draw
+ *  function builds are recorded when XformBake draws every object once in
+ *  feedback mode, and replayed after that, so the trigonometry of its
+ *  rotations is done once.  The bounding box of each object is taken from
+ *  the vertices that draw returned, so it matches what is drawn.  The scene
+ *  does not move, so this is done once at startup.
+ */
+#ifndef XFORM_H
+#define XFORM_H
+
+#include "vecmath.h"
+
+//  Scene table (structure of arrays indexed by object)
+typedef struct
+{
+   int     n;           //  Objects
+   float*  min[3];      //  World bounding box minimum (x,y,z)
+   float*  max[3];      //  World bounding box maximum (x,y,z)
+   float*  center[3];   //  Bounding box center (x,y,z)
+   float*  radius;      //  Half the bounding box diagonal
+   int*    first;       //  First part of the object (-1 before it is baked)
+   int*    count;       //  Number of parts
+   //  Parts (one per matrix a draw function uses)
+   int     parts;       //  Parts recorded
+   int     mparts;      //  Parts allocated
+   mat4_t* world;       //  World matrix
+} xform_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern xform_t xform;
+
+void XformBake(void (*draw)(int obj));
+void XformBegin(int obj);
+void XformEnd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif